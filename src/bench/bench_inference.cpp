@@ -0,0 +1,432 @@
+#include "../core/inference.h"
+#include "../core/model.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Замеры задержки и пропускной способности инференса. Без --model строится модель
+// со случайными весами заданных размеров. Результат - JSON на stdout или в --output
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Результат одного замера: задержки запросов (или батчей) и число сгенерированных токенов
+struct Measurement {
+    std::vector<double> latencies_ms;
+    long long tokens = 0;
+    double wall_seconds = 0.0;
+};
+
+std::vector<int> parse_list(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(std::stoi(item));
+        }
+    }
+    if (values.empty()) {
+        throw std::runtime_error("Пустой список значений: " + text);
+    }
+    return values;
+}
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Перцентиль по ближайшему рангу
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+    return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Пиковый объем резидентной памяти процесса в килобайтах
+long peak_rss_kb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+std::string json_string(const std::string& text) {
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+// Случайная задача из input_length слов словаря. Каждое восьмое слово - формула,
+// чтобы в замер попадал и разбор формул токенизатором
+std::string random_task(const std::vector<std::string>& words, int input_length, std::mt19937& generator) {
+    std::uniform_int_distribution<size_t> word_distribution(0, words.size() - 1);
+    std::string text;
+    for (int i = 0; i < input_length; ++i) {
+        if (!text.empty()) {
+            text += ' ';
+        }
+        if (i % 8 == 7) {
+            text += "$x^" + std::to_string(i) + " + 1$";
+        } else {
+            text += words[word_distribution(generator)];
+        }
+    }
+    return text;
+}
+
+} // namespace
+
+void print_usage() {
+    std::cout << "Использование: bench_inference [опции]\n"
+              << "Опции:\n"
+              << "  --model FILE           Пакет модели (.ftb). Без него - модель со случайными весами\n"
+              << "  --vocab N              Размер словаря случайной модели (по умолчанию 5000)\n"
+              << "  --emb-dim N            Размерность эмбеддингов случайной модели (по умолчанию 256)\n"
+              << "  --hidden-dim N         Размер скрытых слоёв случайной модели (по умолчанию 512)\n"
+              << "  --input-lengths L      Длины входа в словах через запятую (по умолчанию 8,32,128)\n"
+              << "  --output-lengths L     Длины ответа в токенах (по умолчанию 16,64)\n"
+              << "  --batch-sizes L        Размеры батча для generate_batch и solve_batch (по умолчанию 1,8,32)\n"
+              << "  --threads L            Число потоков для solve_task (по умолчанию 1,2,4)\n"
+              << "  --iterations N         Запросов на поток или батчей на замер (по умолчанию 20)\n"
+              << "  --warmup N             Прогревочных запросов перед замером (по умолчанию 3)\n"
+              << "  --torch-threads N      Потоков LibTorch внутри операции (по умолчанию не менять)\n"
+              << "  --output FILE          Записать JSON в файл вместо stdout\n"
+              << "  --help                 Показать эту справку\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string model_path;
+    std::string output_path;
+    int vocab_size = 5000;
+    int embedding_dim = 256;
+    int hidden_dim = 512;
+    std::vector<int> input_lengths = {8, 32, 128};
+    std::vector<int> output_lengths = {16, 64};
+    std::vector<int> batch_sizes = {1, 8, 32};
+    std::vector<int> thread_counts = {1, 2, 4};
+    int iterations = 20;
+    int warmup = 3;
+    int torch_threads = 0;
+    
+    // Разбор аргументов командной строки
+    try {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+                model_path = argv[++i];
+            } else if (strcmp(argv[i], "--vocab") == 0 && i + 1 < argc) {
+                vocab_size = std::stoi(argv[++i]);
+            } else if (strcmp(argv[i], "--emb-dim") == 0 && i + 1 < argc) {
+                embedding_dim = std::stoi(argv[++i]);
+            } else if (strcmp(argv[i], "--hidden-dim") == 0 && i + 1 < argc) {
+                hidden_dim = std::stoi(argv[++i]);
+            } else if (strcmp(argv[i], "--input-lengths") == 0 && i + 1 < argc) {
+                input_lengths = parse_list(argv[++i]);
+            } else if (strcmp(argv[i], "--output-lengths") == 0 && i + 1 < argc) {
+                output_lengths = parse_list(argv[++i]);
+            } else if (strcmp(argv[i], "--batch-sizes") == 0 && i + 1 < argc) {
+                batch_sizes = parse_list(argv[++i]);
+            } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                thread_counts = parse_list(argv[++i]);
+            } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+                iterations = std::stoi(argv[++i]);
+            } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+                warmup = std::stoi(argv[++i]);
+            } else if (strcmp(argv[i], "--torch-threads") == 0 && i + 1 < argc) {
+                torch_threads = std::stoi(argv[++i]);
+            } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+                output_path = argv[++i];
+            } else if (strcmp(argv[i], "--help") == 0) {
+                print_usage();
+                return 0;
+            } else {
+                std::cerr << "Неизвестный аргумент: " << argv[i] << std::endl;
+                print_usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка в аргументах: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    if (torch_threads > 0) {
+        torch::set_num_threads(torch_threads);
+    }
+    
+    try {
+        // Без пакета сохраняем случайную модель со словарем w4, w5, ... во временный пакет
+        std::string temp_path;
+        if (model_path.empty()) {
+            torch::manual_seed(42);
+            std::vector<std::pair<std::string, int>> entries;
+            for (int id = 4; id < vocab_size; ++id) {
+                entries.emplace_back("w" + std::to_string(id), id);
+            }
+            auto random_model = std::make_shared<formula_teacher::FormulaModel>(vocab_size, embedding_dim, hidden_dim);
+            temp_path = "/tmp/bench-inference-" + std::to_string(getpid()) + ".ftb";
+            random_model->save_bundle(temp_path, formula_teacher::FormulaTokenizer(entries));
+            model_path = temp_path;
+        }
+        
+        auto bundle = formula_teacher::BundleFile::open(model_path);
+        const auto& header = bundle->header();
+        vocab_size = header.vocab_size;
+        embedding_dim = header.embedding_dim;
+        hidden_dim = header.hidden_dim;
+        
+        // Слова для задач - обычные токены словаря, без специальных и формул
+        std::vector<std::string> words;
+        for (const auto& entry : bundle->vocabulary()) {
+            if (entry.second > formula_teacher::FormulaTokenizer::UNK && entry.first.find('<') == std::string::npos) {
+                words.push_back(entry.first);
+            }
+        }
+        if (words.empty()) {
+            throw std::runtime_error("В словаре модели нет обычных слов");
+        }
+        
+        auto model = formula_teacher::FormulaModel::from_bundle(bundle);
+        model->eval();
+        formula_teacher::FormulaTokenizer tokenizer(bundle->vocabulary());
+        
+        formula_teacher::FormulaInference inference;
+        if (!inference.load_model(model_path)) {
+            throw std::runtime_error("Не удалось загрузить модель для FormulaInference");
+        }
+        
+        // Пакет уже отображен в память, файл больше не нужен
+        if (!temp_path.empty()) {
+            std::remove(temp_path.c_str());
+        }
+        
+        std::mt19937 generator(42);
+        std::ostringstream results;
+        bool first_result = true;
+        
+        auto report = [&](const char* api, int input_length, int output_length, int batch_size, int threads,
+                          const Measurement& measurement) {
+            const auto& latencies = measurement.latencies_ms;
+            double mean = 0.0;
+            for (double latency : latencies) {
+                mean += latency;
+            }
+            mean = latencies.empty() ? 0.0 : mean / latencies.size();
+            
+            results << (first_result ? "\n" : ",\n") << "    {"
+                    << "\"api\": " << json_string(api)
+                    << ", \"input_length\": " << input_length
+                    << ", \"output_length\": " << output_length
+                    << ", \"batch_size\": " << batch_size
+                    << ", \"threads\": " << threads
+                    << ", \"samples\": " << latencies.size()
+                    << ", \"latency_ms\": {\"p50\": " << percentile(latencies, 50)
+                    << ", \"p90\": " << percentile(latencies, 90)
+                    << ", \"p99\": " << percentile(latencies, 99)
+                    << ", \"mean\": " << mean << "}"
+                    << ", \"tokens\": " << measurement.tokens
+                    << ", \"tokens_per_second\": "
+                    << (measurement.wall_seconds > 0 ? measurement.tokens / measurement.wall_seconds : 0.0)
+                    << ", \"peak_rss_kb\": " << peak_rss_kb() << "}";
+            first_result = false;
+            
+            std::cerr << api << ": вход " << input_length << ", ответ " << output_length << ", батч " << batch_size
+                      << ", потоков " << threads << ", p50 " << percentile(latencies, 50) << " мс" << std::endl;
+        };
+        
+        for (int input_length : input_lengths) {
+            for (int output_length : output_lengths) {
+                formula_teacher::GenerationOptions options;
+                options.max_length = output_length;
+                inference.set_generation_options(options);
+                
+                // Токены задач для FormulaModel, тексты - для FormulaInference
+                auto make_tasks = [&](int count) {
+                    std::vector<std::string> tasks;
+                    for (int i = 0; i < count; ++i) {
+                        tasks.push_back(random_task(words, input_length, generator));
+                    }
+                    return tasks;
+                };
+                auto to_tokens = [&](const std::string& task) {
+                    std::vector<int> tokens{formula_teacher::FormulaTokenizer::SOS};
+                    tokenizer.tokenize(task, tokens);
+                    tokens.push_back(formula_teacher::FormulaTokenizer::EOS);
+                    return tokens;
+                };
+                
+                // FormulaModel::generate: одна задача, один поток
+                {
+                    auto tasks = make_tasks(warmup + iterations);
+                    Measurement measurement;
+                    for (int i = 0; i < warmup; ++i) {
+                        model->generate(to_tokens(tasks[i]), options);
+                    }
+                    auto wall_start = Clock::now();
+                    for (int i = warmup; i < warmup + iterations; ++i) {
+                        auto tokens = to_tokens(tasks[i]);
+                        auto start = Clock::now();
+                        auto output = model->generate(tokens, options);
+                        measurement.latencies_ms.push_back(elapsed_ms(start));
+                        measurement.tokens += static_cast<long long>(output.size());
+                    }
+                    measurement.wall_seconds = elapsed_ms(wall_start) / 1000.0;
+                    report("generate", input_length, output_length, 1, 1, measurement);
+                }
+                
+                // FormulaModel::generate_batch: батч задач за вызов
+                for (int batch_size : batch_sizes) {
+                    Measurement measurement;
+                    auto make_batch = [&]() {
+                        std::vector<std::vector<int>> batch;
+                        for (const auto& task : make_tasks(batch_size)) {
+                            batch.push_back(to_tokens(task));
+                        }
+                        return batch;
+                    };
+                    for (int i = 0; i < warmup; ++i) {
+                        model->generate_batch(make_batch(), output_length);
+                    }
+                    double busy_ms = 0.0;
+                    for (int i = 0; i < iterations; ++i) {
+                        auto batch = make_batch();
+                        auto start = Clock::now();
+                        auto outputs = model->generate_batch(batch, output_length);
+                        double latency = elapsed_ms(start);
+                        measurement.latencies_ms.push_back(latency);
+                        busy_ms += latency;
+                        for (const auto& output : outputs) {
+                            measurement.tokens += static_cast<long long>(output.size());
+                        }
+                    }
+                    // Подготовка батчей не входит во время
+                    measurement.wall_seconds = busy_ms / 1000.0;
+                    report("generate_batch", input_length, output_length, batch_size, 1, measurement);
+                }
+                
+                // FormulaInference::solve_batch: непрерывный батч с токенизацией и детокенизацией
+                for (int batch_size : batch_sizes) {
+                    Measurement measurement;
+                    for (int i = 0; i < warmup; ++i) {
+                        inference.solve_batch(make_tasks(batch_size), batch_size);
+                    }
+                    double busy_ms = 0.0;
+                    for (int i = 0; i < iterations; ++i) {
+                        auto tasks = make_tasks(batch_size);
+                        auto start = Clock::now();
+                        auto solutions = inference.solve_batch(tasks, batch_size);
+                        double latency = elapsed_ms(start);
+                        measurement.latencies_ms.push_back(latency);
+                        busy_ms += latency;
+                        for (const auto& solution : solutions) {
+                            measurement.tokens += static_cast<long long>(tokenizer.tokenize(solution).size());
+                        }
+                    }
+                    measurement.wall_seconds = busy_ms / 1000.0;
+                    report("solve_batch", input_length, output_length, batch_size, 1, measurement);
+                }
+                
+                // FormulaInference::solve_task: токенизация, генерация и детокенизация в нескольких потоках
+                for (int threads : thread_counts) {
+                    std::vector<std::vector<std::string>> thread_tasks;
+                    for (int t = 0; t < threads; ++t) {
+                        thread_tasks.push_back(make_tasks(warmup + iterations));
+                    }
+                    
+                    std::vector<Measurement> per_thread(threads);
+                    std::atomic<int> ready{0};
+                    std::atomic<bool> go{false};
+                    std::vector<std::thread> workers;
+                    for (int t = 0; t < threads; ++t) {
+                        workers.emplace_back([&, t]() {
+                            formula_teacher::InferenceSession session;
+                            const auto& tasks = thread_tasks[t];
+                            for (int i = 0; i < warmup; ++i) {
+                                inference.solve_task(tasks[i], session);
+                            }
+                            
+                            // Все потоки начинают замер одновременно
+                            ready++;
+                            while (!go.load()) {
+                                std::this_thread::yield();
+                            }
+                            
+                            for (int i = warmup; i < warmup + iterations; ++i) {
+                                auto start = Clock::now();
+                                inference.solve_task(tasks[i], session);
+                                per_thread[t].latencies_ms.push_back(elapsed_ms(start));
+                                per_thread[t].tokens += static_cast<long long>(session.output_tokens.size());
+                            }
+                        });
+                    }
+                    
+                    while (ready.load() < threads) {
+                        std::this_thread::yield();
+                    }
+                    auto wall_start = Clock::now();
+                    go.store(true);
+                    for (auto& worker : workers) {
+                        worker.join();
+                    }
+                    
+                    Measurement measurement;
+                    measurement.wall_seconds = elapsed_ms(wall_start) / 1000.0;
+                    for (const auto& part : per_thread) {
+                        measurement.latencies_ms.insert(measurement.latencies_ms.end(),
+                                                        part.latencies_ms.begin(), part.latencies_ms.end());
+                        measurement.tokens += part.tokens;
+                    }
+                    report("solve_task", input_length, output_length, 1, threads, measurement);
+                }
+            }
+        }
+        
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"model\": {\"path\": " << json_string(temp_path.empty() ? model_path : "random")
+             << ", \"vocab_size\": " << vocab_size
+             << ", \"embedding_dim\": " << embedding_dim
+             << ", \"hidden_dim\": " << hidden_dim << "},\n"
+             << "  \"iterations\": " << iterations << ",\n"
+             << "  \"warmup\": " << warmup << ",\n"
+             << "  \"torch_threads\": " << torch::get_num_threads() << ",\n"
+             << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+             << "  \"results\": [" << results.str() << "\n  ],\n"
+             << "  \"peak_rss_kb\": " << peak_rss_kb() << "\n"
+             << "}\n";
+        
+        if (output_path.empty()) {
+            std::cout << json.str();
+        } else {
+            std::ofstream file(output_path);
+            if (!(file << json.str())) {
+                throw std::runtime_error("Не удалось записать " + output_path);
+            }
+        }
+        
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,270 @@
+#include "batch_scheduler.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace formula_teacher {
+
+BatchScheduler::BatchScheduler(std::shared_ptr<FormulaModel> model) : model(std::move(model)) {
+    // Грамматика от словаря другого размера не соответствует логитам
+    grammar = this->model->get_grammar();
+    if (grammar && grammar->vocab_size() != this->model->get_vocab_size()) {
+        grammar.reset();
+    }
+}
+
+void BatchScheduler::add(BatchSequence sequence) {
+    if (sequence.input_tokens.empty()) {
+        throw std::invalid_argument("Пустая входная последовательность в батче");
+    }
+    
+    // Ответ нулевой длины не требует ни одного шага
+    if (sequence.max_length <= 0) {
+        sequence.on_finish({});
+        return;
+    }
+    
+    waiting.push_back(std::move(sequence));
+}
+
+bool BatchScheduler::step() {
+    torch::NoGradGuard no_grad;
+    
+    // Срок и отмена проверяются перед шагом, как в FormulaModel::decode. Закончившие
+    // структуру ответа получают конец последовательности без шага декодера
+    for (size_t i = 0; i < slots.size(); ++i) {
+        Slot& slot = slots[i];
+        if (!slot.occupied) {
+            continue;
+        }
+        if (slot.sequence.limits.should_stop()) {
+            finish(i);
+        } else if (constrained(slot) && FormulaGrammar::complete(slot.grammar_state, slot.sequence.max_formulas)) {
+            slot.output_tokens.push_back(FormulaTokenizer::EOS);
+            if (slot.sequence.on_token) {
+                slot.sequence.on_token(FormulaTokenizer::EOS);
+            }
+            finish(i);
+        }
+    }
+    
+    try {
+        if (!waiting.empty()) {
+            admit();
+        }
+        if (active == 0) {
+            return !empty();
+        }
+        
+        // Шаг идет по слотам до последнего занятого и по входу до самого длинного из занятых
+        int64_t extent = 0;
+        int64_t length = 0;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].occupied) {
+                extent = static_cast<int64_t>(i) + 1;
+                length = std::max(length, slots[i].input_length);
+            }
+        }
+        
+        DecoderState state;
+        state.encoder_output = encoder_output.narrow(0, 0, extent).narrow(1, 0, length);
+        state.keys = keys.narrow(0, 0, extent).narrow(1, 0, length);
+        state.mask = mask.narrow(0, 0, extent).narrow(1, 0, length);
+        state.h = h.narrow(1, 0, extent);
+        state.c = c.narrow(1, 0, extent);
+        
+        auto step_tokens = tokens.narrow(0, 0, extent);
+        auto logits = model->decode_step(step_tokens, state);
+        
+        // Маска грамматики сразу для всех строк, свободные и неограниченные - без ограничений
+        std::vector<const GrammarState*> grammar_states(static_cast<size_t>(extent), nullptr);
+        std::vector<int> remaining(static_cast<size_t>(extent), 0);
+        bool any_constrained = false;
+        for (int64_t i = 0; i < extent; ++i) {
+            Slot& slot = slots[static_cast<size_t>(i)];
+            if (slot.occupied && constrained(slot)) {
+                grammar_states[static_cast<size_t>(i)] = &slot.grammar_state;
+                remaining[static_cast<size_t>(i)] =
+                    slot.sequence.max_length - static_cast<int>(slot.output_tokens.size()) - 1;
+                any_constrained = true;
+            }
+        }
+        if (any_constrained) {
+            // max_formulas не нужен: закончившие структуру строки завершены перед шагом
+            auto allowed = grammar_mask(*grammar, grammar_states, remaining, 0);
+            logits.masked_fill_(allowed.logical_not(), -std::numeric_limits<float>::infinity());
+        }
+        
+        // Шаг LSTM возвращает новое состояние - переносим его обратно в слоты
+        h.narrow(1, 0, extent).copy_(state.h);
+        c.narrow(1, 0, extent).copy_(state.c);
+        
+        auto top_tokens = logits.argmax(1);
+        step_tokens.copy_(top_tokens);
+        
+        // Строки свободных слотов внутри диапазона посчитаны впустую, их токены не нужны
+        auto top_access = top_tokens.accessor<int64_t, 1>();
+        for (int64_t i = 0; i < extent; ++i) {
+            Slot& slot = slots[static_cast<size_t>(i)];
+            if (!slot.occupied) {
+                continue;
+            }
+            
+            int token = static_cast<int>(top_access[i]);
+            slot.output_tokens.push_back(token);
+            if (constrained(slot)) {
+                grammar->advance(slot.grammar_state, token);
+            }
+            if (slot.sequence.on_token) {
+                slot.sequence.on_token(token);
+            }
+            
+            if (token == FormulaTokenizer::EOS ||
+                static_cast<int>(slot.output_tokens.size()) >= slot.sequence.max_length) {
+                finish(static_cast<size_t>(i));
+            }
+        }
+    } catch (const std::exception& e) {
+        fail(e);
+    }
+    
+    return !empty();
+}
+
+void BatchScheduler::admit() {
+    std::vector<BatchSequence> joining(std::make_move_iterator(waiting.begin()),
+                                       std::make_move_iterator(waiting.end()));
+    waiting.clear();
+    
+    int64_t count = static_cast<int64_t>(joining.size());
+    int64_t max_input_length = 0;
+    for (const auto& sequence : joining) {
+        max_input_length = std::max(max_input_length, static_cast<int64_t>(sequence.input_tokens.size()));
+    }
+    
+    // Один проход энкодера на все присоединяющиеся, короткие входы дополняются PAD (0)
+    auto input_tensor = torch::zeros({count, max_input_length}, torch::kLong);
+    auto lengths = torch::empty({count}, torch::kLong);
+    auto input_access = input_tensor.accessor<int64_t, 2>();
+    auto length_access = lengths.accessor<int64_t, 1>();
+    for (int64_t row = 0; row < count; ++row) {
+        const auto& input_tokens = joining[static_cast<size_t>(row)].input_tokens;
+        for (size_t k = 0; k < input_tokens.size(); ++k) {
+            input_access[row][static_cast<int64_t>(k)] = input_tokens[k];
+        }
+        length_access[row] = static_cast<int64_t>(input_tokens.size());
+    }
+    
+    auto joining_mask = torch::arange(max_input_length, torch::kLong).unsqueeze(0) >= lengths.unsqueeze(1);
+    DecoderState state;
+    try {
+        state = model->start_decoding(model->encode(input_tensor, lengths), joining_mask);
+    } catch (const std::exception& e) {
+        // Последовательности уже вне очереди - сообщаем об ошибке только им
+        for (auto& sequence : joining) {
+            sequence.on_error(e);
+        }
+        return;
+    }
+    
+    // Свободные слоты с наименьшими номерами, чтобы диапазон шага оставался плотным
+    std::vector<int64_t> slot_indices;
+    for (size_t i = 0; i < slots.size() && static_cast<int64_t>(slot_indices.size()) < count; ++i) {
+        if (!slots[i].occupied) {
+            slot_indices.push_back(static_cast<int64_t>(i));
+        }
+    }
+    while (static_cast<int64_t>(slot_indices.size()) < count) {
+        slot_indices.push_back(static_cast<int64_t>(slots.size()));
+        slots.emplace_back();
+    }
+    reserve(static_cast<int64_t>(slots.size()), max_input_length, state.encoder_output.size(2));
+    
+    auto rows = torch::tensor(slot_indices, torch::kLong);
+    encoder_output.narrow(1, 0, max_input_length).index_copy_(0, rows, state.encoder_output);
+    keys.narrow(1, 0, max_input_length).index_copy_(0, rows, state.keys);
+    mask.index_fill_(0, rows, true);
+    mask.narrow(1, 0, max_input_length).index_copy_(0, rows, joining_mask);
+    h.index_fill_(1, rows, 0.0);
+    c.index_fill_(1, rows, 0.0);
+    tokens.index_fill_(0, rows, static_cast<int64_t>(FormulaTokenizer::SOS));
+    
+    for (int64_t row = 0; row < count; ++row) {
+        Slot& slot = slots[static_cast<size_t>(slot_indices[row])];
+        slot.occupied = true;
+        slot.input_length = length_access[row];
+        slot.sequence = std::move(joining[static_cast<size_t>(row)]);
+        slot.output_tokens.clear();
+        slot.grammar_state = GrammarState();
+        ++active;
+    }
+}
+
+void BatchScheduler::reserve(int64_t slot_count, int64_t input_length, int64_t hidden_dim) {
+    int64_t slot_capacity = capacity();
+    int64_t length_capacity = mask.defined() ? mask.size(1) : 0;
+    if (slot_count <= slot_capacity && input_length <= length_capacity) {
+        return;
+    }
+    
+    // Рост с запасом, чтобы не перекладывать тензоры на каждом присоединении
+    int64_t new_slots = slot_count > slot_capacity ? std::max(slot_count, slot_capacity * 2) : slot_capacity;
+    int64_t new_length = input_length > length_capacity ? std::max(input_length, length_capacity * 2) : length_capacity;
+    
+    auto options = torch::TensorOptions().dtype(torch::kFloat);
+    auto new_encoder_output = torch::zeros({new_slots, new_length, hidden_dim}, options);
+    auto new_keys = torch::zeros({new_slots, new_length, hidden_dim}, options);
+    auto new_mask = torch::ones({new_slots, new_length}, torch::kBool);
+    auto new_h = torch::zeros({1, new_slots, hidden_dim}, options);
+    auto new_c = torch::zeros({1, new_slots, hidden_dim}, options);
+    auto new_tokens = torch::full({new_slots}, static_cast<int64_t>(FormulaTokenizer::PAD), torch::kLong);
+    
+    if (slot_capacity > 0) {
+        new_encoder_output.narrow(0, 0, slot_capacity).narrow(1, 0, length_capacity).copy_(encoder_output);
+        new_keys.narrow(0, 0, slot_capacity).narrow(1, 0, length_capacity).copy_(keys);
+        new_mask.narrow(0, 0, slot_capacity).narrow(1, 0, length_capacity).copy_(mask);
+        new_h.narrow(1, 0, slot_capacity).copy_(h);
+        new_c.narrow(1, 0, slot_capacity).copy_(c);
+        new_tokens.narrow(0, 0, slot_capacity).copy_(tokens);
+    }
+    
+    encoder_output = new_encoder_output;
+    keys = new_keys;
+    mask = new_mask;
+    h = new_h;
+    c = new_c;
+    tokens = new_tokens;
+}
+
+void BatchScheduler::finish(size_t index) {
+    Slot& slot = slots[index];
+    slot.occupied = false;
+    --active;
+    
+    // Обработчик может поставить новую последовательность - слот к этому моменту свободен
+    auto sequence = std::move(slot.sequence);
+    auto output_tokens = std::move(slot.output_tokens);
+    slot.output_tokens = std::vector<int>();
+    sequence.on_finish(std::move(output_tokens));
+}
+
+void BatchScheduler::fail(const std::exception& error) {
+    std::vector<BatchSequence> failed;
+    for (auto& slot : slots) {
+        if (slot.occupied) {
+            slot.occupied = false;
+            failed.push_back(std::move(slot.sequence));
+        }
+    }
+    for (auto& sequence : waiting) {
+        failed.push_back(std::move(sequence));
+    }
+    waiting.clear();
+    active = 0;
+    
+    for (auto& sequence : failed) {
+        sequence.on_error(error);
+    }
+}
+
+} // namespace formula_teacher
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "model.h"
+#include "request_control.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace formula_teacher {
+
+// Последовательность для непрерывного батча
+struct BatchSequence {
+    // Вход с токенами начала и конца последовательности
+    std::vector<int> input_tokens;
+    
+    // Максимальная длина ответа в токенах
+    int max_length = 100;
+    
+    // Срок и отмена, проверяются перед каждым шагом
+    RequestLimits limits;
+    
+    // Ограничение ответа грамматикой модели (см. GenerationOptions::constrain_formulas)
+    bool constrain_formulas = false;
+    int max_formulas = 0;
+    
+    // Очередной токен ответа, может быть пустым
+    TokenCallback on_token;
+    
+    // Завершение: ответ (с токеном конца последовательности, если он выдан).
+    // Вызывается ровно один раз, либо он, либо on_error
+    std::function<void(std::vector<int>)> on_finish;
+    
+    // Ошибка модели на шаге, в котором участвовала последовательность
+    std::function<void(const std::exception&)> on_error;
+};
+
+// Непрерывный (пошаговый) батч жадного декодирования. Декодер делает шаг сразу по всем
+// занятым слотам, новые последовательности присоединяются на любом шаге после прохода
+// энкодера, а выдавшие конец последовательности освобождают слот для следующих.
+// В отличие от generate_batch короткие ответы не ждут самого длинного в батче.
+//
+// Выход энкодера, ключи внимания, маска входа и состояние LSTM хранятся в тензорах,
+// индексированных номером слота: присоединение и выбывание не перекладывают остальные
+// строки. Шаг идет по слотам до последнего занятого, свободные слоты занимаются
+// с наименьшего номера. Кандидаты выходной проекции у задач разные, поэтому батч
+// считает логиты по всему словарю. Маска грамматики для ограниченных последовательностей
+// строится одной операцией на все строки шага. Не потокобезопасен: им владеет один поток
+class BatchScheduler {
+public:
+    explicit BatchScheduler(std::shared_ptr<FormulaModel> model);
+    
+    BatchScheduler(const BatchScheduler&) = delete;
+    BatchScheduler& operator=(const BatchScheduler&) = delete;
+    
+    // Постановка в очередь: последовательность займет слот на ближайшем шаге.
+    // Бросает std::invalid_argument для пустого входа
+    void add(BatchSequence sequence);
+    
+    // Шаг: завершение остановленных по сроку или отмене и закончивших структуру ответа
+    // (с токеном конца последовательности, без шага декодера), присоединение ожидающих
+    // (один проход энкодера на всех), шаг декодера по занятым слотам и завершение
+    // выдавших конец последовательности. Обработчики вызываются в этом потоке.
+    // При ошибке модели все последовательности получают on_error.
+    // Возвращает false, если последовательностей не осталось
+    bool step();
+    
+    // Последовательностей в слотах и в очереди
+    size_t size() const { return active + waiting.size(); }
+    bool empty() const { return size() == 0; }
+    
+    // Емкость тензоров слотов (растет по мере надобности)
+    int64_t capacity() const { return tokens.defined() ? tokens.size(0) : 0; }
+    
+private:
+    struct Slot {
+        bool occupied = false;
+        int64_t input_length = 0;
+        BatchSequence sequence;
+        std::vector<int> output_tokens;
+        GrammarState grammar_state;
+    };
+    
+    // Проход энкодера по ожидающим и запись их в свободные слоты
+    void admit();
+    
+    // Расширение тензоров слотов до slot_count слотов и входа длиной input_length
+    void reserve(int64_t slot_count, int64_t input_length, int64_t hidden_dim);
+    
+    // Ограничена ли последовательность слота грамматикой
+    bool constrained(const Slot& slot) const { return grammar && slot.sequence.constrain_formulas; }
+    
+    // Освобождение слота и вызов on_finish
+    void finish(size_t index);
+    
+    // Ошибка модели: все последовательности завершаются с on_error
+    void fail(const std::exception& error);
+    
+    std::shared_ptr<FormulaModel> model;
+    
+    // Грамматика модели на момент создания батча, может отсутствовать
+    std::shared_ptr<const FormulaGrammar> grammar;
+    
+    std::vector<Slot> slots;
+    std::deque<BatchSequence> waiting;
+    size_t active = 0;
+    
+    // Тензоры слотов: выход энкодера и ключи внимания [N, S, H], маска входа [N, S]
+    // (true - позиция за концом входа), состояние LSTM [1, N, H] и предыдущие токены [N]
+    torch::Tensor encoder_output;
+    torch::Tensor keys;
+    torch::Tensor mask;
+    torch::Tensor h;
+    torch::Tensor c;
+    torch::Tensor tokens;
+};
+
+} // namespace formula_teacher
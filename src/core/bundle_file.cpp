@@ -0,0 +1,460 @@
+#include "bundle_file.h"
+#include "digest.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace formula_teacher {
+
+namespace {
+
+uint64_t align_up(uint64_t value) {
+    return (value + BUNDLE_ALIGNMENT - 1) & ~(BUNDLE_ALIGNMENT - 1);
+}
+
+// Дописывает нули до смещения offset
+void pad_to(std::ofstream& file, uint64_t& position, uint64_t offset) {
+    static const char zeros[BUNDLE_ALIGNMENT] = {};
+    while (position < offset) {
+        uint64_t chunk = std::min<uint64_t>(offset - position, sizeof(zeros));
+        file.write(zeros, static_cast<std::streamsize>(chunk));
+        position += chunk;
+    }
+}
+
+// Раскладка пакета, общая для файла и сегмента разделяемой памяти
+struct BundleLayout {
+    BundleHeader header{};
+    std::vector<BundleTensor> table;
+    std::string vocabulary_data;
+};
+
+BundleLayout make_layout(int vocab_size, int embedding_dim, int hidden_dim,
+                         const std::vector<BundleTensorData>& tensors,
+                         const std::vector<std::pair<std::string, int>>& vocabulary) {
+    BundleLayout layout;
+    BundleHeader& file_header = layout.header;
+    std::memcpy(file_header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    file_header.version = BUNDLE_VERSION;
+    file_header.tensor_count = static_cast<uint32_t>(tensors.size());
+    file_header.vocab_size = vocab_size;
+    file_header.embedding_dim = embedding_dim;
+    file_header.hidden_dim = hidden_dim;
+    file_header.vocabulary_count = static_cast<uint32_t>(vocabulary.size());
+    file_header.tensor_table_offset = sizeof(BundleHeader);
+    
+    // Раскладка весов
+    std::vector<BundleTensor>& table = layout.table;
+    table.resize(tensors.size());
+    uint64_t offset = align_up(sizeof(BundleHeader) + tensors.size() * sizeof(BundleTensor));
+    uint64_t model_digest = DIGEST_SEED;
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        const auto& tensor = tensors[i];
+        if (tensor.name.size() >= sizeof(table[i].name) || tensor.shape.empty() || tensor.shape.size() > 4) {
+            throw std::runtime_error("Тензор нельзя записать в пакет модели: " + tensor.name);
+        }
+        
+        std::strncpy(table[i].name, tensor.name.c_str(), sizeof(table[i].name) - 1);
+        table[i].ndim = static_cast<uint32_t>(tensor.shape.size());
+        uint64_t elements = 1;
+        for (size_t d = 0; d < tensor.shape.size(); ++d) {
+            table[i].shape[d] = tensor.shape[d];
+            elements *= static_cast<uint64_t>(tensor.shape[d]);
+        }
+        table[i].offset = offset;
+        table[i].nbytes = elements * sizeof(float);
+        offset = align_up(offset + table[i].nbytes);
+        
+        model_digest = digest_bytes(table[i].name, sizeof(table[i].name), model_digest);
+        model_digest = digest_bytes(tensor.data, table[i].nbytes, model_digest);
+    }
+    
+    // Словарь
+    std::string& vocabulary_data = layout.vocabulary_data;
+    for (const auto& [token, id] : vocabulary) {
+        int32_t token_id = id;
+        uint32_t length = static_cast<uint32_t>(token.size());
+        vocabulary_data.append(reinterpret_cast<const char*>(&token_id), sizeof(token_id));
+        vocabulary_data.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        vocabulary_data.append(token);
+    }
+    file_header.vocabulary_offset = offset;
+    file_header.vocabulary_bytes = vocabulary_data.size();
+    file_header.file_size = offset + vocabulary_data.size();
+    file_header.model_digest = model_digest;
+    file_header.vocabulary_digest = digest_bytes(vocabulary_data.data(), vocabulary_data.size());
+    
+    return layout;
+}
+
+// Пакеты в разделяемой памяти, подключенные в этом процессе, по ключу
+std::mutex shared_mutex;
+std::unordered_map<uint64_t, std::weak_ptr<BundleFile>> shared_bundles;
+
+int lock_file(int fd, int operation) {
+    int result;
+    do {
+        result = flock(fd, operation);
+    } while (result != 0 && errno == EINTR);
+    return result;
+}
+
+// Открыт ли через fd тот же сегмент, что сейчас доступен по имени name
+bool same_segment(int fd, const std::string& name) {
+    int current = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (current < 0) {
+        return false;
+    }
+    
+    struct stat ours;
+    struct stat theirs;
+    bool same = fstat(fd, &ours) == 0 && fstat(current, &theirs) == 0 &&
+                ours.st_dev == theirs.st_dev && ours.st_ino == theirs.st_ino;
+    close(current);
+    return same;
+}
+
+// Сегмент нулевого размера: создатель открыл его, но еще не взял блокировку и не выделил место
+bool empty_segment(int fd) {
+    struct stat segment_stat;
+    return fstat(fd, &segment_stat) == 0 && segment_stat.st_size == 0;
+}
+
+// Сколько ждать создателя, который успел только открыть сегмент
+const int EMPTY_SEGMENT_RETRIES = 50;
+const std::chrono::milliseconds EMPTY_SEGMENT_BACKOFF(10);
+
+} // namespace
+
+bool BundleFile::is_bundle(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(BUNDLE_MAGIC)];
+    if (!file.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, BUNDLE_MAGIC, sizeof(magic)) == 0;
+}
+
+std::shared_ptr<BundleFile> BundleFile::open(const std::string& path) {
+    std::shared_ptr<BundleFile> bundle(new BundleFile());
+    
+    bundle->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (bundle->fd < 0) {
+        throw std::runtime_error("Не удалось открыть пакет модели: " + path);
+    }
+    
+    struct stat file_stat;
+    if (fstat(bundle->fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(BundleHeader)) {
+        throw std::runtime_error("Поврежден пакет модели: " + path);
+    }
+    bundle->mapping_size = static_cast<size_t>(file_stat.st_size);
+    
+    void* mapping = mmap(nullptr, bundle->mapping_size, PROT_READ, MAP_SHARED, bundle->fd, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Не удалось отобразить пакет модели в память: " + path);
+    }
+    bundle->mapping = static_cast<const unsigned char*>(mapping);
+    
+    bundle->validate(path);
+    
+    // Веса читаются целиком при первом же проходе модели: просим ядро подгрузить их заранее
+    // и, где поддерживается, отдать под них большие страницы
+    uint64_t weights_start = bundle->header().tensor_table_offset;
+    uint64_t weights_end = bundle->header().vocabulary_offset;
+#ifdef MADV_HUGEPAGE
+    madvise(mapping, bundle->mapping_size, MADV_HUGEPAGE);
+#endif
+    madvise(static_cast<char*>(mapping) + (weights_start & ~uint64_t(4095)),
+            weights_end - (weights_start & ~uint64_t(4095)), MADV_WILLNEED);
+    
+    return bundle;
+}
+
+void BundleFile::validate(const std::string& path) const {
+    const BundleHeader& file_header = header();
+    if (std::memcmp(file_header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0 ||
+        file_header.version != BUNDLE_VERSION) {
+        throw std::runtime_error("Неизвестный формат пакета модели: " + path);
+    }
+    
+    uint64_t table_end = file_header.tensor_table_offset + uint64_t(file_header.tensor_count) * sizeof(BundleTensor);
+    if (file_header.file_size != mapping_size ||
+        file_header.tensor_table_offset < sizeof(BundleHeader) ||
+        table_end > file_header.vocabulary_offset ||
+        file_header.vocabulary_offset + file_header.vocabulary_bytes > mapping_size) {
+        throw std::runtime_error("Поврежден пакет модели: " + path);
+    }
+    
+    for (uint32_t i = 0; i < file_header.tensor_count; ++i) {
+        const BundleTensor& tensor = tensors()[i];
+        
+        uint64_t elements = 1;
+        for (uint32_t d = 0; d < tensor.ndim && d < 4; ++d) {
+            elements *= static_cast<uint64_t>(tensor.shape[d]);
+        }
+        if (tensor.ndim == 0 || tensor.ndim > 4 ||
+            tensor.name[sizeof(tensor.name) - 1] != '\0' ||
+            tensor.offset % BUNDLE_ALIGNMENT != 0 ||
+            tensor.nbytes != elements * sizeof(float) ||
+            tensor.offset < table_end ||
+            tensor.offset + tensor.nbytes > file_header.vocabulary_offset) {
+            throw std::runtime_error("Поврежден пакет модели: " + path);
+        }
+    }
+}
+
+BundleFile::~BundleFile() {
+    if (mapping) {
+        munmap(const_cast<unsigned char*>(mapping), mapping_size);
+    }
+    if (fd >= 0) {
+        if (!segment_name.empty()) {
+            release_shared();
+        }
+        close(fd);
+    }
+}
+
+const BundleTensor* BundleFile::find_tensor(const std::string& name) const {
+    for (uint32_t i = 0; i < header().tensor_count; ++i) {
+        if (name == tensors()[i].name) {
+            return &tensors()[i];
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::pair<std::string, int>> BundleFile::vocabulary() const {
+    std::vector<std::pair<std::string, int>> entries;
+    entries.reserve(header().vocabulary_count);
+    
+    const unsigned char* position = mapping + header().vocabulary_offset;
+    const unsigned char* end = position + header().vocabulary_bytes;
+    for (uint32_t i = 0; i < header().vocabulary_count; ++i) {
+        int32_t id;
+        uint32_t length;
+        if (end - position < static_cast<ptrdiff_t>(sizeof(id) + sizeof(length))) {
+            throw std::runtime_error("Поврежден словарь в пакете модели");
+        }
+        std::memcpy(&id, position, sizeof(id));
+        std::memcpy(&length, position + sizeof(id), sizeof(length));
+        position += sizeof(id) + sizeof(length);
+        
+        if (static_cast<uint64_t>(end - position) < length) {
+            throw std::runtime_error("Поврежден словарь в пакете модели");
+        }
+        entries.emplace_back(std::string(reinterpret_cast<const char*>(position), length), id);
+        position += length;
+    }
+    
+    return entries;
+}
+
+void BundleFile::write(const std::string& path, int vocab_size, int embedding_dim, int hidden_dim,
+                       const std::vector<BundleTensorData>& tensors,
+                       const std::vector<std::pair<std::string, int>>& vocabulary) {
+    BundleLayout layout = make_layout(vocab_size, embedding_dim, hidden_dim, tensors, vocabulary);
+    const BundleHeader& file_header = layout.header;
+    const std::vector<BundleTensor>& table = layout.table;
+    const std::string& vocabulary_data = layout.vocabulary_data;
+    
+    // Пишем во временный файл и переименовываем: процессы, у которых отображен
+    // прежний пакет, продолжают читать старые страницы
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Не удалось создать пакет модели: " + path);
+        }
+        
+        uint64_t position = 0;
+        file.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
+        file.write(reinterpret_cast<const char*>(table.data()),
+                   static_cast<std::streamsize>(table.size() * sizeof(BundleTensor)));
+        position = sizeof(file_header) + table.size() * sizeof(BundleTensor);
+        
+        for (size_t i = 0; i < tensors.size(); ++i) {
+            pad_to(file, position, table[i].offset);
+            file.write(reinterpret_cast<const char*>(tensors[i].data), static_cast<std::streamsize>(table[i].nbytes));
+            position += table[i].nbytes;
+        }
+        
+        pad_to(file, position, file_header.vocabulary_offset);
+        file.write(vocabulary_data.data(), static_cast<std::streamsize>(vocabulary_data.size()));
+        
+        if (!file.flush()) {
+            throw std::runtime_error("Ошибка записи пакета модели: " + path);
+        }
+    }
+    
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("Не удалось сохранить пакет модели: " + path);
+    }
+}
+
+std::string BundleFile::shared_name(uint64_t key) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "/formula-teacher-%u-%016llx", static_cast<unsigned>(getuid()),
+                  static_cast<unsigned long long>(key));
+    return name;
+}
+
+std::shared_ptr<BundleFile> BundleFile::map_shared(int segment_fd, const std::string& name) {
+    // Создатель держит монопольную блокировку, пока заполняет сегмент
+    if (lock_file(segment_fd, LOCK_SH) != 0) {
+        return nullptr;
+    }
+    
+    struct stat segment_stat;
+    if (fstat(segment_fd, &segment_stat) != 0 || static_cast<size_t>(segment_stat.st_size) < sizeof(BundleHeader)) {
+        return nullptr;
+    }
+    
+    void* mapping = mmap(nullptr, static_cast<size_t>(segment_stat.st_size), PROT_READ, MAP_SHARED, segment_fd, 0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    
+    std::shared_ptr<BundleFile> bundle(new BundleFile());
+    bundle->mapping = static_cast<const unsigned char*>(mapping);
+    bundle->mapping_size = static_cast<size_t>(segment_stat.st_size);
+    
+    // Сигнатура пишется последней: без нее сегмент не заполнен до конца
+    if (std::memcmp(bundle->header().magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+        return nullptr;
+    }
+    bundle->validate(name);
+    
+    bundle->fd = segment_fd;
+    bundle->segment_name = name;
+    return bundle;
+}
+
+std::shared_ptr<BundleFile> BundleFile::attach_shared(uint64_t key) {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    if (auto bundle = shared_bundles[key].lock()) {
+        return bundle;
+    }
+    
+    std::string name = shared_name(key);
+    int segment_fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (segment_fd < 0) {
+        return nullptr;
+    }
+    
+    std::shared_ptr<BundleFile> bundle;
+    for (int attempt = 0;; ++attempt) {
+        try {
+            bundle = map_shared(segment_fd, name);
+        } catch (const std::runtime_error&) {
+            bundle = nullptr;
+        }
+        if (bundle || !empty_segment(segment_fd) || attempt == EMPTY_SEGMENT_RETRIES) {
+            break;
+        }
+        
+        // Между O_EXCL и LOCK_EX создателя сегмент пуст и не заблокирован - это не падение.
+        // Разделяемую блокировку отпускаем, иначе создатель не получит монопольную
+        lock_file(segment_fd, LOCK_UN);
+        std::this_thread::sleep_for(EMPTY_SEGMENT_BACKOFF);
+    }
+    if (!bundle) {
+        // Создатель упал, не заполнив сегмент: удаляем его, если больше никто не подключен.
+        // Пустой сегмент считается брошенным, только если так и не начал заполняться за время ожидания
+        if (lock_file(segment_fd, LOCK_EX | LOCK_NB) == 0 && same_segment(segment_fd, name)) {
+            shm_unlink(name.c_str());
+        }
+        close(segment_fd);
+        return nullptr;
+    }
+    
+    shared_bundles[key] = bundle;
+    return bundle;
+}
+
+std::shared_ptr<BundleFile> BundleFile::publish_shared(uint64_t key, int vocab_size, int embedding_dim, int hidden_dim,
+                                                       const std::vector<BundleTensorData>& tensors,
+                                                       const std::vector<std::pair<std::string, int>>& vocabulary) {
+    std::string name = shared_name(key);
+    
+    // Два процесса могут создавать сегмент одновременно: проигравший подключается к нему
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        if (auto bundle = attach_shared(key)) {
+            return bundle;
+        }
+        
+        int segment_fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (segment_fd < 0) {
+            if (errno == EEXIST) {
+                continue;
+            }
+            throw std::runtime_error("Не удалось создать сегмент разделяемой памяти: " + name);
+        }
+        lock_file(segment_fd, LOCK_EX);
+        
+        BundleLayout layout = make_layout(vocab_size, embedding_dim, hidden_dim, tensors, vocabulary);
+        size_t size = static_cast<size_t>(layout.header.file_size);
+        
+        // Место резервируется сразу: при нехватке памяти в tmpfs запись в отображение
+        // закончилась бы SIGBUS, а не ошибкой
+        int error = posix_fallocate(segment_fd, 0, static_cast<off_t>(size));
+        void* mapping = error == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0) : MAP_FAILED;
+        if (mapping == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            close(segment_fd);
+            throw std::runtime_error("Недостаточно разделяемой памяти для весов модели: " + name);
+        }
+        
+        unsigned char* image = static_cast<unsigned char*>(mapping);
+        std::memcpy(image + layout.header.tensor_table_offset, layout.table.data(),
+                    layout.table.size() * sizeof(BundleTensor));
+        for (size_t i = 0; i < tensors.size(); ++i) {
+            std::memcpy(image + layout.table[i].offset, tensors[i].data, layout.table[i].nbytes);
+        }
+        std::memcpy(image + layout.header.vocabulary_offset, layout.vocabulary_data.data(),
+                    layout.vocabulary_data.size());
+        
+        // Сигнатура последней: сегмент упавшего создателя узнается по ее отсутствию
+        std::memcpy(image + sizeof(BUNDLE_MAGIC), reinterpret_cast<const char*>(&layout.header) + sizeof(BUNDLE_MAGIC),
+                    sizeof(BundleHeader) - sizeof(BUNDLE_MAGIC));
+        std::memcpy(image, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+        munmap(mapping, size);
+        
+        // Дальше сегмент только читается, в том числе создателем
+        lock_file(segment_fd, LOCK_SH);
+        std::shared_ptr<BundleFile> bundle = map_shared(segment_fd, name);
+        if (!bundle) {
+            close(segment_fd);
+            throw std::runtime_error("Не удалось подключиться к сегменту разделяемой памяти: " + name);
+        }
+        
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_bundles[key] = bundle;
+        return bundle;
+    }
+    
+    throw std::runtime_error("Не удалось создать сегмент разделяемой памяти: " + name);
+}
+
+void BundleFile::release_shared() {
+    // Монопольная блокировка достается, только если других подключенных процессов нет.
+    // Имя могло уже указывать на новый сегмент - чужой не удаляем
+    if (lock_file(fd, LOCK_EX | LOCK_NB) == 0 && same_segment(fd, segment_name)) {
+        shm_unlink(segment_name.c_str());
+    }
+}
+
+} // namespace formula_teacher
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace formula_teacher {
+
+// Однофайловый пакет модели (.ftb): конфигурация, веса и словарь.
+//
+// [BundleHeader][таблица BundleTensor][веса float32, каждый тензор выровнен на 64 байта][словарь]
+//
+// Словарь - записи [int32 индекс][uint32 длина][байты токена]. Порядок байтов - как у машины,
+// на которой пакет записан. Файл отображается в память только для чтения, тензоры
+// создаются прямо поверх отображения, поэтому страницы весов делятся между процессами
+// через page cache. Заголовок не зависит от LibTorch и читается также автономным рантаймом.
+//
+// Тот же образ можно опубликовать в разделяемой памяти POSIX (см. publish_shared):
+// так делятся веса моделей, загруженных не из пакета
+const char BUNDLE_MAGIC[8] = {'F', 'T', 'B', 'U', 'N', 'D', 'L', '1'};
+const uint32_t BUNDLE_VERSION = 1;
+const uint64_t BUNDLE_ALIGNMENT = 64;
+
+struct BundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tensor_count;
+    
+    // Размеры модели
+    int32_t vocab_size;
+    int32_t embedding_dim;
+    int32_t hidden_dim;
+    uint32_t vocabulary_count;
+    
+    // Смещения от начала файла
+    uint64_t tensor_table_offset;
+    uint64_t vocabulary_offset;
+    uint64_t vocabulary_bytes;
+    uint64_t file_size;
+    
+    // Хэши весов и словаря, считаются при записи, чтобы не читать файл целиком при открытии
+    uint64_t model_digest;
+    uint64_t vocabulary_digest;
+    
+    uint64_t reserved[6];
+};
+
+// Описание одного тензора весов
+struct BundleTensor {
+    char name[64];
+    uint32_t ndim;
+    uint32_t reserved;
+    int64_t shape[4];
+    uint64_t offset;
+    uint64_t nbytes;
+    uint64_t padding;
+};
+
+static_assert(sizeof(BundleHeader) == 128, "размер заголовка пакета входит в формат");
+static_assert(sizeof(BundleTensor) == 128, "размер записи тензора входит в формат");
+
+// Тензор для записи в пакет
+struct BundleTensorData {
+    std::string name;
+    std::vector<int64_t> shape;
+    const float* data;
+};
+
+// Отображенный в память пакет модели
+class BundleFile {
+public:
+    // Проверка сигнатуры без отображения файла
+    static bool is_bundle(const std::string& path);
+    
+    // Открытие и проверка пакета. Бросает std::runtime_error, если файл поврежден
+    static std::shared_ptr<BundleFile> open(const std::string& path);
+    
+    // Запись пакета. Тензоры пишутся в порядке tensors
+    static void write(const std::string& path, int vocab_size, int embedding_dim, int hidden_dim,
+                      const std::vector<BundleTensorData>& tensors,
+                      const std::vector<std::pair<std::string, int>>& vocabulary);
+    
+    // Подключение к образу пакета в сегменте разделяемой памяти с ключом key (обычно хэш
+    // файла модели). nullptr, если сегмента нет. Сегмент, который создатель не успел
+    // заполнить (процесс упал), удаляется
+    static std::shared_ptr<BundleFile> attach_shared(uint64_t key);
+    
+    // Публикация образа пакета в сегменте с ключом key и подключение к нему. Если сегмент
+    // уже создал другой процесс, подключается к нему. Бросает std::runtime_error, если
+    // разделяемой памяти не хватает.
+    //
+    // Каждый подключенный процесс держит разделяемую блокировку flock на сегменте;
+    // последний отключившийся удаляет его. Блокировки снимает ядро, поэтому упавшие процессы
+    // не мешают удалению. Если упал последний процесс, сегмент остается до следующего
+    // подключения с тем же ключом. Внутри процесса пакеты с одним ключом общие
+    static std::shared_ptr<BundleFile> publish_shared(uint64_t key, int vocab_size, int embedding_dim, int hidden_dim,
+                                                      const std::vector<BundleTensorData>& tensors,
+                                                      const std::vector<std::pair<std::string, int>>& vocabulary);
+    
+    // Имя сегмента разделяемой памяти для ключа (на пользователя свое)
+    static std::string shared_name(uint64_t key);
+    
+    ~BundleFile();
+    
+    BundleFile(const BundleFile&) = delete;
+    BundleFile& operator=(const BundleFile&) = delete;
+    
+    const BundleHeader& header() const { return *reinterpret_cast<const BundleHeader*>(mapping); }
+    
+    // Описание тензора по имени параметра, nullptr если такого нет
+    const BundleTensor* find_tensor(const std::string& name) const;
+    
+    // Данные тензора внутри отображения
+    const float* tensor_data(const BundleTensor& tensor) const {
+        return reinterpret_cast<const float*>(mapping + tensor.offset);
+    }
+    
+    // Словарь: пары (токен, индекс)
+    std::vector<std::pair<std::string, int>> vocabulary() const;
+    
+private:
+    BundleFile() = default;
+    
+    // Проверка таблиц после отображения
+    void validate(const std::string& path) const;
+    
+    // Подключение к открытому сегменту. nullptr, если сегмент не заполнен
+    static std::shared_ptr<BundleFile> map_shared(int fd, const std::string& name);
+    
+    // Отключение от сегмента и удаление его, если других подключенных процессов нет
+    void release_shared();
+    
+    const BundleTensor* tensors() const {
+        return reinterpret_cast<const BundleTensor*>(mapping + header().tensor_table_offset);
+    }
+    
+    int fd = -1;
+    const unsigned char* mapping = nullptr;
+    size_t mapping_size = 0;
+    
+    // Имя сегмента разделяемой памяти, пусто для файла
+    std::string segment_name;
+};
+
+} // namespace formula_teacher
@@ -0,0 +1,65 @@
+#include "completion_queue.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace formula_teacher {
+
+CompletionQueue::CompletionQueue() : closed(false) {
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) {
+        throw std::runtime_error(std::string("Не удалось создать eventfd: ") + std::strerror(errno));
+    }
+}
+
+CompletionQueue::~CompletionQueue() {
+    close();
+    ::close(event_fd);
+}
+
+void CompletionQueue::post(std::function<void()> event) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            return;
+        }
+        events.push_back(std::move(event));
+    }
+    
+    uint64_t one = 1;
+    ssize_t ignored = write(event_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+size_t CompletionQueue::dispatch() {
+    uint64_t counter;
+    ssize_t ignored = read(event_fd, &counter, sizeof(counter));
+    (void)ignored;
+    
+    std::deque<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(events);
+    }
+    
+    for (auto& event : ready) {
+        event();
+    }
+    return ready.size();
+}
+
+void CompletionQueue::close() {
+    // События освобождаются вне блокировки: их захваченные объекты могут быть тяжелыми
+    std::deque<std::function<void()>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        dropped.swap(events);
+    }
+}
+
+} // namespace formula_teacher
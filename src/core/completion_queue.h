@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace formula_teacher {
+
+// Очередь событий из потоков-исполнителей в поток владельца (например, главный цикл GTK).
+// События накапливаются из любого потока, а выполняются в потоке, вызвавшем dispatch.
+// О новых событиях сообщает eventfd: его можно добавить в epoll или в GMainContext
+// как источник ввода и вызывать dispatch, когда он готов к чтению
+class CompletionQueue {
+public:
+    // Бросает std::runtime_error, если eventfd не создан
+    CompletionQueue();
+    ~CompletionQueue();
+    
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+    
+    // Дескриптор, готовый к чтению, пока в очереди есть события
+    int fd() const { return event_fd; }
+    
+    // Постановка события из любого потока. После close события отбрасываются
+    void post(std::function<void()> event);
+    
+    // Выполнение накопленных событий в текущем потоке, возвращает их число.
+    // События, поставленные во время выполнения, ждут следующего вызова
+    size_t dispatch();
+    
+    // Отказ от событий: накопленные удаляются, новые не принимаются
+    void close();
+    
+private:
+    std::mutex mutex;
+    std::deque<std::function<void()>> events;
+    bool closed;
+    int event_fd;
+};
+
+} // namespace formula_teacher
@@ -0,0 +1,33 @@
+#include "digest.h"
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace formula_teacher {
+
+uint64_t digest_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t digest_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Не удалось открыть файл: " + path);
+    }
+    
+    uint64_t hash = DIGEST_SEED;
+    std::vector<char> buffer(1 << 16);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hash = digest_bytes(buffer.data(), static_cast<size_t>(file.gcount()), hash);
+    }
+    return hash;
+}
+
+} // namespace formula_teacher
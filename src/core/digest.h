@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace formula_teacher {
+
+// Начальное значение 64-битного хэша FNV-1a
+constexpr uint64_t DIGEST_SEED = 14695981039346656037ULL;
+
+// Хэш FNV-1a блока памяти, seed позволяет продолжать хэширование по частям
+uint64_t digest_bytes(const void* data, size_t size, uint64_t seed = DIGEST_SEED);
+
+// Хэш содержимого файла. Бросает std::runtime_error, если файл не открывается
+uint64_t digest_file(const std::string& path);
+
+} // namespace formula_teacher
@@ -0,0 +1,120 @@
+#include "encoder_cache.h"
+#include <iterator>
+
+namespace formula_teacher {
+
+EncoderCache::EncoderCache(size_t max_bytes)
+    : max_bytes(max_bytes), bytes(0), hits(0), misses(0), evictions(0) {
+}
+
+uint64_t EncoderCache::hash_tokens(uint64_t generation, const std::vector<int>& input_tokens) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < 8; ++i) {
+        hash ^= (generation >> (i * 8)) & 0xFF;
+        hash *= 1099511628211ULL;
+    }
+    for (int token : input_tokens) {
+        uint32_t value = static_cast<uint32_t>(token);
+        for (int i = 0; i < 4; ++i) {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+size_t EncoderCache::entry_bytes(const std::vector<int>& input_tokens, const DecoderState& state) {
+    size_t total = input_tokens.size() * sizeof(int);
+    for (const auto* tensor : {&state.encoder_output, &state.keys, &state.mask, &state.h, &state.c,
+                               &state.shortlist, &state.shortlist_weight, &state.shortlist_bias}) {
+        if (tensor->defined()) {
+            total += tensor->numel() * tensor->element_size();
+        }
+    }
+    return total;
+}
+
+bool EncoderCache::lookup(uint64_t generation, const std::vector<int>& input_tokens, DecoderState& state) {
+    uint64_t hash = hash_tokens(generation, input_tokens);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        // Сравниваем сами токены на случай коллизии хэшей
+        if (it->second->generation == generation && it->second->input_tokens == input_tokens) {
+            entries.splice(entries.begin(), entries, it->second);
+            state = it->second->state;
+            hits++;
+            return true;
+        }
+    }
+    
+    misses++;
+    return false;
+}
+
+void EncoderCache::insert(uint64_t generation, const std::vector<int>& input_tokens, const DecoderState& state) {
+    uint64_t hash = hash_tokens(generation, input_tokens);
+    size_t size = entry_bytes(input_tokens, state);
+    if (size > max_bytes) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    // Запись могла быть добавлена другим потоком, пока этот считал энкодер
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->generation == generation && it->second->input_tokens == input_tokens) {
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+    }
+    
+    entries.push_front({hash, generation, input_tokens, state, size});
+    index.emplace(hash, entries.begin());
+    bytes += size;
+    
+    evict_to_budget();
+}
+
+void EncoderCache::evict_to_budget() {
+    while (bytes > max_bytes && !entries.empty()) {
+        auto oldest = std::prev(entries.end());
+        
+        auto range = index.equal_range(oldest->hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == oldest) {
+                index.erase(it);
+                break;
+            }
+        }
+        
+        bytes -= oldest->bytes;
+        entries.erase(oldest);
+        evictions++;
+    }
+}
+
+void EncoderCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+EncoderCache::Stats EncoderCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Stats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.evictions = evictions;
+    result.entries = entries.size();
+    result.bytes = bytes;
+    result.max_bytes = max_bytes;
+    return result;
+}
+
+} // namespace formula_teacher
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "model.h"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace formula_teacher {
+
+// LRU-кэш подготовленных состояний декодера (выход энкодера и ключи внимания),
+// ключ - поколение модели и последовательность входных токенов. Объем ограничен
+// бюджетом в байтах. Методы потокобезопасны
+class EncoderCache {
+public:
+    // Статистика использования кэша
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t max_bytes = 0;
+    };
+    
+    explicit EncoderCache(size_t max_bytes);
+    
+    // Поиск состояния для входа. При попадании state заполняется и запись становится самой свежей
+    bool lookup(uint64_t generation, const std::vector<int>& input_tokens, DecoderState& state);
+    
+    // Добавление состояния. Записи больше бюджета не кэшируются. Запрос, который дорешивается
+    // на прежнем поколении модели, добавляет запись со своим поколением, и новое её не найдет
+    void insert(uint64_t generation, const std::vector<int>& input_tokens, const DecoderState& state);
+    
+    // Очистка кэша (например, при загрузке другой модели)
+    void clear();
+    
+    Stats stats() const;
+    
+private:
+    struct Entry {
+        uint64_t hash;
+        uint64_t generation;
+        std::vector<int> input_tokens;
+        DecoderState state;
+        size_t bytes;
+    };
+    
+    // Хэш поколения и последовательности токенов (FNV-1a)
+    static uint64_t hash_tokens(uint64_t generation, const std::vector<int>& input_tokens);
+    
+    // Размер записи в байтах
+    static size_t entry_bytes(const std::vector<int>& input_tokens, const DecoderState& state);
+    
+    // Удаление самых старых записей, пока объем превышает бюджет
+    void evict_to_budget();
+    
+    mutable std::mutex mutex;
+    
+    // Список от самых свежих к самым старым записям
+    std::list<Entry> entries;
+    std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index;
+    
+    size_t max_bytes;
+    size_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+} // namespace formula_teacher
@@ -0,0 +1,741 @@
+#include "engine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace formula_teacher {
+
+namespace {
+
+// Номера запросов асинхронного API, общие для всех очередей
+std::atomic<uint64_t> next_request_id{1};
+
+// Веса классов Interactive, Normal, Background во взвешенной очереди
+const std::vector<double> DEFAULT_PRIORITY_WEIGHTS = {16.0, 4.0, 1.0};
+
+ThreadBudget workers_budget(int num_workers) {
+    ThreadBudget budget;
+    budget.sessions = std::max(0, num_workers);
+    budget.intra_op_threads = 1;
+    return budget;
+}
+
+} // namespace
+
+FormulaEngine::FormulaEngine(int num_workers) : FormulaEngine(workers_budget(num_workers)) {}
+
+FormulaEngine::FormulaEngine(const ThreadBudget& budget) : queue(DEFAULT_PRIORITY_WEIGHTS), stopping(false) {
+    auto plan = plan_sessions(budget);
+    
+    for (size_t i = 0; i < plan.size(); ++i) {
+        sessions.push_back(std::make_unique<InferenceSession>());
+    }
+    for (size_t i = 0; i < plan.size(); ++i) {
+        workers.emplace_back(&FormulaEngine::worker_loop, this, std::ref(*sessions[i]), plan[i]);
+    }
+}
+
+FormulaEngine::~FormulaEngine() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+bool FormulaEngine::load_model(const std::string& model_path, bool quantize_int8) {
+    return load(model_path, "", quantize_int8);
+}
+
+bool FormulaEngine::load(const std::string& model_path, const std::string& vocab_path, bool quantize_int8) {
+    bool loaded;
+    {
+        std::shared_lock<std::shared_mutex> lock(model_mutex);
+        loaded = inference.load(model_path, vocab_path, quantize_int8);
+    }
+    if (loaded) {
+        notify_generation();
+    }
+    return loaded;
+}
+
+bool FormulaEngine::load_vocabulary(const std::string& vocab_path) {
+    bool loaded;
+    {
+        std::shared_lock<std::shared_mutex> lock(model_mutex);
+        loaded = inference.load_vocabulary(vocab_path);
+    }
+    if (loaded) {
+        notify_generation();
+    }
+    return loaded;
+}
+
+bool FormulaEngine::load_scripted_model(const std::string& model_path) {
+    bool loaded;
+    {
+        std::shared_lock<std::shared_mutex> lock(model_mutex);
+        loaded = inference.load_scripted_model(model_path);
+    }
+    if (loaded) {
+        notify_generation();
+    }
+    return loaded;
+}
+
+bool FormulaEngine::load_shortlist(const std::string& shortlist_path) {
+    bool loaded;
+    {
+        std::shared_lock<std::shared_mutex> lock(model_mutex);
+        loaded = inference.load_shortlist(shortlist_path);
+    }
+    if (loaded) {
+        notify_generation();
+    }
+    return loaded;
+}
+
+void FormulaEngine::notify_generation() {
+    // Блокировка очереди исключает пропуск пробуждения между проверкой условия и ожиданием
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+    }
+    queue_cv.notify_all();
+}
+
+void FormulaEngine::set_generation_options(const GenerationOptions& options) {
+    std::unique_lock<std::shared_mutex> lock(model_mutex);
+    inference.set_generation_options(options);
+}
+
+void FormulaEngine::set_symbolic_solver(bool enabled, double min_confidence) {
+    std::unique_lock<std::shared_mutex> lock(model_mutex);
+    inference.set_symbolic_solver(enabled, min_confidence);
+}
+
+void FormulaEngine::set_shared_weights(bool enabled) {
+    std::unique_lock<std::shared_mutex> lock(model_mutex);
+    inference.set_shared_weights(enabled);
+}
+
+void FormulaEngine::set_max_batch_size(int max_batch_size) {
+    this->max_batch_size.store(std::max(1, max_batch_size));
+}
+
+void FormulaEngine::set_priority_weight(RequestPriority priority, double weight) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue.set_weight(static_cast<size_t>(priority), weight);
+}
+
+FairQueueStats FormulaEngine::get_queue_stats(RequestPriority priority) const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return queue.stats(static_cast<size_t>(priority));
+}
+
+void FormulaEngine::set_encoder_cache_size(size_t max_bytes) {
+    std::unique_lock<std::shared_mutex> lock(model_mutex);
+    inference.set_encoder_cache_size(max_bytes);
+}
+
+EncoderCache::Stats FormulaEngine::get_encoder_cache_stats() const {
+    std::shared_lock<std::shared_mutex> lock(model_mutex);
+    return inference.get_encoder_cache_stats();
+}
+
+bool FormulaEngine::open_solution_cache(const std::string& path, size_t capacity_bytes) {
+    std::unique_lock<std::shared_mutex> lock(model_mutex);
+    return inference.open_solution_cache(path, capacity_bytes);
+}
+
+std::future<SolveResult> FormulaEngine::submit(const std::string& task_text, SolveRequest request) {
+    Job job;
+    job.task_text = task_text;
+    job.request = std::move(request);
+    auto result = job.result.get_future();
+    enqueue(std::move(job));
+    return result;
+}
+
+void FormulaEngine::submit(const std::string& task_text, SolveRequest request,
+                           std::function<void(SolveResult)> on_complete) {
+    Job job;
+    job.task_text = task_text;
+    job.request = std::move(request);
+    job.on_complete = std::move(on_complete);
+    enqueue(std::move(job));
+}
+
+void FormulaEngine::enqueue(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (job.action) {
+            actions.push_back(std::move(job));
+        } else {
+            size_t priority = static_cast<size_t>(job.request.priority);
+            queue.push(priority, std::move(job));
+        }
+    }
+    queue_cv.notify_one();
+}
+
+std::string FormulaEngine::solve_task(const std::string& task_text) {
+    return submit(task_text).get().text;
+}
+
+void FormulaEngine::run(std::function<void()> action) {
+    Job job;
+    job.action = std::move(action);
+    enqueue(std::move(job));
+}
+
+void FormulaEngine::worker_loop(InferenceSession& session, SessionThreads threads) {
+    // Привязка наследуется пулом OpenMP, который LibTorch создает из этого потока.
+    // При сборке LibTorch с OpenMP число потоков задается для вызывающего потока,
+    // поэтому у каждого исполнителя свой пул, а не общий на процесс
+    pin_current_thread(threads.cpus);
+    torch::set_num_threads(threads.intra_op_threads);
+    
+    Preemption preemption;
+    
+    while (true) {
+        Job job;
+        bool has_job = false;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            
+            // Пока в батче есть задачи, исполнитель не ждет: он шагает батч и между шагами
+            // добирает задачи из очереди, пока батч не заполнится
+            size_t batched = inference.batch_size(session);
+            if (batched == 0) {
+                // Сессии вытеснения держат веса поколения, на котором решали последними
+                uint64_t current_id = inference.generation_id();
+                for (auto& preempting : preemption.sessions) {
+                    if (preempting && preempting->generation != current_id) {
+                        preempting.reset();
+                    }
+                }
+                
+                ++idle_workers;
+                queue_cv.wait(lock, [&] {
+                    return stopping || !queue.empty() || !actions.empty() ||
+                           session.generation != inference.generation_id();
+                });
+                --idle_workers;
+                
+                // Оставшиеся задачи дорешиваются перед остановкой
+                if (queue.empty() && actions.empty() && stopping) {
+                    return;
+                }
+                
+                // Загружено новое поколение модели, а задач нет: буферы сессии держат прежние
+                // веса - готовим их под новое, пока исполнитель свободен
+                if (queue.empty() && actions.empty()) {
+                    lock.unlock();
+                    std::shared_lock<std::shared_mutex> model_lock(model_mutex);
+                    inference.prepare_session(session);
+                    continue;
+                }
+            }
+            
+            // Полный батч принимает только интерактивные задачи
+            size_t limit = batched < static_cast<size_t>(max_batch_size.load())
+                ? queue.class_count() : static_cast<size_t>(RequestPriority::Interactive) + 1;
+            if (!actions.empty()) {
+                job = std::move(actions.front());
+                actions.pop_front();
+                has_job = true;
+            } else if (queue.next_class(limit) < queue.class_count()) {
+                job = queue.pop(limit);
+                has_job = true;
+            }
+        }
+        
+        if (!has_job) {
+            std::shared_lock<std::shared_mutex> lock(model_mutex);
+            inference.step_batch(session);
+            continue;
+        }
+        
+        if (job.action) {
+            job.action();
+            continue;
+        }
+        
+        dispatch(job, session, preemption);
+        
+        // Вытеснившие задачи завершаются после снятия блокировки модели
+        auto completions = std::move(preemption.completions);
+        preemption.completions.clear();
+        for (auto& complete : completions) {
+            complete();
+        }
+    }
+}
+
+void FormulaEngine::dispatch(Job& job, InferenceSession& session, Preemption& preemption) {
+    std::shared_lock<std::shared_mutex> lock(model_mutex);
+    
+    if (max_batch_size.load() > 1) {
+        // Результат придет из шага батча; обработчик std::function копируется, поэтому promise в shared_ptr
+        std::function<void(SolveResult)> on_complete = std::move(job.on_complete);
+        if (!on_complete) {
+            auto result = std::make_shared<std::promise<SolveResult>>(std::move(job.result));
+            on_complete = [result](SolveResult solved) { result->set_value(std::move(solved)); };
+        }
+        inference.submit_batch(job.task_text, session, job.request, std::move(on_complete));
+        return;
+    }
+    
+    attach_preemption(job, preemption);
+    solve_job(job, session, &lock);
+}
+
+void FormulaEngine::solve_job(Job& job, InferenceSession& session, std::shared_lock<std::shared_mutex>* lock) {
+    if (job.on_complete) {
+        SolveResult result;
+        try {
+            result = inference.solve(job.task_text, session, job.request);
+        } catch (const std::exception& e) {
+            result = {std::string("Ошибка при решении задачи: ") + e.what(), SolveStatus::Error};
+        }
+        if (lock) {
+            lock->unlock();
+        }
+        job.on_complete(std::move(result));
+        return;
+    }
+    
+    try {
+        job.result.set_value(inference.solve(job.task_text, session, job.request));
+    } catch (...) {
+        job.result.set_exception(std::current_exception());
+    }
+}
+
+void FormulaEngine::attach_preemption(Job& job, Preemption& preemption) {
+    size_t priority = static_cast<size_t>(job.request.priority);
+    if (priority == static_cast<size_t>(RequestPriority::Interactive)) {
+        return;
+    }
+    
+    // Обработчик запроса вызывается первым: его точка вытеснения не теряется
+    auto previous = std::move(job.request.limits.preemption_point);
+    job.request.limits.preemption_point = [this, priority, &preemption, previous] {
+        if (previous) {
+            previous();
+        }
+        preempt(priority, preemption);
+    };
+}
+
+void FormulaEngine::preempt(size_t priority, Preemption& preemption) {
+    while (true) {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            
+            // Свободный исполнитель возьмет срочную задачу сам
+            if (idle_workers > 0 || queue.next_class(priority) == queue.class_count()) {
+                return;
+            }
+            job = queue.pop(priority);
+        }
+        
+        // Каждый класс вытесняет только менее срочные, поэтому сессия класса
+        // занята не более чем одной задачей в стеке вытеснений
+        auto& session = preemption.sessions[static_cast<size_t>(job.request.priority)];
+        if (!session) {
+            session = std::make_unique<InferenceSession>();
+        }
+        
+        // Обработчик завершения откладывается до снятия блокировки модели (см. Preemption)
+        if (job.on_complete) {
+            job.on_complete = [&preemption, on_complete = std::move(job.on_complete)](SolveResult result) {
+                preemption.completions.push_back([on_complete, result = std::move(result)]() mutable {
+                    on_complete(std::move(result));
+                });
+            };
+        }
+        
+        attach_preemption(job, preemption);
+        solve_job(job, *session, nullptr);
+    }
+}
+
+// Ограничения запроса для C API: токен отмены принадлежит запросу
+struct FormulaRequest {
+    RequestLimits limits;
+    std::shared_ptr<CancellationToken> cancellation;
+    RequestPriority priority = RequestPriority::Interactive;
+    bool force_model = false;
+};
+
+// Очередь асинхронного API и токены отмены незавершенных запросов. Исполнители держат
+// её через shared_ptr, поэтому запрос может завершиться и после formula_queue_free
+struct AsyncQueueState {
+    CompletionQueue completions;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<CancellationToken>> pending;
+};
+
+struct FormulaQueue {
+    std::shared_ptr<AsyncQueueState> state;
+};
+
+// Результат асинхронного решения: текст переходит из SolveResult без копирования
+struct FormulaResult {
+    std::atomic<int> references{1};
+    std::string text;
+    int status = 0;
+};
+
+} // namespace formula_teacher
+
+// C API реализация
+extern "C" {
+
+formula_teacher::FormulaEngine* formula_engine_new(int num_workers) {
+    try {
+        return new formula_teacher::FormulaEngine(num_workers);
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при создании движка: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+formula_teacher::FormulaEngine* formula_engine_new_with_budget(int threads, int sessions, const char* cpus) {
+    try {
+        formula_teacher::ThreadBudget budget;
+        budget.threads = threads;
+        budget.sessions = sessions;
+        if (cpus && *cpus) {
+            budget.cpus = formula_teacher::parse_cpu_list(cpus);
+        }
+        return new formula_teacher::FormulaEngine(budget);
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при создании движка: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+void formula_engine_free(formula_teacher::FormulaEngine* engine) {
+    delete engine;
+}
+
+bool load_model_from_file(formula_teacher::FormulaEngine* engine, const char* path) {
+    return engine && engine->load_model(path);
+}
+
+bool load_vocabulary_from_file(formula_teacher::FormulaEngine* engine, const char* path) {
+    return engine && engine->load_vocabulary(path);
+}
+
+bool load_model_with_vocabulary(formula_teacher::FormulaEngine* engine, const char* model_path,
+                                const char* vocab_path) {
+    return engine && model_path && engine->load(model_path, vocab_path ? vocab_path : "");
+}
+
+bool load_quantized_model_from_file(formula_teacher::FormulaEngine* engine, const char* path) {
+    return engine && engine->load_model(path, true);
+}
+
+bool load_scripted_model_from_file(formula_teacher::FormulaEngine* engine, const char* path) {
+    return engine && engine->load_scripted_model(path);
+}
+
+bool is_model_bundle_file(const char* path) {
+    return path && formula_teacher::BundleFile::is_bundle(path);
+}
+
+void formula_engine_set_shared_weights(formula_teacher::FormulaEngine* engine, bool enabled) {
+    if (engine) {
+        engine->set_shared_weights(enabled);
+    }
+}
+
+void formula_engine_set_max_batch_size(formula_teacher::FormulaEngine* engine, int max_batch_size) {
+    if (engine) {
+        engine->set_max_batch_size(max_batch_size);
+    }
+}
+
+char* process_task_with_model(const char* task_text, formula_teacher::FormulaEngine* engine) {
+    if (!engine) {
+        return nullptr;
+    }
+    
+    std::string result;
+    try {
+        result = engine->solve_task(task_text);
+    } catch (const std::exception& e) {
+        // Исключение не должно пересечь границу C API
+        result = std::string("Ошибка при решении задачи: ") + e.what();
+    }
+    
+    // Необходимо выделить память для строки, которую можно будет освободить в Vala
+    char* c_result = (char*)malloc(result.length() + 1);
+    strcpy(c_result, result.c_str());
+    
+    return c_result;
+}
+
+char* process_task_streaming(const char* task_text, formula_teacher::FormulaEngine* engine,
+                             formula_teacher::formula_fragment_callback callback, void* user_data) {
+    return process_task_request(task_text, engine, nullptr, callback, user_data, nullptr);
+}
+
+formula_teacher::FormulaRequest* formula_request_new(int timeout_ms) {
+    auto request = new formula_teacher::FormulaRequest();
+    request->limits = formula_teacher::RequestLimits::with_timeout(std::chrono::milliseconds(timeout_ms));
+    request->cancellation = std::make_shared<formula_teacher::CancellationToken>();
+    request->limits.cancellation = request->cancellation;
+    return request;
+}
+
+void formula_request_cancel(formula_teacher::FormulaRequest* request) {
+    if (request) {
+        request->cancellation->cancel();
+    }
+}
+
+void formula_request_free(formula_teacher::FormulaRequest* request) {
+    delete request;
+}
+
+void formula_request_set_priority(formula_teacher::FormulaRequest* request, int priority) {
+    if (request) {
+        request->priority = formula_teacher::request_priority_from_int(priority);
+    }
+}
+
+void formula_request_set_force_model(formula_teacher::FormulaRequest* request, int force_model) {
+    if (request) {
+        request->force_model = force_model != 0;
+    }
+}
+
+char* process_task_request(const char* task_text, formula_teacher::FormulaEngine* engine,
+                           formula_teacher::FormulaRequest* request,
+                           formula_teacher::formula_fragment_callback callback, void* user_data, int* status) {
+    if (!engine) {
+        return nullptr;
+    }
+    
+    formula_teacher::SolveRequest solve_request;
+    solve_request.priority = formula_teacher::RequestPriority::Interactive;
+    if (request) {
+        solve_request.limits = request->limits;
+        solve_request.priority = request->priority;
+        solve_request.force_model = request->force_model;
+    }
+    if (callback) {
+        solve_request.on_fragment = [callback, user_data](const std::string& fragment) {
+            callback(fragment.c_str(), user_data);
+        };
+    }
+    
+    formula_teacher::SolveResult result;
+    try {
+        result = engine->submit(task_text, std::move(solve_request)).get();
+    } catch (const std::exception& e) {
+        // Исключение не должно пересечь границу C API
+        result = {std::string("Ошибка при решении задачи: ") + e.what(), formula_teacher::SolveStatus::Error};
+    }
+    if (status) {
+        *status = static_cast<int>(result.status);
+    }
+    
+    char* c_result = (char*)malloc(result.text.length() + 1);
+    strcpy(c_result, result.text.c_str());
+    
+    return c_result;
+}
+
+formula_teacher::FormulaQueue* formula_queue_new(void) {
+    try {
+        auto queue = new formula_teacher::FormulaQueue();
+        queue->state = std::make_shared<formula_teacher::AsyncQueueState>();
+        return queue;
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при создании очереди: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+void formula_queue_free(formula_teacher::FormulaQueue* queue) {
+    if (!queue) {
+        return;
+    }
+    
+    // Исполнители быстрее освобождаются от брошенных запросов
+    {
+        std::lock_guard<std::mutex> lock(queue->state->mutex);
+        for (auto& request : queue->state->pending) {
+            request.second->cancel();
+        }
+        queue->state->pending.clear();
+    }
+    queue->state->completions.close();
+    delete queue;
+}
+
+int formula_queue_fd(formula_teacher::FormulaQueue* queue) {
+    return queue ? queue->state->completions.fd() : -1;
+}
+
+int formula_queue_dispatch(formula_teacher::FormulaQueue* queue) {
+    if (!queue) {
+        return 0;
+    }
+    
+    // Обработчик может освободить очередь, состояние должно пережить цикл dispatch
+    auto state = queue->state;
+    return static_cast<int>(state->completions.dispatch());
+}
+
+bool formula_queue_cancel(formula_teacher::FormulaQueue* queue, uint64_t request_id) {
+    if (!queue) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(queue->state->mutex);
+    auto request = queue->state->pending.find(request_id);
+    if (request == queue->state->pending.end()) {
+        return false;
+    }
+    request->second->cancel();
+    return true;
+}
+
+formula_teacher::FormulaResult* formula_result_ref(formula_teacher::FormulaResult* result) {
+    if (result) {
+        result->references.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result;
+}
+
+void formula_result_unref(formula_teacher::FormulaResult* result) {
+    if (result && result->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete result;
+    }
+}
+
+const char* formula_result_text(const formula_teacher::FormulaResult* result) {
+    return result ? result->text.c_str() : nullptr;
+}
+
+size_t formula_result_length(const formula_teacher::FormulaResult* result) {
+    return result ? result->text.size() : 0;
+}
+
+int formula_result_status(const formula_teacher::FormulaResult* result) {
+    return result ? result->status : static_cast<int>(formula_teacher::SolveStatus::Error);
+}
+
+size_t formula_result_copy_text(const formula_teacher::FormulaResult* result, char* buffer, size_t size) {
+    if (!result) {
+        return 0;
+    }
+    
+    if (buffer && size > 0) {
+        size_t count = std::min(size - 1, result->text.size());
+        memcpy(buffer, result->text.data(), count);
+        buffer[count] = '\0';
+    }
+    return result->text.size();
+}
+
+uint64_t formula_engine_submit(formula_teacher::FormulaEngine* engine, formula_teacher::FormulaQueue* queue,
+                               const char* task_text, int timeout_ms,
+                               formula_teacher::formula_fragment_callback on_fragment,
+                               formula_teacher::formula_complete_callback on_complete, void* user_data) {
+    return formula_engine_submit_with_priority(engine, queue, task_text, timeout_ms,
+                                               static_cast<int>(formula_teacher::RequestPriority::Interactive),
+                                               on_fragment, on_complete, user_data);
+}
+
+uint64_t formula_engine_submit_with_priority(formula_teacher::FormulaEngine* engine,
+                                             formula_teacher::FormulaQueue* queue, const char* task_text,
+                                             int timeout_ms, int priority,
+                                             formula_teacher::formula_fragment_callback on_fragment,
+                                             formula_teacher::formula_complete_callback on_complete,
+                                             void* user_data) {
+    if (!engine || !queue || !task_text) {
+        return 0;
+    }
+    
+    auto state = queue->state;
+    uint64_t request_id = formula_teacher::next_request_id.fetch_add(1, std::memory_order_relaxed);
+    
+    auto cancellation = std::make_shared<formula_teacher::CancellationToken>();
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->pending[request_id] = cancellation;
+    }
+    
+    formula_teacher::SolveRequest request;
+    request.limits = formula_teacher::RequestLimits::with_timeout(std::chrono::milliseconds(timeout_ms));
+    request.limits.cancellation = cancellation;
+    request.priority = formula_teacher::request_priority_from_int(priority);
+    if (on_fragment) {
+        request.on_fragment = [state, on_fragment, user_data](const std::string& fragment) {
+            state->completions.post([on_fragment, user_data, fragment] {
+                on_fragment(fragment.c_str(), user_data);
+            });
+        };
+    }
+    
+    engine->submit(task_text, std::move(request),
+                   [state, request_id, on_complete, user_data](formula_teacher::SolveResult solved) {
+        // Если очередь закрыта и событие отброшено, результат освобождает shared_ptr
+        auto result = new formula_teacher::FormulaResult();
+        result->text = std::move(solved.text);
+        result->status = static_cast<int>(solved.status);
+        std::shared_ptr<formula_teacher::FormulaResult> reference(result, formula_result_unref);
+        
+        state->completions.post([state, request_id, on_complete, user_data, reference] {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->pending.erase(request_id);
+            }
+            if (on_complete) {
+                on_complete(request_id, reference.get(), user_data);
+            }
+        });
+    });
+    return request_id;
+}
+
+uint64_t formula_engine_load_async(formula_teacher::FormulaEngine* engine, formula_teacher::FormulaQueue* queue,
+                                   const char* model_path, const char* vocab_path,
+                                   formula_teacher::formula_load_callback on_loaded, void* user_data) {
+    if (!engine || !queue || !model_path) {
+        return 0;
+    }
+    
+    auto state = queue->state;
+    uint64_t request_id = formula_teacher::next_request_id.fetch_add(1, std::memory_order_relaxed);
+    std::string model(model_path);
+    std::string vocabulary(vocab_path ? vocab_path : "");
+    
+    engine->run([engine, state, request_id, model, vocabulary, on_loaded, user_data] {
+        bool success = engine->load(model, vocabulary);
+        
+        state->completions.post([request_id, success, on_loaded, user_data] {
+            if (on_loaded) {
+                on_loaded(request_id, success, user_data);
+            }
+        });
+    });
+    return request_id;
+}
+
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "completion_queue.h"
+#include "fair_queue.h"
+#include "inference.h"
+#include "threading.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace formula_teacher {
+
+// Движок инференса для нескольких одновременных запросов.
+// Веса модели и словарь общие и только читаются, у каждого потока-исполнителя
+// своя InferenceSession с рабочими буферами.
+//
+// Задачи ждут во взвешенной справедливой очереди по классам приоритета (SolveRequest::priority):
+// пока в классе есть задачи, он получает долю исполнителей по своему весу. Если свободных
+// исполнителей нет, задача более срочного класса вытесняет менее срочную на границе шага
+// декодера: исполнитель решает срочную задачу на отдельной сессии и продолжает прерванную
+class FormulaEngine {
+public:
+    // num_workers = 0 - по числу ядер процессора, каждый исполнитель однопоточный
+    explicit FormulaEngine(int num_workers = 0);
+    
+    // Явный бюджет потоков: число исполнителей, потоки LibTorch внутри операций
+    // у каждого и привязка исполнителей к ядрам (см. plan_sessions)
+    explicit FormulaEngine(const ThreadBudget& budget);
+    ~FormulaEngine();
+    
+    FormulaEngine(const FormulaEngine&) = delete;
+    FormulaEngine& operator=(const FormulaEngine&) = delete;
+    
+    // Загрузка модели и словаря без остановки обслуживания: новое поколение модели
+    // собирается рядом с текущим, новые запросы берут его, а выполняющиеся дорешиваются
+    // на прежнем. Простаивающие исполнители сразу готовят под него свои буферы
+    bool load_model(const std::string& model_path, bool quantize_int8 = false);
+    bool load_vocabulary(const std::string& vocab_path);
+    
+    // Модель и словарь одним поколением (vocab_path может быть пустым)
+    bool load(const std::string& model_path, const std::string& vocab_path, bool quantize_int8 = false);
+    
+    // Загрузка замороженной TorchScript-модели
+    bool load_scripted_model(const std::string& model_path);
+    
+    // Подключение списка кандидатов выходной проекции
+    bool load_shortlist(const std::string& shortlist_path);
+    
+    // Смена параметров генерации для последующих запросов
+    void set_generation_options(const GenerationOptions& options);
+    
+    // Символьный решатель перед моделью (см. FormulaInference::set_symbolic_solver)
+    void set_symbolic_solver(bool enabled, double min_confidence = 0.8);
+    
+    // Веса последующих загрузок в разделяемой памяти (см. FormulaInference::set_shared_weights)
+    void set_shared_weights(bool enabled);
+    
+    // Непрерывное батчирование: каждый исполнитель решает до max_batch_size задач сразу,
+    // делая шаг декодера по всем (см. BatchScheduler), и берет новые задачи из очереди
+    // между шагами. 1 - по одной задаче на исполнителя (по умолчанию). В этом режиме
+    // обработчик завершения вызывается под разделяемой блокировкой модели, а вместо
+    // вытеснения интерактивные задачи присоединяются к батчу сверх его размера
+    void set_max_batch_size(int max_batch_size);
+    
+    // Вес класса приоритета во взвешенной очереди. По умолчанию Interactive - 16,
+    // Normal - 4, Background - 1
+    void set_priority_weight(RequestPriority priority, double weight);
+    
+    // Глубина очереди и время ожидания задач класса
+    FairQueueStats get_queue_stats(RequestPriority priority) const;
+    
+    // Включение кэша выходов энкодера, общего для всех потоков-исполнителей
+    void set_encoder_cache_size(size_t max_bytes);
+    EncoderCache::Stats get_encoder_cache_stats() const;
+    
+    // Подключение постоянного кэша решений
+    bool open_solution_cache(const std::string& path, size_t capacity_bytes = 64 << 20);
+    
+    // Постановка задачи в очередь, результат придет через future.
+    // Обработчик фрагментов из request вызывается в потоке-исполнителе (см. FormulaInference::solve).
+    // Срок запроса отсчитывается с момента постановки, то есть включает ожидание в очереди
+    std::future<SolveResult> submit(const std::string& task_text, SolveRequest request = SolveRequest());
+    
+    // Постановка задачи без future: on_complete вызывается в потоке-исполнителе с результатом.
+    // Для циклов событий, которые не могут ждать future (см. formula-solverd)
+    void submit(const std::string& task_text, SolveRequest request,
+                std::function<void(SolveResult)> on_complete);
+    
+    // Синхронное решение задачи на одном из потоков-исполнителей
+    std::string solve_task(const std::string& task_text);
+    
+    // Выполнение действия на одном из потоков-исполнителей в общей очереди с задачами,
+    // без блокировки модели (например, загрузка модели без отдельного потока)
+    void run(std::function<void()> action);
+    
+    // Количество потоков-исполнителей
+    int num_workers() const { return static_cast<int>(workers.size()); }
+    
+private:
+    // Задача в очереди
+    struct Job {
+        std::string task_text;
+        SolveRequest request;
+        std::promise<SolveResult> result;
+        
+        // Если задан, результат передается ему, а не в result
+        std::function<void(SolveResult)> on_complete;
+        
+        // Если задано, выполняется вместо решения задачи
+        std::function<void()> action;
+    };
+    
+    void enqueue(Job job);
+    
+    // Будит исполнителей, чтобы простаивающие обновили буферы под новое поколение модели
+    void notify_generation();
+    
+    // Цикл потока-исполнителя
+    void worker_loop(InferenceSession& session, SessionThreads threads);
+    
+    // Вытеснение на одном исполнителе
+    struct Preemption {
+        // Сессии для задач, вытеснивших текущую: по одной на класс, создаются при первом
+        // вытеснении. Сессии прежнего поколения модели отпускаются, когда исполнитель свободен
+        std::array<std::unique_ptr<InferenceSession>, REQUEST_PRIORITY_COUNT> sessions;
+        
+        // Обработчики завершения вытеснивших задач. Вытеснение идет под разделяемой
+        // блокировкой модели прерванной задачи, поэтому они вызываются циклом исполнителя
+        // после ее снятия: обработчик может менять настройки движка
+        std::vector<std::function<void()>> completions;
+    };
+    
+    // Решение задачи исполнителем: сразу или постановкой в непрерывный батч сессии
+    void dispatch(Job& job, InferenceSession& session, Preemption& preemption);
+    
+    // Решение задачи и передача результата под разделяемой блокировкой модели.
+    // Если lock задан, он снимается перед вызовом обработчика завершения
+    void solve_job(Job& job, InferenceSession& session, std::shared_lock<std::shared_mutex>* lock);
+    
+    // Точка вытеснения для задачи класса priority (кроме самого срочного)
+    void attach_preemption(Job& job, Preemption& preemption);
+    
+    // Решение задач классов срочнее priority, пока они ждут и нет свободных исполнителей.
+    // Вызывается из шага декодера прерванной задачи, под разделяемой блокировкой модели
+    void preempt(size_t priority, Preemption& preemption);
+    
+    // Общие веса и словарь
+    FormulaInference inference;
+    
+    // Настройки движка меняются под монопольной блокировкой, решение задач и загрузка
+    // поколений модели идут под разделяемой
+    mutable std::shared_mutex model_mutex;
+    
+    // Очередь задач по классам приоритета и действия (run), которые идут раньше задач
+    mutable std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    FairQueue<Job> queue;
+    std::deque<Job> actions;
+    bool stopping;
+    
+    // Исполнители, ждущие задач. Пока такие есть, вытеснение не нужно
+    int idle_workers = 0;
+    
+    // Задач в непрерывном батче одного исполнителя, 1 - без батчирования
+    std::atomic<int> max_batch_size{1};
+    
+    // Потоки-исполнители и их сессии
+    std::vector<std::unique_ptr<InferenceSession>> sessions;
+    std::vector<std::thread> workers;
+};
+
+// C API для использования в Vala
+extern "C" {
+    FormulaEngine* formula_engine_new(int num_workers);
+    
+    // threads - всего потоков (0 - по числу ядер), sessions - исполнителей (0 - подобрать),
+    // cpus - список ядер вида "0-3,8" или NULL
+    FormulaEngine* formula_engine_new_with_budget(int threads, int sessions, const char* cpus);
+    void formula_engine_free(FormulaEngine* engine);
+    bool load_model_from_file(FormulaEngine* engine, const char* path);
+    bool load_vocabulary_from_file(FormulaEngine* engine, const char* path);
+    
+    // Модель и словарь (vocab_path может быть NULL) одним поколением
+    bool load_model_with_vocabulary(FormulaEngine* engine, const char* model_path, const char* vocab_path);
+    bool load_quantized_model_from_file(FormulaEngine* engine, const char* path);
+    bool load_scripted_model_from_file(FormulaEngine* engine, const char* path);
+    bool is_model_bundle_file(const char* path);
+    
+    // Веса последующих загрузок в разделяемой памяти, общей для процессов с той же моделью
+    void formula_engine_set_shared_weights(FormulaEngine* engine, bool enabled);
+    
+    // Задач в непрерывном батче одного исполнителя, 1 - без батчирования
+    void formula_engine_set_max_batch_size(FormulaEngine* engine, int max_batch_size);
+    
+    // Блокирует вызывающий поток до готовности решения. Нельзя вызывать из обработчика
+    // фрагментов или завершения, выполняемого исполнителем движка: исполнитель будет ждать сам себя
+    char* process_task_with_model(const char* task_text, FormulaEngine* engine);
+    
+    // Потоковое решение: callback вызывается из потока движка для каждого фрагмента
+    // (строка действительна только во время вызова). Возвращает полное решение, как
+    // process_task_with_model, после последнего фрагмента
+    typedef void (*formula_fragment_callback)(const char* fragment, void* user_data);
+    char* process_task_streaming(const char* task_text, FormulaEngine* engine,
+                                 formula_fragment_callback callback, void* user_data);
+    
+    // Ограничения запроса: срок в миллисекундах (0 - без срока) и отмена из любого потока.
+    // Освобождать после возврата из process_task_request
+    typedef struct FormulaRequest FormulaRequest;
+    FormulaRequest* formula_request_new(int timeout_ms);
+    void formula_request_cancel(FormulaRequest* request);
+    void formula_request_free(FormulaRequest* request);
+    
+    // Задачи C API по умолчанию интерактивные (RequestPriority::Interactive).
+    // priority - значение RequestPriority
+    void formula_request_set_priority(FormulaRequest* request, int priority);
+    
+    // force_model != 0 - решать моделью, даже если задачу берет символьный решатель
+    void formula_request_set_force_model(FormulaRequest* request, int force_model);
+    
+    // Решение с ограничениями: возвращает текст (частичный при истечении срока или отмене),
+    // статус (значение SolveStatus) пишется в status, если он не NULL.
+    // request и callback могут быть NULL. Как и process_task_with_model, блокирует вызывающий
+    // поток: вызов из обработчика на потоке исполнителя движка приводит к взаимоблокировке
+    char* process_task_request(const char* task_text, FormulaEngine* engine, FormulaRequest* request,
+                               formula_fragment_callback callback, void* user_data, int* status);
+    
+    // Асинхронный API. Задачи решают потоки-исполнители движка, а фрагменты и результаты
+    // приходят через очередь событий: её дескриптор (eventfd) добавляется в цикл событий
+    // владельца (GMainContext, epoll), и когда он готов к чтению, владелец вызывает
+    // formula_queue_dispatch - обработчики выполняются в вызвавшем его потоке.
+    // Очередь освобождается после движка или когда в ней нет незавершенных запросов:
+    // при освобождении незавершенные запросы отменяются, их обработчики не вызываются
+    typedef struct FormulaQueue FormulaQueue;
+    FormulaQueue* formula_queue_new(void);
+    void formula_queue_free(FormulaQueue* queue);
+    int formula_queue_fd(FormulaQueue* queue);
+    
+    // Выполняет накопленные обработчики, возвращает их число
+    int formula_queue_dispatch(FormulaQueue* queue);
+    
+    // Отмена запроса: результат все равно придет, со статусом CANCELLED и частью решения.
+    // false, если запрос уже завершен
+    bool formula_queue_cancel(FormulaQueue* queue, uint64_t request_id);
+    
+    // Результат решения с подсчетом ссылок. Обработчик получает заимствованную ссылку:
+    // чтобы сохранить результат после возврата из обработчика, нужен formula_result_ref
+    typedef struct FormulaResult FormulaResult;
+    FormulaResult* formula_result_ref(FormulaResult* result);
+    void formula_result_unref(FormulaResult* result);
+    
+    // Текст действителен, пока на результат есть ссылка
+    const char* formula_result_text(const FormulaResult* result);
+    size_t formula_result_length(const FormulaResult* result);
+    int formula_result_status(const FormulaResult* result);
+    
+    // Копирование текста в буфер вызывающего (с завершающим нулем, с обрезкой по size).
+    // Возвращает полную длину текста
+    size_t formula_result_copy_text(const FormulaResult* result, char* buffer, size_t size);
+    
+    typedef void (*formula_complete_callback)(uint64_t request_id, FormulaResult* result, void* user_data);
+    typedef void (*formula_load_callback)(uint64_t request_id, bool success, void* user_data);
+    
+    // Постановка задачи: возвращает номер запроса (0 при ошибке). Фрагменты (если задан
+    // on_fragment) и результат приходят через queue. timeout_ms = 0 - без срока
+    uint64_t formula_engine_submit(FormulaEngine* engine, FormulaQueue* queue, const char* task_text, int timeout_ms,
+                                   formula_fragment_callback on_fragment, formula_complete_callback on_complete,
+                                   void* user_data);
+    
+    // То же с классом приоритета (значение RequestPriority)
+    uint64_t formula_engine_submit_with_priority(FormulaEngine* engine, FormulaQueue* queue, const char* task_text,
+                                                 int timeout_ms, int priority, formula_fragment_callback on_fragment,
+                                                 formula_complete_callback on_complete, void* user_data);
+    
+    // Загрузка модели и словаря (vocab_path может быть NULL) на потоке-исполнителе
+    uint64_t formula_engine_load_async(FormulaEngine* engine, FormulaQueue* queue, const char* model_path,
+                                       const char* vocab_path, formula_load_callback on_loaded, void* user_data);
+}
+
+} // namespace formula_teacher
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace formula_teacher {
+
+// Статистика одного класса очереди
+struct FairQueueStats {
+    // Сейчас в очереди
+    size_t depth = 0;
+    
+    // Наибольшая глубина с момента создания
+    size_t max_depth = 0;
+    
+    // Выдано из очереди и сколько они ждали
+    uint64_t dequeued = 0;
+    double mean_wait_ms = 0.0;
+    double max_wait_ms = 0.0;
+    
+    // Оценки процентилей ожидания по гистограмме со степенями двойки (верхняя граница корзины)
+    double p50_wait_ms = 0.0;
+    double p99_wait_ms = 0.0;
+};
+
+// Взвешенная справедливая очередь: элементы нескольких классов, класс 0 - самый срочный.
+// Каждому классу достается доля выдач, пропорциональная весу, пока в нем есть элементы;
+// простаивающий класс не копит кредит. Внутри класса порядок FIFO.
+// Выбор - по виртуальному времени начала (start-time fair queuing) с единичной ценой
+// элемента. Не потокобезопасна: доступ под блокировкой владельца
+template <typename T>
+class FairQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    explicit FairQueue(std::vector<double> weights) : classes(weights.size()) {
+        if (weights.empty()) {
+            throw std::invalid_argument("Очереди нужен хотя бы один класс");
+        }
+        for (size_t i = 0; i < weights.size(); ++i) {
+            set_weight(i, weights[i]);
+        }
+    }
+    
+    size_t class_count() const { return classes.size(); }
+    
+    // Вес класса, неположительный заменяется минимальным
+    void set_weight(size_t index, double weight) {
+        classes.at(index).weight = std::max(weight, 1e-6);
+    }
+    
+    void push(size_t index, T item) {
+        Class& queue_class = classes.at(index);
+        
+        // Класс, вставший в очередь после простоя, начинает с текущего виртуального времени
+        if (queue_class.items.empty()) {
+            queue_class.start = std::max(queue_class.start, virtual_time);
+        }
+        queue_class.items.push_back({std::move(item), Clock::now()});
+        queue_class.max_depth = std::max(queue_class.max_depth, queue_class.items.size());
+        ++total;
+    }
+    
+    bool empty() const { return total == 0; }
+    size_t size() const { return total; }
+    
+    // Класс, из которого выдаст pop(limit), или class_count(), если среди классов
+    // с номером меньше limit элементов нет. При равном времени выигрывает более срочный
+    size_t next_class(size_t limit = std::numeric_limits<size_t>::max()) const {
+        size_t best = classes.size();
+        for (size_t i = 0; i < classes.size() && i < limit; ++i) {
+            if (!classes[i].items.empty() && (best == classes.size() || classes[i].start < classes[best].start)) {
+                best = i;
+            }
+        }
+        return best;
+    }
+    
+    // Выдача следующего элемента среди классов с номером меньше limit.
+    // Вызывающий проверяет next_class(limit) < class_count()
+    T pop(size_t limit = std::numeric_limits<size_t>::max()) {
+        size_t index = next_class(limit);
+        Class& queue_class = classes.at(index);
+        
+        virtual_time = queue_class.start;
+        queue_class.start += 1.0 / queue_class.weight;
+        
+        Entry entry = std::move(queue_class.items.front());
+        queue_class.items.pop_front();
+        --total;
+        
+        record_wait(queue_class, Clock::now() - entry.enqueued);
+        return std::move(entry.item);
+    }
+    
+    FairQueueStats stats(size_t index) const {
+        const Class& queue_class = classes.at(index);
+        
+        FairQueueStats result;
+        result.depth = queue_class.items.size();
+        result.max_depth = queue_class.max_depth;
+        result.dequeued = queue_class.dequeued;
+        if (queue_class.dequeued > 0) {
+            result.mean_wait_ms = queue_class.total_wait_us / 1000.0 / static_cast<double>(queue_class.dequeued);
+        }
+        result.max_wait_ms = queue_class.max_wait_us / 1000.0;
+        result.p50_wait_ms = percentile(queue_class, 0.50);
+        result.p99_wait_ms = percentile(queue_class, 0.99);
+        return result;
+    }
+    
+private:
+    // Корзина i гистограммы ожидания - меньше 2^i микросекунд
+    static constexpr size_t WAIT_BUCKETS = 40;
+    
+    struct Entry {
+        T item;
+        Clock::time_point enqueued;
+    };
+    
+    struct Class {
+        std::deque<Entry> items;
+        double weight = 1.0;
+        
+        // Виртуальное время начала следующей выдачи
+        double start = 0.0;
+        
+        size_t max_depth = 0;
+        uint64_t dequeued = 0;
+        double total_wait_us = 0.0;
+        double max_wait_us = 0.0;
+        std::array<uint64_t, WAIT_BUCKETS> wait_histogram{};
+    };
+    
+    static void record_wait(Class& queue_class, Clock::duration wait) {
+        double wait_us = std::chrono::duration<double, std::micro>(wait).count();
+        ++queue_class.dequeued;
+        queue_class.total_wait_us += wait_us;
+        queue_class.max_wait_us = std::max(queue_class.max_wait_us, wait_us);
+        
+        size_t bucket = 0;
+        while (bucket + 1 < WAIT_BUCKETS && static_cast<double>(uint64_t(1) << bucket) <= wait_us) {
+            ++bucket;
+        }
+        ++queue_class.wait_histogram[bucket];
+    }
+    
+    static double percentile(const Class& queue_class, double fraction) {
+        if (queue_class.dequeued == 0) {
+            return 0.0;
+        }
+        
+        uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(queue_class.dequeued - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < WAIT_BUCKETS; ++bucket) {
+            seen += queue_class.wait_histogram[bucket];
+            if (seen >= rank) {
+                return std::min(static_cast<double>(uint64_t(1) << bucket), queue_class.max_wait_us) / 1000.0;
+            }
+        }
+        return queue_class.max_wait_us / 1000.0;
+    }
+    
+    std::vector<Class> classes;
+    size_t total = 0;
+    
+    // Виртуальное время последней выдачи
+    double virtual_time = 0.0;
+};
+
+} // namespace formula_teacher
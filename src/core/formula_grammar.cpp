@@ -0,0 +1,243 @@
+#include "formula_grammar.h"
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+namespace formula_teacher {
+
+namespace {
+
+const std::string OPEN_TAG = "<formula>";
+const std::string CLOSE_TAG = "</formula>";
+
+bool starts_with(const std::string& text, const std::string& prefix) {
+    return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool ends_with(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+FormulaGrammar::FormulaGrammar(const FormulaTokenizer& tokenizer, int vocab_size) {
+    size_t size = static_cast<size_t>(std::max(0, vocab_size));
+    token_tables.text_allowed.assign(size, 0);
+    token_tables.formula_allowed.assign(size, 0);
+    token_tables.opens_formula.assign(size, 0);
+    token_tables.closes_formula.assign(size, 0);
+    token_tables.close_kind.assign(size, -1);
+    token_tables.close_count.assign(size, 0);
+    token_tables.depth_change.assign(size, 0);
+    token_opens.resize(size);
+    whole_formulas.assign(size, 0);
+    
+    // Виды скобок, которые хоть один токен закрывает
+    std::unordered_set<int> closable;
+    
+    for (size_t id = 0; id < size; ++id) {
+        int token_id = static_cast<int>(id);
+        if (token_id == FormulaTokenizer::PAD || token_id == FormulaTokenizer::SOS) {
+            continue;
+        }
+        if (token_id == FormulaTokenizer::EOS) {
+            token_tables.text_allowed[id] = 1;
+            continue;
+        }
+        
+        const std::string& text = tokenizer.token_text(token_id);
+        if (text == OPEN_TAG) {
+            token_tables.text_allowed[id] = 1;
+            token_tables.opens_formula[id] = 1;
+            token_tables.depth_change[id] = 1;
+            continue;
+        }
+        if (text == CLOSE_TAG) {
+            token_tables.formula_allowed[id] = 1;
+            token_tables.closes_formula[id] = 1;
+            token_tables.depth_change[id] = -1;
+            continue;
+        }
+        
+        // Формула целиком в одном токене допустима, только если она сбалансирована
+        if (text.size() >= OPEN_TAG.size() + CLOSE_TAG.size() && starts_with(text, OPEN_TAG) &&
+            ends_with(text, CLOSE_TAG)) {
+            auto brackets = scan(text.substr(OPEN_TAG.size(), text.size() - OPEN_TAG.size() - CLOSE_TAG.size()));
+            whole_formulas[id] = 1;
+            token_tables.text_allowed[id] = brackets.valid && brackets.closes.empty() && brackets.opens.empty();
+            continue;
+        }
+        
+        // Обрывки тегов формулы не допускаются нигде
+        if (text.find(OPEN_TAG) != std::string::npos || text.find(CLOSE_TAG) != std::string::npos) {
+            continue;
+        }
+        
+        token_tables.text_allowed[id] = 1;
+        
+        auto brackets = scan(text);
+        bool uniform = std::all_of(brackets.closes.begin(), brackets.closes.end(),
+                                   [&](int kind) { return kind == brackets.closes.front(); });
+        if (!brackets.valid || !uniform) {
+            continue;
+        }
+        
+        token_tables.formula_allowed[id] = 1;
+        if (!brackets.closes.empty()) {
+            token_tables.close_kind[id] = brackets.closes.front();
+            token_tables.close_count[id] = static_cast<int32_t>(brackets.closes.size());
+            closable.insert(brackets.closes.front());
+        }
+        token_tables.depth_change[id] = static_cast<int32_t>(brackets.opens.size()) -
+                                        static_cast<int32_t>(brackets.closes.size());
+        token_opens[id] = std::move(brackets.opens);
+    }
+    
+    // Окружение, которое нечем закрыть, сделает ответ некорректным до конца генерации
+    for (size_t id = 0; id < size; ++id) {
+        for (int kind : token_opens[id]) {
+            if (!closable.count(kind)) {
+                token_tables.formula_allowed[id] = 0;
+                break;
+            }
+        }
+    }
+}
+
+FormulaGrammar::Brackets FormulaGrammar::scan(const std::string& text) {
+    Brackets result;
+    
+    auto open = [&](int kind) { result.opens.push_back(kind); };
+    auto close = [&](int kind) {
+        if (result.opens.empty()) {
+            result.closes.push_back(kind);
+        } else if (result.opens.back() == kind) {
+            result.opens.pop_back();
+        } else {
+            result.valid = false;
+        }
+    };
+    
+    size_t i = 0;
+    while (i < text.size() && result.valid) {
+        char c = text[i];
+        if (c == '\\') {
+            if (i + 1 >= text.size()) {
+                break;
+            }
+            char next = text[i + 1];
+            
+            // \{ и \} - скобки множества, \\ - перенос строки
+            if (next == '{' || next == '}') {
+                next == '{' ? open(DELIMITER) : close(DELIMITER);
+                i += 2;
+                continue;
+            }
+            if (!std::isalpha(static_cast<unsigned char>(next))) {
+                i += 2;
+                continue;
+            }
+            
+            size_t name_end = i + 1;
+            while (name_end < text.size() && std::isalpha(static_cast<unsigned char>(text[name_end]))) {
+                ++name_end;
+            }
+            std::string command = text.substr(i + 1, name_end - i - 1);
+            i = name_end;
+            
+            if ((command == "begin" || command == "end") && i < text.size() && text[i] == '{') {
+                size_t brace_end = text.find('}', i);
+                if (brace_end == std::string::npos) {
+                    // Обрывок \begin{ без имени окружения
+                    result.valid = false;
+                    break;
+                }
+                std::string name = text.substr(i + 1, brace_end - i - 1);
+                auto it = environments.emplace(name, FIRST_ENVIRONMENT + static_cast<int>(environments.size())).first;
+                command == "begin" ? open(it->second) : close(it->second);
+                i = brace_end + 1;
+            }
+            continue;
+        }
+        
+        switch (c) {
+            case '{': open(GROUP); break;
+            case '}': close(GROUP); break;
+            case '(':
+            case '[': open(DELIMITER); break;
+            case ')':
+            case ']': close(DELIMITER); break;
+            default: break;
+        }
+        ++i;
+    }
+    
+    return result;
+}
+
+int FormulaGrammar::top_run(const GrammarState& state) {
+    int run = 0;
+    int kind = top_kind(state);
+    for (auto it = state.stack.rbegin(); it != state.stack.rend() && *it == kind; ++it) {
+        ++run;
+    }
+    return run;
+}
+
+int FormulaGrammar::depth_limit(int remaining) {
+    return std::min(MAX_DEPTH + 1, remaining - 1);
+}
+
+bool FormulaGrammar::allows(const GrammarState& state, int token, int remaining) const {
+    if (token < 0 || token >= vocab_size()) {
+        return false;
+    }
+    size_t id = static_cast<size_t>(token);
+    
+    if (state.in_formula) {
+        if (!token_tables.formula_allowed[id]) {
+            return false;
+        }
+        int count = token_tables.close_count[id];
+        if (count > 0 && (token_tables.close_kind[id] != top_kind(state) || count > top_run(state))) {
+            return false;
+        }
+        if (token_tables.closes_formula[id] && !state.stack.empty()) {
+            return false;
+        }
+    } else if (!token_tables.text_allowed[id]) {
+        return false;
+    }
+    
+    int change = token_tables.depth_change[id];
+    int depth = static_cast<int>(state.stack.size()) + (state.in_formula ? 1 : 0);
+    return change <= 0 || depth + change <= depth_limit(remaining);
+}
+
+void FormulaGrammar::advance(GrammarState& state, int token) const {
+    if (token < 0 || token >= vocab_size()) {
+        return;
+    }
+    size_t id = static_cast<size_t>(token);
+    
+    if (token_tables.opens_formula[id]) {
+        state.in_formula = true;
+        state.stack.clear();
+    } else if (token_tables.closes_formula[id]) {
+        if (state.in_formula) {
+            ++state.formulas;
+        }
+        state.in_formula = false;
+        state.stack.clear();
+    } else if (!state.in_formula) {
+        if (whole_formulas[id]) {
+            ++state.formulas;
+        }
+    } else {
+        int count = std::min(token_tables.close_count[id], static_cast<int32_t>(state.stack.size()));
+        state.stack.resize(state.stack.size() - static_cast<size_t>(count));
+        state.stack.insert(state.stack.end(), token_opens[id].begin(), token_opens[id].end());
+    }
+}
+
+} // namespace formula_teacher
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "tokenizer.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace formula_teacher {
+
+// Состояние ответа при ограниченном декодировании (магазинная память грамматики)
+struct GrammarState {
+    // Внутри <formula> ... </formula>
+    bool in_formula = false;
+    
+    // Незакрытые скобки и окружения LaTeX текущей формулы, вид - см. FormulaGrammar
+    std::vector<int> stack;
+    
+    // Закрытых формул верхнего уровня
+    int formulas = 0;
+};
+
+// Грамматика корректного ответа: формулы закрыты, а внутри формулы сбалансированы
+// фигурные скобки, круглые и квадратные скобки (закрываются любой из двух, чтобы
+// допускать полуинтервалы) и окружения \begin{...} ... \end{...}. Конец
+// последовательности допустим только вне формулы.
+//
+// Свойства токенов считаются один раз по словарю, поэтому допустимость токена
+// в состоянии проверяется по нескольким числам, а маска для батча строится
+// векторно (см. grammar_mask). Токен, закрывающий несколько скобок, допустим,
+// только если все они одного вида. Токены, закрывающие не то, что открыли сами,
+// и токены, открывающие окружение без закрывающего токена в словаре, не допускаются
+class FormulaGrammar {
+public:
+    // Предел вложенности скобок внутри формулы
+    static constexpr int MAX_DEPTH = 32;
+    
+    // Виды скобок, окружения нумеруются с FIRST_ENVIRONMENT
+    static constexpr int GROUP = 0;
+    static constexpr int DELIMITER = 1;
+    static constexpr int FIRST_ENVIRONMENT = 2;
+    
+    // Свойства токенов по индексу, для векторной маски
+    struct Tables {
+        // Допустим вне формулы и внутри формулы (без учета скобок)
+        std::vector<uint8_t> text_allowed;
+        std::vector<uint8_t> formula_allowed;
+        
+        // <formula> и </formula>
+        std::vector<uint8_t> opens_formula;
+        std::vector<uint8_t> closes_formula;
+        
+        // Вид и число скобок, которые токен закрывает (-1 и 0, если не закрывает)
+        std::vector<int32_t> close_kind;
+        std::vector<int32_t> close_count;
+        
+        // Изменение вложенности: скобки и сама формула
+        std::vector<int32_t> depth_change;
+    };
+    
+    // Таблицы для vocab_size токенов модели, токены вне словаря считаются <unk>
+    FormulaGrammar(const FormulaTokenizer& tokenizer, int vocab_size);
+    
+    int vocab_size() const { return static_cast<int>(token_tables.text_allowed.size()); }
+    const Tables& tables() const { return token_tables; }
+    
+    // Допустим ли token в state, если после него остается remaining шагов:
+    // вложенность растет, только пока ее успевают закрыть (скобки, формула и конец
+    // последовательности - хотя бы по токену)
+    bool allows(const GrammarState& state, int token, int remaining) const;
+    
+    // Переход по выданному токену. Недопустимый токен не ломает состояние:
+    // лишние закрывающие скобки пропускаются
+    void advance(GrammarState& state, int token) const;
+    
+    // Ответ структурно закончен: закрыто max_formulas формул верхнего уровня
+    // и новая не открыта. max_formulas = 0 - конец определяет модель
+    static bool complete(const GrammarState& state, int max_formulas) {
+        return max_formulas > 0 && !state.in_formula && state.formulas >= max_formulas;
+    }
+    
+    // Вид скобки на вершине, число таких подряд сверху и предел вложенности после шага
+    static int top_kind(const GrammarState& state) { return state.stack.empty() ? -1 : state.stack.back(); }
+    static int top_run(const GrammarState& state);
+    static int depth_limit(int remaining);
+    
+private:
+    // Скобки, которые токен формулы закрывает и открывает
+    struct Brackets {
+        bool valid = true;
+        std::vector<int> closes;
+        std::vector<int> opens;
+    };
+    
+    // Разбор текста формулы, окружения получают номера в environments
+    Brackets scan(const std::string& text);
+    
+    Tables token_tables;
+    
+    // Скобки, открываемые токенами формул (по индексу, пусто у большинства)
+    std::vector<std::vector<int>> token_opens;
+    
+    // Формулы целиком в одном токене
+    std::vector<uint8_t> whole_formulas;
+    
+    std::unordered_map<std::string, int> environments;
+};
+
+} // namespace formula_teacher
@@ -1,86 +1,613 @@
 #include "inference.h"
+#include "digest.h"
+#include <fstream>
 #include <iostream>
+#include <algorithm>
 #include <memory>
 
 namespace formula_teacher {
 
-// Глобальный объект для работы с библиотекой из C API
-static FormulaInference g_inference;
+namespace {
 
-FormulaInference::FormulaInference() : model_loaded(false), vocabulary_loaded(false) {
+// Хэш параметров генерации, от которых зависит решение
+uint64_t options_digest(const GenerationOptions& options) {
+    uint64_t hash = digest_bytes(&options.max_length, sizeof(options.max_length));
+    hash = digest_bytes(&options.beam_width, sizeof(options.beam_width), hash);
+    hash = digest_bytes(&options.length_penalty, sizeof(options.length_penalty), hash);
+    hash = digest_bytes(&options.shortlist_min_confidence, sizeof(options.shortlist_min_confidence), hash);
+    hash = digest_bytes(&options.constrain_formulas, sizeof(options.constrain_formulas), hash);
+    return digest_bytes(&options.max_formulas, sizeof(options.max_formulas), hash);
+}
+
+// Почему генерация остановилась
+SolveStatus stop_status(const std::vector<int>& output_tokens, int max_length, const RequestLimits& limits) {
+    if (!output_tokens.empty() && output_tokens.back() == FormulaTokenizer::EOS) {
+        return SolveStatus::Completed;
+    }
+    if (static_cast<int>(output_tokens.size()) >= max_length) {
+        return SolveStatus::MaxLength;
+    }
+    if (limits.cancelled()) {
+        return SolveStatus::Cancelled;
+    }
+    return SolveStatus::DeadlineExceeded;
+}
+
+// Задача в непрерывном батче, живет до завершения своей последовательности
+struct BatchTask {
+    // Поколение держит токенизатор, на который ссылается detokenizer
+    std::shared_ptr<const ModelGeneration> generation;
+    std::vector<int> input_tokens;
+    SolutionKey solution_key;
+    int max_length = 0;
+    RequestLimits limits;
+    FragmentCallback on_fragment;
+    std::function<void(SolveResult)> on_complete;
+    std::unique_ptr<StreamingDetokenizer> detokenizer;
+};
+
+} // namespace
+
+FormulaInference::FormulaInference() {
     // Инициализация
 }
 
-bool FormulaInference::load_model(const std::string& model_path) {
+void FormulaInference::build_model(ModelGeneration& next, const std::string& model_path, bool quantize_int8) const {
+    next.scripted_model.reset();
+    if (BundleFile::is_bundle(model_path)) {
+        // Пакет содержит и словарь, хэши записаны в заголовке - файл целиком не читается
+        auto bundle = BundleFile::open(model_path);
+        next.model = FormulaModel::from_bundle(bundle);
+        next.tokenizer = std::make_shared<FormulaTokenizer>(bundle->vocabulary());
+        next.model_digest = bundle->header().model_digest;
+        next.vocabulary_digest = bundle->header().vocabulary_digest;
+    } else if (shared_weights) {
+        // Веса ищутся в разделяемой памяти по хэшу файла: если модель уже загрузил другой
+        // процесс, файл не разбирается, иначе загруженные веса публикуются для следующих
+        next.model_digest = digest_file(model_path);
+        auto bundle = BundleFile::attach_shared(next.model_digest);
+        if (!bundle) {
+            bundle = FormulaModel::load(model_path)->share_weights(next.model_digest);
+        }
+        next.model = FormulaModel::from_bundle(bundle);
+    } else {
+        next.model = FormulaModel::load(model_path);
+        next.model_digest = digest_file(model_path);
+    }
+    next.model->eval();
+    
+    next.quantization_report = QuantizationReport();
+    if (quantize_int8) {
+        next.quantization_report = next.model->quantize_int8();
+        const auto& report = next.quantization_report;
+        std::cerr << "Модель квантована в int8: веса " << report.fp32_bytes
+                  << " -> " << report.int8_bytes << " байт, отклонение логитов max "
+                  << report.max_logit_error << " / среднее " << report.mean_logit_error
+                  << ", совпадение токенов с fp32 " << report.token_agreement * 100.0 << "%"
+                  << std::endl;
+        
+        // Квантованная модель дает другие решения - отделяем их в кэше решений
+        next.model_digest = digest_bytes("int8", 4, next.model_digest);
+    }
+    
+    // Список кандидатов, сохраненный при обучении рядом с моделью
+    std::string shortlist_path = model_path + ".shortlist";
+    if (std::ifstream(shortlist_path).good()) {
+        try {
+            build_shortlist(next, shortlist_path);
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка при загрузке списка кандидатов: " << e.what() << std::endl;
+        }
+    }
+    
+    // Прогрев до публикации: первые запросы нового поколения не платят за отложенную
+    // инициализацию LibTorch и первое обращение к страницам весов
+    auto workspace = next.model->create_workspace(WORKSPACE_INPUT_LENGTH);
+    next.model->warm_up(workspace, generation_options.max_length);
+}
+
+void FormulaInference::build_vocabulary(ModelGeneration& next, const std::string& vocab_path) const {
+    next.tokenizer = std::make_shared<FormulaTokenizer>(vocab_path);
+    next.vocabulary_digest = digest_file(vocab_path);
+}
+
+void FormulaInference::build_shortlist(ModelGeneration& next, const std::string& shortlist_path) const {
+    if (!next.model) {
+        throw std::runtime_error("модель не загружена");
+    }
+    
+    auto shortlist = std::make_shared<VocabularyShortlist>(VocabularyShortlist::load(shortlist_path));
+    next.model->set_shortlist(shortlist);
+    
+    // Кандидаты меняют решения - отделяем их в кэше решений
+    next.model_digest = digest_bytes("shortlist", 9, digest_bytes(&next.model_digest, sizeof(next.model_digest),
+                                                                  digest_file(shortlist_path)));
+}
+
+std::shared_ptr<ModelGeneration> FormulaInference::next_generation() const {
+    auto current = current_generation();
+    return current ? std::make_shared<ModelGeneration>(*current) : std::make_shared<ModelGeneration>();
+}
+
+void FormulaInference::build_grammar(ModelGeneration& next) const {
+    if (!next.model || !next.tokenizer) {
+        return;
+    }
+    
+    // Модель может достаться от прежнего поколения со старым словарем - грамматику строим заново
     try {
-        model = FormulaModel::load(model_path);
-        model_loaded = true;
-        return true;
+        next.model->set_grammar(std::make_shared<FormulaGrammar>(*next.tokenizer, next.model->get_vocab_size()));
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при построении грамматики формул: " << e.what() << std::endl;
+        next.model->set_grammar(nullptr);
+    }
+}
+
+void FormulaInference::publish(std::shared_ptr<ModelGeneration> next) {
+    build_grammar(*next);
+    next->id = ++last_generation_id;
+    std::atomic_store(&generation, std::shared_ptr<const ModelGeneration>(std::move(next)));
+    
+    // Записи прежних поколений больше не найдутся (номер поколения входит в ключ), освобождаем память
+    if (encoder_cache) {
+        encoder_cache->clear();
+    }
+}
+
+bool FormulaInference::load_model(const std::string& model_path, bool quantize_int8) {
+    return load(model_path, "", quantize_int8);
+}
+
+bool FormulaInference::load(const std::string& model_path, const std::string& vocab_path, bool quantize_int8) {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    
+    auto next = next_generation();
+    try {
+        build_model(*next, model_path, quantize_int8);
     } catch (const std::exception& e) {
         std::cerr << "Ошибка при загрузке модели: " << e.what() << std::endl;
-        model_loaded = false;
         return false;
     }
+    
+    if (!vocab_path.empty()) {
+        try {
+            build_vocabulary(*next, vocab_path);
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка при загрузке словаря: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    
+    publish(std::move(next));
+    return true;
+}
+
+bool FormulaInference::load_shortlist(const std::string& shortlist_path) {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    
+    auto next = next_generation();
+    try {
+        build_shortlist(*next, shortlist_path);
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при загрузке списка кандидатов: " << e.what() << std::endl;
+        return false;
+    }
+    
+    // Кандидаты попадают в состояния, которые хранит кэш энкодера, - нужно новое поколение
+    publish(std::move(next));
+    return true;
+}
+
+bool FormulaInference::load_scripted_model(const std::string& model_path) {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    
+    auto next = next_generation();
+    try {
+        next->scripted_model = ScriptedFormulaModel::load(model_path);
+        next->model.reset();
+        next->model_digest = digest_bytes("script", 6, digest_file(model_path));
+        next->quantization_report = QuantizationReport();
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при загрузке TorchScript-модели: " << e.what() << std::endl;
+        return false;
+    }
+    
+    publish(std::move(next));
+    return true;
 }
 
 bool FormulaInference::load_vocabulary(const std::string& vocab_path) {
+    std::lock_guard<std::mutex> lock(load_mutex);
+    
+    auto next = next_generation();
     try {
-        tokenizer = std::make_unique<FormulaTokenizer>(vocab_path);
-        vocabulary_loaded = true;
-        return true;
+        build_vocabulary(*next, vocab_path);
     } catch (const std::exception& e) {
         std::cerr << "Ошибка при загрузке словаря: " << e.what() << std::endl;
-        vocabulary_loaded = false;
         return false;
     }
+    
+    publish(std::move(next));
+    return true;
 }
 
-std::string FormulaInference::solve_task(const std::string& task_text) {
-    if (!model_loaded || !vocabulary_loaded) {
-        return "Ошибка: Модель или словарь не загружены";
+QuantizationReport FormulaInference::get_quantization_report() const {
+    auto current = current_generation();
+    return current ? current->quantization_report : QuantizationReport();
+}
+
+uint64_t FormulaInference::generation_id() const {
+    auto current = current_generation();
+    return current ? current->id : 0;
+}
+
+void FormulaInference::set_encoder_cache_size(size_t max_bytes) {
+    if (max_bytes == 0) {
+        encoder_cache.reset();
+    } else {
+        encoder_cache = std::make_unique<EncoderCache>(max_bytes);
+    }
+}
+
+EncoderCache::Stats FormulaInference::get_encoder_cache_stats() const {
+    return encoder_cache ? encoder_cache->stats() : EncoderCache::Stats();
+}
+
+bool FormulaInference::open_solution_cache(const std::string& path, size_t capacity_bytes) {
+    try {
+        solution_cache = SolutionCache::open(path, capacity_bytes);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при открытии кэша решений: " << e.what() << std::endl;
+        solution_cache.reset();
+        return false;
+    }
+}
+
+void FormulaInference::bind_session(InferenceSession& session, const ModelGeneration& current,
+                                    bool warm_up) const {
+    session.generation = current.id;
+    
+    // Буферы прежнего поколения отпускают его веса в любом случае
+    session.workspace = DecoderWorkspace();
+    if (!current.model) {
+        return;
     }
     
     try {
-        // Токенизация входного текста
-        std::vector<int> input_tokens = tokenizer->tokenize(task_text);
-        
-        // Добавление специальных токенов
-        input_tokens.insert(input_tokens.begin(), FormulaTokenizer::SOS);
+        session.input_tokens.reserve(WORKSPACE_INPUT_LENGTH);
+        session.output_tokens.reserve(static_cast<size_t>(std::max(0, generation_options.max_length)));
+        session.workspace = current.model->create_workspace(WORKSPACE_INPUT_LENGTH);
+        if (warm_up) {
+            current.model->warm_up(session.workspace, generation_options.max_length);
+        }
+    } catch (const std::exception& e) {
+        // Без буферов сессия декодирует обычным путем
+        std::cerr << "Ошибка при прогреве модели: " << e.what() << std::endl;
+        session.workspace = DecoderWorkspace();
+    }
+}
+
+void FormulaInference::prepare_session(InferenceSession& session) const {
+    auto current = current_generation();
+    if (current) {
+        bind_session(session, *current, true);
+    }
+}
+
+std::string FormulaInference::solve_task(const std::string& task_text) const {
+    InferenceSession session;
+    return solve_task(task_text, session);
+}
+
+std::string FormulaInference::solve_task(const std::string& task_text, InferenceSession& session) const {
+    return solve(task_text, session, SolveRequest()).text;
+}
+
+std::string FormulaInference::solve_task(const std::string& task_text, InferenceSession& session,
+                                         const FragmentCallback& on_fragment) const {
+    SolveRequest request;
+    request.on_fragment = on_fragment;
+    return solve(task_text, session, request).text;
+}
+
+SolveResult FormulaInference::solve(const std::string& task_text, InferenceSession& session,
+                                    const SolveRequest& request) const {
+    const auto& on_fragment = request.on_fragment;
+    const auto& limits = request.limits;
+    
+    // Текст, целиком выдаваемый одним фрагментом (кэш, ошибки)
+    auto emit = [&](const std::string& text, SolveStatus status) -> SolveResult {
+        if (on_fragment && !text.empty()) {
+            on_fragment(text);
+        }
+        return {text, status};
+    };
+    
+    // Простые задачи решаются символьно, без модели
+    SolveResult symbolic_result;
+    if (!request.force_model && solve_symbolically(task_text, symbolic_result)) {
+        emit(symbolic_result.text, symbolic_result.status);
+        return symbolic_result;
+    }
+    
+    // Поколение модели фиксируется на весь запрос: загрузка новой модели его не затронет
+    auto current = current_generation();
+    if (!current || !current->model_loaded() || !current->vocabulary_loaded()) {
+        return emit("Ошибка: Модель или словарь не загружены", SolveStatus::Error);
+    }
+    const auto& model = current->model;
+    const auto& tokenizer = current->tokenizer;
+    
+    // Запрос мог быть отменен или просрочен, пока стоял в очереди
+    if (limits.cancelled()) {
+        return {"", SolveStatus::Cancelled};
+    }
+    if (limits.expired()) {
+        return {"", SolveStatus::DeadlineExceeded};
+    }
+    
+    try {
+        // Токенизация входного текста с добавлением специальных токенов
+        auto& input_tokens = session.input_tokens;
+        input_tokens.clear();
+        input_tokens.push_back(FormulaTokenizer::SOS);
+        tokenizer->tokenize(task_text, input_tokens);
         input_tokens.push_back(FormulaTokenizer::EOS);
         
-        // Генерация решения
-        std::vector<int> output_tokens = model->generate(input_tokens);
+        // Готовое решение для той же модели, словаря и параметров генерации
+        SolutionKey solution_key;
+        solution_key.model_digest = current->model_digest;
+        solution_key.vocabulary_digest = current->vocabulary_digest;
+        solution_key.options_digest = options_digest(generation_options);
+        solution_key.input_tokens = &input_tokens;
+        
+        std::string solution;
+        if (solution_cache && solution_cache->lookup(solution_key, solution)) {
+            return emit(solution, SolveStatus::Completed);
+        }
+        
+        // Токены превращаются в текст по мере генерации
+        StreamingDetokenizer detokenizer(*tokenizer);
+        TokenCallback on_token;
+        if (on_fragment) {
+            on_token = [&](int token) {
+                auto fragment = detokenizer.push(token);
+                if (!fragment.empty()) {
+                    on_fragment(fragment);
+                }
+            };
+        }
+        
+        if (current->scripted_model) {
+            // Замороженный граф декодирует жадно
+            session.output_tokens = current->scripted_model->generate(input_tokens, generation_options.max_length,
+                                                             on_token, &limits);
+        } else {
+            // Повторные задачи берут выход энкодера и ключи внимания из кэша
+            DecoderState state;
+            if (!encoder_cache || !encoder_cache->lookup(current->id, input_tokens, state)) {
+                state = model->prepare(input_tokens);
+                if (encoder_cache) {
+                    encoder_cache->insert(current->id, input_tokens, state);
+                }
+            }
+            
+            // Буферы прежнего поколения не подходят - создаем под текущее
+            if (session.generation != current->id) {
+                bind_session(session, *current, false);
+            }
+            
+            // Генерация решения в буферах сессии
+            model->decode(state, generation_options, session.workspace, session.output_tokens, on_token, &limits);
+        }
+        
+        // Незакрытая формула в конце ответа
+        if (on_fragment) {
+            auto tail = detokenizer.finish();
+            if (!tail.empty()) {
+                on_fragment(tail);
+            }
+        }
+        
+        // Почему генерация остановилась
+        const auto& output_tokens = session.output_tokens;
+        SolveStatus status = stop_status(output_tokens, generation_options.max_length, limits);
         
         // Детокенизация результата
-        std::string solution = tokenizer->detokenize(output_tokens);
+        solution = tokenizer->detokenize(output_tokens);
+        
+        // Прерванный ответ зависит от нагрузки, а не только от входа - в кэш не попадает
+        if (solution_cache && (status == SolveStatus::Completed || status == SolveStatus::MaxLength)) {
+            solution_cache->insert(solution_key, solution);
+        }
         
-        return solution;
+        return {solution, status};
     } catch (const std::exception& e) {
-        return std::string("Ошибка при решении задачи: ") + e.what();
+        return emit(std::string("Ошибка при решении задачи: ") + e.what(), SolveStatus::Error);
     }
 }
 
-} // namespace formula_teacher
+void FormulaInference::submit_batch(const std::string& task_text, InferenceSession& session,
+                                    const SolveRequest& request, std::function<void(SolveResult)> on_complete) const {
+    // Лучевой поиск и замороженная модель декодируют по одной задаче, а ошибки,
+    // символьные ответы и запросы, которые уже не нужно решать, обрабатывает solve
+    SolveResult symbolic_result;
+    if (!request.force_model && solve_symbolically(task_text, symbolic_result)) {
+        if (request.on_fragment && !symbolic_result.text.empty()) {
+            request.on_fragment(symbolic_result.text);
+        }
+        on_complete(std::move(symbolic_result));
+        return;
+    }
+    
+    auto current = current_generation();
+    if (!current || !current->model || !current->vocabulary_loaded() || current->scripted_model ||
+        generation_options.beam_width > 1 || request.limits.should_stop()) {
+        on_complete(solve(task_text, session, request));
+        return;
+    }
+    
+    auto task = std::make_shared<BatchTask>();
+    task->generation = current;
+    task->max_length = generation_options.max_length;
+    task->limits = request.limits;
+    task->on_fragment = request.on_fragment;
+    task->on_complete = std::move(on_complete);
+    
+    // Текст, целиком выдаваемый одним фрагментом (кэш, ошибки)
+    auto emit = [](BatchTask& task, const std::string& text, SolveStatus status) {
+        if (task.on_fragment && !text.empty()) {
+            task.on_fragment(text);
+        }
+        task.on_complete({text, status});
+    };
+    
+    try {
+        const auto& tokenizer = *current->tokenizer;
+        task->input_tokens.push_back(FormulaTokenizer::SOS);
+        tokenizer.tokenize(task_text, task->input_tokens);
+        task->input_tokens.push_back(FormulaTokenizer::EOS);
+        
+        task->solution_key.model_digest = current->model_digest;
+        task->solution_key.vocabulary_digest = current->vocabulary_digest;
+        task->solution_key.options_digest = options_digest(generation_options);
+        task->solution_key.input_tokens = &task->input_tokens;
+        
+        std::string solution;
+        if (solution_cache && solution_cache->lookup(task->solution_key, solution)) {
+            emit(*task, solution, SolveStatus::Completed);
+            return;
+        }
+        
+        BatchSequence sequence;
+        sequence.input_tokens = task->input_tokens;
+        sequence.max_length = task->max_length;
+        sequence.limits = task->limits;
+        sequence.constrain_formulas = generation_options.constrain_formulas;
+        sequence.max_formulas = generation_options.max_formulas;
+        
+        // Токены превращаются в текст по мере шагов батча
+        if (task->on_fragment) {
+            task->detokenizer = std::make_unique<StreamingDetokenizer>(tokenizer);
+            sequence.on_token = [task](int token) {
+                auto fragment = task->detokenizer->push(token);
+                if (!fragment.empty()) {
+                    task->on_fragment(fragment);
+                }
+            };
+        }
+        
+        sequence.on_finish = [this, task](std::vector<int> output_tokens) {
+            if (task->detokenizer) {
+                auto tail = task->detokenizer->finish();
+                if (!tail.empty()) {
+                    task->on_fragment(tail);
+                }
+            }
+            
+            SolveStatus status = stop_status(output_tokens, task->max_length, task->limits);
+            std::string solution = task->generation->tokenizer->detokenize(output_tokens);
+            
+            // Прерванный ответ зависит от нагрузки, а не только от входа - в кэш не попадает
+            if (solution_cache && (status == SolveStatus::Completed || status == SolveStatus::MaxLength)) {
+                solution_cache->insert(task->solution_key, solution);
+            }
+            task->on_complete({std::move(solution), status});
+        };
+        
+        sequence.on_error = [task, emit](const std::exception& e) {
+            emit(*task, std::string("Ошибка при решении задачи: ") + e.what(), SolveStatus::Error);
+        };
+        
+        // Новое поколение модели открывает новый батч, прежний дорешивает свои задачи
+        auto& batches = session.batches;
+        if (batches.empty() || batches.back().generation->id != current->id) {
+            batches.push_back({current, std::make_unique<BatchScheduler>(current->model)});
+        }
+        batches.back().scheduler->add(std::move(sequence));
+    } catch (const std::exception& e) {
+        emit(*task, std::string("Ошибка при решении задачи: ") + e.what(), SolveStatus::Error);
+    }
+}
 
-// C API реализация
-extern "C" {
+bool FormulaInference::step_batch(InferenceSession& session) const {
+    auto& batches = session.batches;
+    
+    // Обработчики завершения могут ставить новые задачи, поэтому проход по номерам
+    for (size_t i = 0; i < batches.size(); ++i) {
+        batches[i].scheduler->step();
+    }
+    
+    // Опустевшие батчи прежних поколений отпускают их веса. Батч текущего поколения
+    // остается, чтобы не выделять тензоры слотов заново на следующей задаче
+    uint64_t current_id = generation_id();
+    batches.erase(std::remove_if(batches.begin(), batches.end(),
+                                 [&](const SessionBatch& batch) {
+                                     return batch.scheduler->empty() && batch.generation->id != current_id;
+                                 }),
+                  batches.end());
+    
+    return batch_size(session) > 0;
+}
 
-bool load_model_from_file(const char* path) {
-    return formula_teacher::g_inference.load_model(path);
+size_t FormulaInference::batch_size(const InferenceSession& session) const {
+    size_t size = 0;
+    for (const auto& batch : session.batches) {
+        size += batch.scheduler->size();
+    }
+    return size;
 }
 
-bool load_vocabulary_from_file(const char* path) {
-    return formula_teacher::g_inference.load_vocabulary(path);
+const char* solve_status_name(SolveStatus status) {
+    switch (status) {
+        case SolveStatus::Completed: return "completed";
+        case SolveStatus::MaxLength: return "max_length";
+        case SolveStatus::DeadlineExceeded: return "deadline_exceeded";
+        case SolveStatus::Cancelled: return "cancelled";
+        case SolveStatus::Error: return "error";
+    }
+    return "unknown";
 }
 
-char* process_task_with_model(const char* task_text, void*) {
-    std::string result = formula_teacher::g_inference.solve_task(task_text);
+bool FormulaInference::solve_symbolically(const std::string& task_text, SolveResult& result) const {
+    if (!symbolic_enabled) {
+        return false;
+    }
     
-    // Необходимо выделить память для строки, которую можно будет освободить в Vala
-    char* c_result = (char*)malloc(result.length() + 1);
-    strcpy(c_result, result.c_str());
+    auto answer = solve_symbolic(task_text);
+    if (!answer.solved || answer.confidence < symbolic_min_confidence) {
+        return false;
+    }
     
-    return c_result;
+    result.text = std::move(answer.text);
+    result.status = SolveStatus::Completed;
+    result.symbolic = true;
+    result.confidence = answer.confidence;
+    return true;
 }
 
+std::vector<std::string> FormulaInference::solve_batch(const std::vector<std::string>& task_texts,
+                                                       int max_batch_size) const {
+    std::vector<std::string> solutions(task_texts.size());
+    
+    // Задачи идут через непрерывный батч, как у submit_batch: символьный решатель, кэш решений
+    // и грамматика работают так же, а ошибка приходит только задачам своего шага
+    InferenceSession session;
+    size_t limit = static_cast<size_t>(std::max(1, max_batch_size));
+    size_t next = 0;
+    while (next < task_texts.size() || batch_size(session) > 0) {
+        // Новые задачи занимают слоты, освободившиеся на прошлом шаге
+        while (next < task_texts.size() && batch_size(session) < limit) {
+            size_t index = next++;
+            submit_batch(task_texts[index], session, SolveRequest(), [&solutions, index](SolveResult result) {
+                solutions[index] = std::move(result.text);
+            });
+        }
+        step_batch(session);
+    }
+    
+    return solutions;
 }
+
+} // namespace formula_teacher
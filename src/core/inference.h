@@ -1,40 +1,271 @@
 #pragma once
 
+#include "batch_scheduler.h"
+#include "encoder_cache.h"
 #include "model.h"
+#include "request_control.h"
+#include "scripted_model.h"
+#include "solution_cache.h"
+#include "symbolic.h"
 #include "tokenizer.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace formula_teacher {
 
+// Обработчик очередного фрагмента решения при потоковой выдаче
+using FragmentCallback = std::function<void(const std::string&)>;
+
+// Чем закончилось решение задачи. Значения входят в C API, порядок не менять
+enum class SolveStatus {
+    // Ответ дописан до токена конца последовательности
+    Completed = 0,
+    // Ответ обрезан по GenerationOptions::max_length
+    MaxLength = 1,
+    // Истек срок запроса, текст - уже сгенерированная часть
+    DeadlineExceeded = 2,
+    // Запрос отменен, текст - уже сгенерированная часть
+    Cancelled = 3,
+    // Ошибка, текст - сообщение об ошибке
+    Error = 4
+};
+
+// Название статуса для логов
+const char* solve_status_name(SolveStatus status);
+
+// Параметры одного запроса на решение
+struct SolveRequest {
+    // Потоковая выдача фрагментов, может быть пустым
+    FragmentCallback on_fragment;
+    
+    // Срок и отмена, проверяются между шагами декодера
+    RequestLimits limits;
+    
+    // Класс в очереди движка (см. FormulaEngine), сам solve его не учитывает
+    RequestPriority priority = RequestPriority::Normal;
+    
+    // Решать моделью, даже если задачу берет символьный решатель
+    bool force_model = false;
+};
+
+// Результат решения: текст (возможно, частичный) и статус
+struct SolveResult {
+    std::string text;
+    SolveStatus status = SolveStatus::Completed;
+    
+    // Решено символьным решателем (см. solve_symbolic) и его уверенность
+    bool symbolic = false;
+    double confidence = 0.0;
+};
+
+struct ModelGeneration;
+
+// Непрерывный батч одного поколения модели
+struct SessionBatch {
+    std::shared_ptr<const ModelGeneration> generation;
+    std::unique_ptr<BatchScheduler> scheduler;
+};
+
+// Рабочие данные одного потока-исполнителя. Сессия не разделяется между потоками,
+// поэтому её буферы переиспользуются между запросами без блокировок
+struct InferenceSession {
+    std::vector<int> input_tokens;
+    std::vector<int> output_tokens;
+    
+    // Буферы декодера и поколение модели, для которого они созданы (см. FormulaInference::prepare_session)
+    DecoderWorkspace workspace;
+    uint64_t generation = 0;
+    
+    // Непрерывные батчи (см. FormulaInference::submit_batch): последний - для текущего
+    // поколения модели, прежние дорешивают начатые задачи на своих весах
+    std::vector<SessionBatch> batches;
+};
+
+// Поколение модели: веса, словарь и все, что от них зависит. После публикации поколение
+// не меняется: загрузка собирает новое рядом и подменяет текущее атомарно. Запрос держит
+// свое поколение до конца, поэтому прежние веса освобождаются с последним таким запросом
+struct ModelGeneration {
+    // Номер поколения, растет с каждой загрузкой. Часть ключа кэша энкодера
+    uint64_t id = 0;
+    
+    std::shared_ptr<FormulaModel> model;
+    
+    // Замороженная TorchScript-модель, если загружена вместо обычной
+    std::shared_ptr<ScriptedFormulaModel> scripted_model;
+    
+    std::shared_ptr<const FormulaTokenizer> tokenizer;
+    
+    // Отчет о квантовании (пустой для fp32 модели)
+    QuantizationReport quantization_report;
+    
+    // Хэши файлов модели и словаря - часть ключа кэша решений
+    uint64_t model_digest = 0;
+    uint64_t vocabulary_digest = 0;
+    
+    bool model_loaded() const { return model || scripted_model; }
+    bool vocabulary_loaded() const { return tokenizer != nullptr; }
+};
+
 class FormulaInference {
 public:
     // Конструктор
     FormulaInference();
     
-    // Загрузка модели из файла
-    bool load_model(const std::string& model_path);
+    // Загрузка модели из файла. При quantize_int8 линейные слои и LSTM
+    // переводятся в int8, отчет о расхождении с fp32 выводится в лог.
+    // Пакет модели (см. BundleFile) отображается в память и сразу загружает словарь.
+    // Все загрузки собирают новое поколение модели и публикуют его атомарно: выполняющиеся
+    // запросы дорешиваются на прежнем, при ошибке загрузки прежнее остается текущим
+    bool load_model(const std::string& model_path, bool quantize_int8 = false);
+    
+    // Загрузка модели вместе со словарем одним поколением, без промежуточного
+    // поколения с новой моделью и старым словарем. vocab_path может быть пустым
+    bool load(const std::string& model_path, const std::string& vocab_path, bool quantize_int8 = false);
+    
+    // Подключение списка кандидатов выходной проекции (файл .shortlist от обучения).
+    // load_model подключает model_path + ".shortlist" сам, если такой файл есть
+    bool load_shortlist(const std::string& shortlist_path);
+    
+    // Загрузка замороженной TorchScript-модели (см. ScriptedFormulaModel).
+    // Такая модель декодирует только жадно, кэш энкодера для нее не используется
+    bool load_scripted_model(const std::string& model_path);
+    
+    // Отчет о квантовании текущей модели
+    QuantizationReport get_quantization_report() const;
+    
+    // Текущее поколение модели, может быть nullptr до первой загрузки
+    std::shared_ptr<const ModelGeneration> current_generation() const { return std::atomic_load(&generation); }
+    
+    // Номер текущего поколения, 0 - модель не загружена
+    uint64_t generation_id() const;
     
     // Загрузка словаря из файла
     bool load_vocabulary(const std::string& vocab_path);
     
+    // Общие веса: последующие load_model публикуют веса модели .pt в разделяемой памяти
+    // (см. BundleFile::publish_shared) или подключаются к уже опубликованным другим
+    // процессом с тем же файлом модели. Пакет модели и так делится через page cache
+    void set_shared_weights(bool enabled) { shared_weights = enabled; }
+    
+    // Параметры генерации (жадный или лучевой поиск, длина ответа)
+    void set_generation_options(const GenerationOptions& options) { generation_options = options; }
+    const GenerationOptions& get_generation_options() const { return generation_options; }
+    
+    // Символьный решатель перед моделью: задачи, которые он распознал с уверенностью
+    // не ниже min_confidence, решаются без модели (см. solve_symbolic). Включен по умолчанию
+    void set_symbolic_solver(bool enabled, double min_confidence = 0.8) {
+        symbolic_enabled = enabled;
+        symbolic_min_confidence = min_confidence;
+    }
+    
+    // Включение LRU-кэша выходов энкодера с ограничением объема в байтах, 0 - выключить
+    void set_encoder_cache_size(size_t max_bytes);
+    
+    // Статистика кэша энкодера (нули, если кэш выключен)
+    EncoderCache::Stats get_encoder_cache_stats() const;
+    
+    // Подключение постоянного кэша готовых решений в файле path.
+    // capacity_bytes - размер создаваемого файла
+    bool open_solution_cache(const std::string& path, size_t capacity_bytes = 64 << 20);
+    
+    // Буферы декодера сессии под текущее поколение и прогревочный проход, чтобы
+    // первый запрос не платил за выделение памяти. Без этого вызова solve создает
+    // буферы сам при первом запросе сессии после смены поколения. Буферы прежнего
+    // поколения держат его веса, поэтому простаивающие сессии стоит обновлять
+    void prepare_session(InferenceSession& session) const;
+    
     // Решение задачи
-    std::string solve_task(const std::string& task_text);
+    std::string solve_task(const std::string& task_text) const;
+    
+    // Решение задачи с буферами сессии. После загрузки модели и словаря
+    // метод можно вызывать одновременно из нескольких потоков с разными сессиями
+    std::string solve_task(const std::string& task_text, InferenceSession& session) const;
+    
+    // Решение задачи с потоковой выдачей: on_fragment получает очередной кусок текста,
+    // как только декодер выдал соответствующие токены. Формула приходит одним фрагментом.
+    // Склейка фрагментов совпадает с возвращаемым решением. Ответ из кэша решений
+    // приходит одним фрагментом, сообщение об ошибке - отдельным последним фрагментом
+    std::string solve_task(const std::string& task_text, InferenceSession& session,
+                           const FragmentCallback& on_fragment) const;
+    
+    // Решение задачи с ограничениями запроса. Срок и отмена проверяются между шагами
+    // декодера: по их срабатыванию возвращается уже сгенерированная часть ответа.
+    // Прерванные ответы не попадают в кэш решений. Символьные ответы не требуют
+    // загруженной модели и в кэш решений не попадают (SolveRequest::force_model - без них)
+    SolveResult solve(const std::string& task_text, InferenceSession& session,
+                      const SolveRequest& request) const;
+    
+    // Постановка задачи в непрерывный батч сессии (см. BatchScheduler): решение придет
+    // в on_complete из step_batch того же потока, фрагменты - по мере шагов. Ответы из кэша
+    // решений, символьные ответы, ошибки, запросы, отмененные или просроченные до начала, и задачи,
+    // которые батч не декодирует (лучевой поиск, замороженная модель), решаются сразу через solve,
+    // и on_complete вызывается до возврата. Кэш энкодера и список кандидатов батч не использует
+    void submit_batch(const std::string& task_text, InferenceSession& session, const SolveRequest& request,
+                      std::function<void(SolveResult)> on_complete) const;
+    
+    // Один шаг всех непрерывных батчей сессии. false, если в них не осталось задач
+    bool step_batch(InferenceSession& session) const;
+    
+    // Задач в непрерывных батчах сессии, включая ожидающие присоединения
+    size_t batch_size(const InferenceSession& session) const;
+    
+    // Решение набора задач непрерывным батчом (см. submit_batch) не больше чем по max_batch_size
+    // задач сразу. Ответы совпадают с solve при тех же параметрах, кроме списка кандидатов
+    // и кэша энкодера, которые батч не использует. Лучевой поиск и замороженная модель
+    // решают задачи по одной
+    std::vector<std::string> solve_batch(const std::vector<std::string>& task_texts,
+                                         int max_batch_size = 64) const;
     
 private:
-    // Указатели на модель и токенизатор
-    std::shared_ptr<FormulaModel> model;
-    std::unique_ptr<FormulaTokenizer> tokenizer;
+    // Сборка частей нового поколения. Бросают исключения при ошибке
+    void build_model(ModelGeneration& next, const std::string& model_path, bool quantize_int8) const;
+    void build_vocabulary(ModelGeneration& next, const std::string& vocab_path) const;
+    void build_shortlist(ModelGeneration& next, const std::string& shortlist_path) const;
+    
+    // Грамматика формул по словарю поколения для его модели (см. GenerationOptions::constrain_formulas)
+    void build_grammar(ModelGeneration& next) const;
+    
+    // Ответ символьного решателя, false - задача остается модели
+    bool solve_symbolically(const std::string& task_text, SolveResult& result) const;
+    
+    // Копия текущего поколения как основа для следующего
+    std::shared_ptr<ModelGeneration> next_generation() const;
+    
+    // Атомарная подмена текущего поколения
+    void publish(std::shared_ptr<ModelGeneration> next);
+    
+    // Буферы сессии под поколение current, при warm_up - с прогревом
+    void bind_session(InferenceSession& session, const ModelGeneration& current, bool warm_up) const;
+    
+    // Текущее поколение, читается и подменяется через std::atomic_load / std::atomic_store
+    std::shared_ptr<const ModelGeneration> generation;
     
-    // Флаги для отслеживания состояния
-    bool model_loaded;
-    bool vocabulary_loaded;
+    // Загрузки выполняются по одной, чтобы не потерять изменения друг друга
+    std::mutex load_mutex;
+    uint64_t last_generation_id = 0;
+    
+    // Параметры генерации
+    GenerationOptions generation_options;
+    
+    // Веса моделей .pt в разделяемой памяти
+    bool shared_weights = false;
+    
+    // Символьный решатель и порог его уверенности
+    bool symbolic_enabled = true;
+    double symbolic_min_confidence = 0.8;
+    
+    // Кэш выходов энкодера, может отсутствовать
+    std::unique_ptr<EncoderCache> encoder_cache;
+    
+    // Постоянный кэш решений, может отсутствовать
+    std::unique_ptr<SolutionCache> solution_cache;
+    
+    // Вместимость буферов декодера сессии по длине входа в токенах
+    static constexpr int WORKSPACE_INPUT_LENGTH = 256;
 };
 
-// C API для использования в Vala
-extern "C" {
-    bool load_model_from_file(const char* path);
-    bool load_vocabulary_from_file(const char* path);
-    char* process_task_with_model(const char* task_text, void* model_ptr);
-}
-
 } // namespace formula_teacher
@@ -1,24 +1,158 @@
 #include "model.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
 
 namespace formula_teacher {
 
+DecoderState DecoderState::index_select(const torch::Tensor& rows) const {
+    DecoderState selected;
+    selected.encoder_output = encoder_output.index_select(0, rows);
+    selected.keys = keys.index_select(0, rows);
+    if (mask.defined()) {
+        selected.mask = mask.index_select(0, rows);
+    }
+    selected.h = h.index_select(1, rows);
+    selected.c = c.index_select(1, rows);
+    
+    // Кандидаты общие для всех строк
+    selected.shortlist = shortlist;
+    selected.shortlist_weight = shortlist_weight;
+    selected.shortlist_bias = shortlist_bias;
+    return selected;
+}
+
+torch::Tensor grammar_mask(const FormulaGrammar& grammar, const std::vector<const GrammarState*>& states,
+                           const std::vector<int>& remaining, int max_formulas) {
+    const auto& tables = grammar.tables();
+    int64_t rows = static_cast<int64_t>(states.size());
+    int64_t vocab = grammar.vocab_size();
+    
+    // Признаки строк [B, 1]: вид скобки на вершине, сколько их подряд, глубина,
+    // вложенность с формулой и ее предел после шага
+    auto constrained = torch::zeros({rows, 1}, torch::kBool);
+    auto complete = torch::zeros({rows, 1}, torch::kBool);
+    auto in_formula = torch::zeros({rows, 1}, torch::kBool);
+    auto top_kind = torch::full({rows, 1}, -1, torch::kInt);
+    auto top_run = torch::zeros({rows, 1}, torch::kInt);
+    auto depth = torch::zeros({rows, 1}, torch::kInt);
+    auto levels = torch::zeros({rows, 1}, torch::kInt);
+    auto limit = torch::zeros({rows, 1}, torch::kInt);
+    
+    auto constrained_access = constrained.accessor<bool, 2>();
+    auto complete_access = complete.accessor<bool, 2>();
+    auto in_formula_access = in_formula.accessor<bool, 2>();
+    auto top_kind_access = top_kind.accessor<int32_t, 2>();
+    auto top_run_access = top_run.accessor<int32_t, 2>();
+    auto depth_access = depth.accessor<int32_t, 2>();
+    auto levels_access = levels.accessor<int32_t, 2>();
+    auto limit_access = limit.accessor<int32_t, 2>();
+    for (int64_t row = 0; row < rows; ++row) {
+        const GrammarState* state = states[static_cast<size_t>(row)];
+        if (!state) {
+            continue;
+        }
+        constrained_access[row][0] = true;
+        complete_access[row][0] = FormulaGrammar::complete(*state, max_formulas);
+        in_formula_access[row][0] = state->in_formula;
+        top_kind_access[row][0] = FormulaGrammar::top_kind(*state);
+        top_run_access[row][0] = FormulaGrammar::top_run(*state);
+        depth_access[row][0] = static_cast<int32_t>(state->stack.size());
+        levels_access[row][0] = static_cast<int32_t>(state->stack.size()) + (state->in_formula ? 1 : 0);
+        limit_access[row][0] = FormulaGrammar::depth_limit(remaining[static_cast<size_t>(row)]);
+    }
+    
+    // Свойства токенов [1, V] прямо поверх таблиц грамматики, без копирования
+    auto column = [&](const auto& table, torch::ScalarType type) {
+        return torch::from_blob(const_cast<void*>(static_cast<const void*>(table.data())), {1, vocab}, type);
+    };
+    auto text_allowed = column(tables.text_allowed, torch::kBool);
+    auto formula_allowed = column(tables.formula_allowed, torch::kBool);
+    auto closes_formula = column(tables.closes_formula, torch::kBool);
+    auto close_kind = column(tables.close_kind, torch::kInt);
+    auto close_count = column(tables.close_count, torch::kInt);
+    auto depth_change = column(tables.depth_change, torch::kInt);
+    
+    // Одни и те же операции над [B, V] для всех строк сразу
+    auto closes_match = (close_count == 0) | ((close_kind == top_kind) & (close_count <= top_run));
+    auto formula_ok = formula_allowed & closes_match & (closes_formula.logical_not() | (depth == 0));
+    auto allowed = torch::where(in_formula, formula_ok, text_allowed);
+    allowed = allowed & ((depth_change <= 0) | (levels + depth_change <= limit));
+    
+    auto eos_only = torch::arange(vocab, torch::kLong).unsqueeze(0) == static_cast<int64_t>(FormulaTokenizer::EOS);
+    allowed = torch::where(complete, eos_only, allowed);
+    
+    return allowed | constrained.logical_not() | allowed.any(1, true).logical_not();
+}
+
 FormulaEncoder::FormulaEncoder(int vocab_size, int embedding_dim, int hidden_dim) {
     embedding = register_module("embedding", torch::nn::Embedding(vocab_size, embedding_dim));
-    lstm = register_module("lstm", torch::nn::LSTM(torch::nn::LSTMOptions(embedding_dim, hidden_dim).bidirectional(true)));
+    lstm = register_module("lstm", torch::nn::LSTM(torch::nn::LSTMOptions(embedding_dim, hidden_dim).bidirectional(true).batch_first(true)));
     fc = register_module("fc", torch::nn::Linear(hidden_dim * 2, hidden_dim));
 }
 
 torch::Tensor FormulaEncoder::forward(torch::Tensor x) {
+    if (use_quantized) {
+        return quantized_forward(x, torch::Tensor());
+    }
+    
     auto embedded = embedding(x);
     auto lstm_output = lstm(embedded);
     auto output = std::get<0>(lstm_output);
     return fc(output);
 }
 
-FormulaDecoder::FormulaDecoder(int vocab_size, int embedding_dim, int hidden_dim) {
+torch::Tensor FormulaEncoder::forward(torch::Tensor x, torch::Tensor lengths) {
+    if (use_quantized) {
+        return quantized_forward(x, lengths);
+    }
+    
+    auto embedded = embedding(x);
+    
+    // Упаковываем батч, чтобы обратный проход LSTM не читал PAD-токены
+    auto packed = torch::nn::utils::rnn::pack_padded_sequence(embedded, lengths, true, false);
+    auto lstm_output = lstm->forward_with_packed_input(packed);
+    auto padded = torch::nn::utils::rnn::pad_packed_sequence(std::get<0>(lstm_output), true, 0.0, x.size(1));
+    
+    return fc(std::get<0>(padded));
+}
+
+torch::Tensor FormulaEncoder::quantized_forward(torch::Tensor x, torch::Tensor lengths) {
+    auto embedded = embedding(x);
+    
+    // Двунаправленный LSTM: выходы прямого и обратного направлений склеиваются, как в torch::nn::LSTM
+    auto forward_output = quantized->forward_lstm.run(embedded, lengths, false);
+    auto backward_output = quantized->backward_lstm.run(embedded, lengths, true);
+    
+    return quantized->fc.forward(torch::cat({forward_output, backward_output}, 2));
+}
+
+QuantizationReport FormulaEncoder::quantize() {
+    auto params = lstm->named_parameters();
+    
+    auto weights = std::make_shared<QuantizedWeights>();
+    weights->forward_lstm = QuantizedLSTMDirection(params["weight_ih_l0"], params["weight_hh_l0"],
+                                                   params["bias_ih_l0"], params["bias_hh_l0"]);
+    weights->backward_lstm = QuantizedLSTMDirection(params["weight_ih_l0_reverse"], params["weight_hh_l0_reverse"],
+                                                    params["bias_ih_l0_reverse"], params["bias_hh_l0_reverse"]);
+    weights->fc = QuantizedLinear(fc->weight, fc->bias);
+    
+    QuantizationReport report;
+    report.fp32_bytes = weights->forward_lstm.fp32_bytes() + weights->backward_lstm.fp32_bytes() + weights->fc.fp32_bytes();
+    report.int8_bytes = weights->forward_lstm.int8_bytes() + weights->backward_lstm.int8_bytes() + weights->fc.int8_bytes();
+    
+    quantized = weights;
+    use_quantized = true;
+    return report;
+}
+
+FormulaDecoder::FormulaDecoder(int vocab_size, int embedding_dim, int hidden_dim) : embedding_dim(embedding_dim) {
     embedding = register_module("embedding", torch::nn::Embedding(vocab_size, embedding_dim));
-    lstm = register_module("lstm", torch::nn::LSTM(torch::nn::LSTMOptions(embedding_dim + hidden_dim, hidden_dim)));
-    attn = register_module("attn", torch::nn::Linear(hidden_dim * 2, hidden_dim));
+    lstm = register_module("lstm", torch::nn::LSTM(torch::nn::LSTMOptions(embedding_dim + hidden_dim, hidden_dim).batch_first(true)));
+    // Вход внимания - конкатенация эмбеддинга токена и выхода энкодера
+    attn = register_module("attn", torch::nn::Linear(embedding_dim + hidden_dim, hidden_dim));
     fc = register_module("fc", torch::nn::Linear(hidden_dim, vocab_size));
 }
 
@@ -26,17 +160,14 @@ torch::Tensor FormulaDecoder::forward(torch::Tensor x, torch::Tensor encoder_out
     // Реализация механизма внимания
     auto embedded = embedding(x);
     
-    // Removed unused variable batch_size
-    auto seq_len = embedded.size(1);
-    auto enc_seq_len = encoder_output.size(1);
-    
-    // Расширение для применения внимания
-    auto extended_embedded = embedded.unsqueeze(2).repeat({1, 1, enc_seq_len, 1});
-    auto extended_encoder = encoder_output.unsqueeze(1).repeat({1, seq_len, 1, 1});
+    // attn([e; h]) = W_e e + W_h h + b: проекции токенов [B, T, H] и выхода энкодера [B, S, H]
+    // считаются отдельно и складываются с broadcast, без repeat и cat в [B, T, S, E + H]
+    auto query = attention_query(embedded);
+    auto keys = attention_keys(encoder_output);
     
     // Вычисление весов внимания
-    auto attention_input = torch::cat({extended_embedded, extended_encoder}, 3);
-    auto attention_weights = torch::softmax(attn(attention_input).squeeze(3), 2);
+    auto energy = torch::tanh(query.unsqueeze(2) + keys.unsqueeze(1));
+    auto attention_weights = torch::softmax(energy.sum(3), 2);
     
     // Применение внимания к выходу энкодера
     auto context = torch::bmm(attention_weights, encoder_output);
@@ -50,6 +181,230 @@ torch::Tensor FormulaDecoder::forward(torch::Tensor x, torch::Tensor encoder_out
     return fc(output);
 }
 
+torch::Tensor FormulaDecoder::attention_query(const torch::Tensor& embedded) {
+    if (use_quantized) {
+        return quantized->attn_query.forward(embedded);
+    }
+    return torch::nn::functional::linear(embedded, attn->weight.narrow(1, 0, embedding_dim));
+}
+
+torch::Tensor FormulaDecoder::attention_keys(const torch::Tensor& encoder_output) {
+    if (use_quantized) {
+        return quantized->attn_keys.forward(encoder_output);
+    }
+    auto encoder_weight = attn->weight.narrow(1, embedding_dim, attn->weight.size(1) - embedding_dim);
+    return torch::nn::functional::linear(encoder_output, encoder_weight, attn->bias);
+}
+
+DecoderState FormulaDecoder::init_state(torch::Tensor encoder_output, torch::Tensor mask) {
+    DecoderState state;
+    state.encoder_output = encoder_output;
+    state.mask = mask;
+    
+    // Часть attn, относящаяся к энкодеру, не зависит от шага - считаем её один раз
+    state.keys = attention_keys(encoder_output);
+    
+    auto hidden_dim = encoder_output.size(2);
+    state.h = torch::zeros({1, encoder_output.size(0), hidden_dim}, encoder_output.options());
+    state.c = torch::zeros_like(state.h);
+    
+    return state;
+}
+
+torch::Tensor FormulaDecoder::step(torch::Tensor x, DecoderState& state) {
+    auto embedded = embedding(x);
+    
+    // Часть attn, относящаяся к токену, складывается с заранее посчитанными ключами
+    auto query = attention_query(embedded);
+    auto energy = torch::tanh(state.keys + query.unsqueeze(1));
+    auto scores = energy.sum(2);
+    if (state.mask.defined()) {
+        // Дополненные позиции не получают внимания
+        scores = scores.masked_fill(state.mask, -std::numeric_limits<float>::infinity());
+    }
+    auto attention_weights = torch::softmax(scores, 1);
+    
+    // Контекст [B, H]
+    auto context = torch::bmm(attention_weights.unsqueeze(1), state.encoder_output).squeeze(1);
+    
+    auto rnn_input = torch::cat({embedded, context}, 1);
+    
+    torch::Tensor output;
+    if (use_quantized) {
+        auto next_state = quantized->lstm.cell(rnn_input, state.h.squeeze(0), state.c.squeeze(0));
+        output = std::get<0>(next_state);
+        state.h = output.unsqueeze(0);
+        state.c = std::get<1>(next_state).unsqueeze(0);
+    } else {
+        // LSTM продолжает с сохраненного состояния вместо нулевого
+        auto lstm_output = lstm(rnn_input.unsqueeze(1), std::make_tuple(state.h, state.c));
+        output = std::get<0>(lstm_output).squeeze(1);
+        std::tie(state.h, state.c) = std::get<1>(lstm_output);
+    }
+    
+    // Проекция только на строки кандидатов вместо всего словаря
+    if (state.shortlist.defined()) {
+        return torch::nn::functional::linear(output, state.shortlist_weight, state.shortlist_bias);
+    }
+    
+    return output_logits(output);
+}
+
+void FormulaDecoder::restrict_output(DecoderState& state, const torch::Tensor& candidates) {
+    state.shortlist = candidates;
+    state.shortlist_weight = fc->weight.index_select(0, candidates);
+    state.shortlist_bias = fc->bias.index_select(0, candidates);
+}
+
+torch::Tensor FormulaDecoder::output_logits(const torch::Tensor& hidden) {
+    if (use_quantized) {
+        return quantized->fc.forward(hidden);
+    }
+    return fc(hidden);
+}
+
+DecoderWorkspace FormulaDecoder::create_workspace(int64_t max_input_length) {
+    torch::NoGradGuard no_grad;
+    
+    auto params = lstm->named_parameters();
+    auto hidden_dim = attn->weight.size(0);
+    auto options = torch::TensorOptions().dtype(fc->weight.dtype()).device(fc->weight.device());
+    
+    DecoderWorkspace workspace;
+    workspace.max_input_length = std::max<int64_t>(1, max_input_length);
+    workspace.embedding_weight = embedding->weight;
+    workspace.query_weight = attn->weight.narrow(1, 0, embedding_dim).t();
+    workspace.weight_ih = params["weight_ih_l0"].t();
+    workspace.weight_hh = params["weight_hh_l0"].t();
+    workspace.lstm_bias = params["bias_ih_l0"] + params["bias_hh_l0"];
+    workspace.fc_weight = fc->weight.t();
+    workspace.fc_bias = fc->bias;
+    
+    workspace.token = torch::zeros({1}, torch::kLong);
+    
+    workspace.lstm_input = torch::zeros({1, embedding_dim + 2 * hidden_dim}, options);
+    workspace.embedded = workspace.lstm_input.narrow(1, 0, embedding_dim);
+    workspace.context = workspace.lstm_input.narrow(1, embedding_dim, hidden_dim);
+    workspace.x = workspace.lstm_input.narrow(1, 0, embedding_dim + hidden_dim);
+    workspace.h = workspace.lstm_input.narrow(1, embedding_dim + hidden_dim, hidden_dim);
+    workspace.c = torch::zeros({1, hidden_dim}, options);
+    
+    workspace.query = torch::zeros({1, hidden_dim}, options);
+    workspace.energy = torch::zeros({workspace.max_input_length, hidden_dim}, options);
+    workspace.scores = torch::zeros({workspace.max_input_length}, options);
+    workspace.attention = torch::zeros({workspace.max_input_length}, options);
+    
+    workspace.gates = torch::zeros({1, 4 * hidden_dim}, options);
+    workspace.gate_i = workspace.gates.narrow(1, 0, hidden_dim);
+    workspace.gate_f = workspace.gates.narrow(1, hidden_dim, hidden_dim);
+    workspace.gate_g = workspace.gates.narrow(1, 2 * hidden_dim, hidden_dim);
+    workspace.gate_o = workspace.gates.narrow(1, 3 * hidden_dim, hidden_dim);
+    
+    workspace.logits = torch::zeros({1, fc->weight.size(0)}, options);
+    return workspace;
+}
+
+bool FormulaDecoder::accepts(const DecoderWorkspace& workspace) const {
+    return workspace.defined() && workspace.fc_bias.is_same(fc->bias) &&
+           workspace.embedding_weight.is_same(embedding->weight);
+}
+
+void FormulaDecoder::bind_workspace(const DecoderState& state, DecoderWorkspace& workspace) {
+    auto input_length = state.encoder_output.size(1);
+    if (input_length > workspace.max_input_length) {
+        // Вход длиннее вместимости - расширяем буферы внимания, дальше они переиспользуются
+        auto options = workspace.energy.options();
+        workspace.max_input_length = input_length;
+        workspace.energy = torch::zeros({input_length, workspace.energy.size(1)}, options);
+        workspace.scores = torch::zeros({input_length}, options);
+        workspace.attention = torch::zeros({input_length}, options);
+    }
+    
+    workspace.h.copy_(state.h[0]);
+    workspace.c.copy_(state.c[0]);
+    
+    workspace.keys = state.keys[0];
+    workspace.encoder_output = state.encoder_output[0];
+    workspace.mask = state.mask.defined() ? state.mask[0] : torch::Tensor();
+    workspace.energy_view = workspace.energy.narrow(0, 0, input_length);
+    workspace.scores_view = workspace.scores.narrow(0, 0, input_length);
+    workspace.attention_view = workspace.attention.narrow(0, 0, input_length);
+    workspace.attention_row = workspace.attention_view.unsqueeze(0);
+    
+    if (state.shortlist.defined()) {
+        workspace.shortlist = state.shortlist.contiguous();
+        workspace.shortlist_weight = state.shortlist_weight.t();
+        workspace.shortlist_bias = state.shortlist_bias;
+        workspace.step_logits = workspace.logits.narrow(1, 0, state.shortlist.size(0));
+    } else {
+        workspace.shortlist = torch::Tensor();
+        workspace.shortlist_weight = torch::Tensor();
+        workspace.shortlist_bias = torch::Tensor();
+        workspace.step_logits = workspace.logits;
+    }
+}
+
+const torch::Tensor& FormulaDecoder::step(int64_t token, DecoderWorkspace& workspace) {
+    workspace.token.data_ptr<int64_t>()[0] = token;
+    torch::index_select_out(workspace.embedded, workspace.embedding_weight, 0, workspace.token);
+    
+    // Внимание, как в step(x, state), но каждая операция пишет в свой буфер
+    torch::mm_out(workspace.query, workspace.embedded, workspace.query_weight);
+    torch::add_out(workspace.energy_view, workspace.keys, workspace.query);
+    workspace.energy_view.tanh_();
+    torch::sum_out(workspace.scores_view, workspace.energy_view, torch::IntArrayRef{1});
+    if (workspace.mask.defined()) {
+        workspace.scores_view.masked_fill_(workspace.mask, -std::numeric_limits<float>::infinity());
+    }
+    torch::_softmax_out(workspace.attention_view, workspace.scores_view, 0, false);
+    torch::mm_out(workspace.context, workspace.attention_row, workspace.encoder_output);
+    
+    // Ячейка LSTM: гейты i, f, g, o считаются от входа и прежнего h, затем h и c обновляются на месте
+    torch::addmm_out(workspace.gates, workspace.lstm_bias, workspace.x, workspace.weight_ih);
+    workspace.gates.addmm_(workspace.h, workspace.weight_hh);
+    workspace.gate_i.sigmoid_();
+    workspace.gate_f.sigmoid_();
+    workspace.gate_g.tanh_();
+    workspace.gate_o.sigmoid_();
+    workspace.c.mul_(workspace.gate_f).addcmul_(workspace.gate_i, workspace.gate_g);
+    torch::tanh_out(workspace.h, workspace.c);
+    workspace.h.mul_(workspace.gate_o);
+    
+    if (workspace.shortlist.defined()) {
+        torch::addmm_out(workspace.step_logits, workspace.shortlist_bias, workspace.h, workspace.shortlist_weight);
+    } else {
+        torch::addmm_out(workspace.logits, workspace.fc_bias, workspace.h, workspace.fc_weight);
+    }
+    return workspace.step_logits;
+}
+
+const torch::Tensor& FormulaDecoder::output_logits(DecoderWorkspace& workspace) {
+    torch::addmm_out(workspace.logits, workspace.fc_bias, workspace.h, workspace.fc_weight);
+    return workspace.logits;
+}
+
+QuantizationReport FormulaDecoder::quantize() {
+    auto params = lstm->named_parameters();
+    auto hidden_dim = attn->weight.size(0);
+    
+    auto weights = std::make_shared<QuantizedWeights>();
+    weights->attn_query = QuantizedLinear(attn->weight.narrow(1, 0, embedding_dim), torch::Tensor());
+    weights->attn_keys = QuantizedLinear(attn->weight.narrow(1, embedding_dim, hidden_dim), attn->bias);
+    weights->lstm = QuantizedLSTMDirection(params["weight_ih_l0"], params["weight_hh_l0"],
+                                           params["bias_ih_l0"], params["bias_hh_l0"]);
+    weights->fc = QuantizedLinear(fc->weight, fc->bias);
+    
+    QuantizationReport report;
+    report.fp32_bytes = weights->attn_query.fp32_bytes() + weights->attn_keys.fp32_bytes() +
+                        weights->lstm.fp32_bytes() + weights->fc.fp32_bytes();
+    report.int8_bytes = weights->attn_query.int8_bytes() + weights->attn_keys.int8_bytes() +
+                        weights->lstm.int8_bytes() + weights->fc.int8_bytes();
+    
+    quantized = weights;
+    use_quantized = true;
+    return report;
+}
+
 FormulaModel::FormulaModel(int vocab_size, int embedding_dim, int hidden_dim) : 
     hidden_dim(hidden_dim), vocab_size(vocab_size) {
     encoder = register_module("encoder", std::make_shared<FormulaEncoder>(vocab_size, embedding_dim, hidden_dim));
@@ -66,47 +421,608 @@ torch::Tensor FormulaModel::forward(torch::Tensor input_seq) {
     return output;
 }
 
-std::vector<int> FormulaModel::generate(std::vector<int>& input_tokens, int max_length) {
+torch::Tensor FormulaModel::encode(torch::Tensor input_seq) {
+    return encoder->forward(input_seq);
+}
+
+torch::Tensor FormulaModel::encode(torch::Tensor input_seq, torch::Tensor lengths) {
+    return encoder->forward(input_seq, lengths);
+}
+
+DecoderState FormulaModel::start_decoding(torch::Tensor encoder_output, torch::Tensor mask) {
+    return decoder->init_state(encoder_output, mask);
+}
+
+torch::Tensor FormulaModel::decode_step(torch::Tensor tokens, DecoderState& state) {
+    return decoder->step(tokens, state);
+}
+
+std::vector<int> FormulaModel::generate(const std::vector<int>& input_tokens, int max_length) {
+    GenerationOptions options;
+    options.max_length = max_length;
+    return generate(input_tokens, options);
+}
+
+std::vector<int> FormulaModel::generate(const std::vector<int>& input_tokens, const GenerationOptions& options) {
+    // Энкодер и ключи внимания считаются один раз на весь запрос
+    return decode(prepare(input_tokens), options);
+}
+
+DecoderState FormulaModel::prepare(const std::vector<int>& input_tokens) {
+    torch::NoGradGuard no_grad;
+    
     // Конвертация входных токенов в тензор
-    auto input_tensor = torch::tensor(input_tokens).unsqueeze(0);
+    std::vector<int64_t> input_ids(input_tokens.begin(), input_tokens.end());
+    auto input_tensor = torch::tensor(input_ids, torch::kLong).unsqueeze(0);
+    
+    auto state = start_decoding(encode(input_tensor));
     
-    // Получаем выход энкодера
-    auto encoder_output = encoder->forward(input_tensor);
+    // Кандидаты имеют смысл, только если их заметно меньше словаря
+    auto current_shortlist = std::atomic_load(&shortlist);
+    if (current_shortlist) {
+        auto candidates = current_shortlist->candidates(input_tokens);
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [&](int64_t token) { return token >= vocab_size; }),
+                         candidates.end());
+        if (static_cast<int64_t>(candidates.size()) * 2 < vocab_size) {
+            decoder->restrict_output(state, torch::tensor(candidates, torch::kLong));
+        }
+    }
+    
+    return state;
+}
+
+torch::Tensor FormulaModel::full_logits(const DecoderState& state) {
+    return decoder->output_logits(state.h.squeeze(0));
+}
+
+std::shared_ptr<const FormulaGrammar> FormulaModel::active_grammar(const GenerationOptions& options) const {
+    if (!options.constrain_formulas) {
+        return nullptr;
+    }
+    
+    // Грамматика от словаря другого размера не соответствует логитам
+    auto grammar = get_grammar();
+    return grammar && grammar->vocab_size() == vocab_size ? grammar : nullptr;
+}
+
+std::vector<int> FormulaModel::decode(DecoderState state, const GenerationOptions& options,
+                                     const TokenCallback& on_token, const RequestLimits* limits) {
+    // При генерации градиенты не нужны
+    torch::NoGradGuard no_grad;
+    
+    if (options.beam_width > 1) {
+        // Лучшая гипотеза известна только в конце поиска
+        auto tokens = beam_search(std::move(state), options, limits);
+        if (on_token) {
+            for (int token : tokens) {
+                on_token(token);
+            }
+        }
+        return tokens;
+    }
     
     std::vector<int> output_tokens;
     
+    auto grammar = active_grammar(options);
+    GrammarState grammar_state;
+    const float excluded = -std::numeric_limits<float>::infinity();
+    
     // Первый токен - специальный токен начала последовательности
-    auto decoder_input = torch::full({1, 1}, 1, input_tensor.options());
+    auto decoder_input = torch::full({1}, static_cast<int64_t>(FormulaTokenizer::SOS), torch::kLong);
     
-    // Генерация токенов один за другим
-    for (int i = 0; i < max_length; i++) {
-        auto output = decoder->forward(decoder_input, encoder_output);
+    // Генерация токенов один за другим, каждый шаг обрабатывает только новый токен
+    for (int i = 0; i < options.max_length; i++) {
+        if (limits && limits->step_boundary()) {
+            break;
+        }
+        
+        // Структура ответа закончена - конец последовательности без шага декодера
+        if (grammar && FormulaGrammar::complete(grammar_state, options.max_formulas)) {
+            output_tokens.push_back(FormulaTokenizer::EOS);
+            if (on_token) {
+                on_token(FormulaTokenizer::EOS);
+            }
+            break;
+        }
+        
+        auto logits = decode_step(decoder_input, state);
+        
+        // Недопустимые грамматикой токены исключаются из выбора
+        torch::Tensor allowed;
+        if (grammar) {
+            allowed = grammar_mask(*grammar, {&grammar_state}, {options.max_length - i - 1}, options.max_formulas);
+        }
         
         // Получаем токен с наивысшей вероятностью
-        auto top_token = output.argmax(2).item().toInt();
-        output_tokens.push_back(top_token);
+        int64_t top_token;
+        if (state.shortlist.defined()) {
+            bool candidates_allowed = true;
+            if (allowed.defined()) {
+                auto candidate_mask = allowed.index_select(1, state.shortlist);
+                candidates_allowed = candidate_mask.any().item<bool>();
+                logits.masked_fill_(candidate_mask.logical_not(), excluded);
+            }
+            auto best = torch::softmax(logits, 1).max(1);
+            if (candidates_allowed && std::get<0>(best).item<float>() >= options.shortlist_min_confidence) {
+                top_token = state.shortlist[std::get<1>(best).item<int64_t>()].item<int64_t>();
+            } else {
+                // Кандидаты не уверены - пересчитываем этот шаг по всему словарю
+                auto full = full_logits(state);
+                if (allowed.defined()) {
+                    full.masked_fill_(allowed.logical_not(), excluded);
+                }
+                top_token = full.argmax(1).item<int64_t>();
+            }
+        } else {
+            if (allowed.defined()) {
+                logits.masked_fill_(allowed.logical_not(), excluded);
+            }
+            top_token = logits.argmax(1).item<int64_t>();
+        }
+        output_tokens.push_back(static_cast<int>(top_token));
+        if (on_token) {
+            on_token(static_cast<int>(top_token));
+        }
+        if (grammar) {
+            grammar->advance(grammar_state, static_cast<int>(top_token));
+        }
         
         // Проверка на токен конца последовательности
-        if (top_token == 2) {
+        if (top_token == FormulaTokenizer::EOS) {
             break;
         }
         
         // Обновляем входные данные декодера
-        decoder_input[0][0] = top_token;
+        decoder_input.fill_(top_token);
     }
     
     return output_tokens;
 }
 
+void FormulaModel::decode(const DecoderState& state, const GenerationOptions& options, DecoderWorkspace& workspace,
+                          std::vector<int>& output_tokens, const TokenCallback& on_token, const RequestLimits* limits) {
+    output_tokens.clear();
+    
+    // Буферы рассчитаны на жадный поиск одной последовательности на fp32 весах
+    if (options.beam_width > 1 || state.encoder_output.size(0) != 1 || !decoder->accepts(workspace) ||
+        decoder->quantized_enabled()) {
+        auto tokens = decode(state, options, on_token, limits);
+        output_tokens.assign(tokens.begin(), tokens.end());
+        return;
+    }
+    
+    torch::NoGradGuard no_grad;
+    decoder->bind_workspace(state, workspace);
+    const int64_t* shortlist = workspace.shortlist.defined() ? workspace.shortlist.data_ptr<int64_t>() : nullptr;
+    
+    auto grammar = active_grammar(options);
+    GrammarState grammar_state;
+    
+    int64_t token = FormulaTokenizer::SOS;
+    for (int i = 0; i < options.max_length; i++) {
+        if (limits && limits->step_boundary()) {
+            break;
+        }
+        
+        // Структура ответа закончена - конец последовательности без шага декодера
+        if (grammar && FormulaGrammar::complete(grammar_state, options.max_formulas)) {
+            output_tokens.push_back(FormulaTokenizer::EOS);
+            if (on_token) {
+                on_token(FormulaTokenizer::EOS);
+            }
+            break;
+        }
+        
+        // Допустим ли индекс логита k (ids переводит его в токен словаря)
+        int remaining = options.max_length - i - 1;
+        auto allowed = [&](int64_t k, const int64_t* ids) {
+            return !grammar || grammar->allows(grammar_state, static_cast<int>(ids ? ids[k] : k), remaining);
+        };
+        
+        // Лучший допустимый индекс, -1 - допустимых нет
+        auto best_allowed = [&](const float* scores, int64_t size, const int64_t* ids) -> int64_t {
+            if (!grammar) {
+                return std::max_element(scores, scores + size) - scores;
+            }
+            int64_t best = -1;
+            for (int64_t k = 0; k < size; ++k) {
+                if (allowed(k, ids) && (best < 0 || scores[k] > scores[best])) {
+                    best = k;
+                }
+            }
+            return best;
+        };
+        
+        // Токен выбирается прямо по буферу логитов, без промежуточных тензоров
+        const auto& logits = decoder->step(token, workspace);
+        const float* values = logits.data_ptr<float>();
+        int64_t count = logits.size(1);
+        int64_t best = best_allowed(values, count, shortlist);
+        
+        if (shortlist) {
+            // Вероятность лучшего кандидата после softmax по допустимым: 1 / sum(exp(l - max))
+            double total = 0.0;
+            for (int64_t k = 0; best >= 0 && k < count; ++k) {
+                if (allowed(k, shortlist)) {
+                    total += std::exp(static_cast<double>(values[k]) - values[best]);
+                }
+            }
+            if (best >= 0 && 1.0 / total >= options.shortlist_min_confidence) {
+                token = shortlist[best];
+            } else {
+                // Кандидаты не уверены - пересчитываем этот шаг по всему словарю
+                const auto& full = decoder->output_logits(workspace);
+                const float* full_values = full.data_ptr<float>();
+                int64_t full_size = full.size(1);
+                token = best_allowed(full_values, full_size, nullptr);
+                if (token < 0) {
+                    token = std::max_element(full_values, full_values + full_size) - full_values;
+                }
+            }
+        } else {
+            token = best >= 0 ? best : std::max_element(values, values + count) - values;
+        }
+        
+        output_tokens.push_back(static_cast<int>(token));
+        if (on_token) {
+            on_token(static_cast<int>(token));
+        }
+        if (grammar) {
+            grammar->advance(grammar_state, static_cast<int>(token));
+        }
+        
+        if (token == FormulaTokenizer::EOS) {
+            break;
+        }
+    }
+}
+
+DecoderWorkspace FormulaModel::create_workspace(int max_input_length) {
+    return decoder->create_workspace(max_input_length);
+}
+
+void FormulaModel::warm_up(DecoderWorkspace& workspace, int output_length) {
+    torch::NoGradGuard no_grad;
+    
+    // Вход полной вместимости буферов из неизвестных токенов
+    std::vector<int> input_tokens(static_cast<size_t>(std::max<int64_t>(2, workspace.max_input_length)),
+                                  FormulaTokenizer::UNK);
+    input_tokens.front() = FormulaTokenizer::SOS;
+    input_tokens.back() = FormulaTokenizer::EOS;
+    auto state = prepare(input_tokens);
+    
+    if (!decoder->accepts(workspace) || decoder->quantized_enabled()) {
+        return;
+    }
+    
+    // Шаги без остановки на конце последовательности, плюс полная проекция для кандидатов
+    decoder->bind_workspace(state, workspace);
+    for (int i = 0; i < output_length; ++i) {
+        decoder->step(FormulaTokenizer::UNK, workspace);
+    }
+    decoder->output_logits(workspace);
+}
+
+std::vector<int> FormulaModel::beam_search(DecoderState state, const GenerationOptions& options,
+                                          const RequestLimits* limits) {
+    const int64_t beam_width = options.beam_width;
+    
+    // Завершенная гипотеза с оценкой, нормированной на длину
+    struct Hypothesis {
+        std::vector<int> tokens;
+        double score;
+    };
+    std::vector<Hypothesis> finished;
+    
+    auto normalized = [&](double score, size_t length) {
+        return score / std::pow(static_cast<double>(length), options.length_penalty);
+    };
+    
+    // Размножаем состояние на все лучи. Вначале жив только первый луч,
+    // чтобы на первом шаге не получить K одинаковых гипотез
+    state = state.index_select(torch::zeros({beam_width}, torch::kLong));
+    auto beam_scores = torch::full({beam_width}, -std::numeric_limits<float>::infinity());
+    beam_scores[0] = 0.0;
+    
+    std::vector<std::vector<int>> beam_tokens(beam_width);
+    auto decoder_input = torch::full({beam_width}, static_cast<int64_t>(FormulaTokenizer::SOS), torch::kLong);
+    
+    auto grammar = active_grammar(options);
+    std::vector<GrammarState> beam_grammar(static_cast<size_t>(beam_width));
+    
+    for (int i = 0; i < options.max_length; i++) {
+        // При остановке по сроку или отмене ответ выбирается из того, что уже есть
+        if (limits && limits->step_boundary()) {
+            break;
+        }
+        
+        // Один шаг декодера сразу для всех лучей [K, V]
+        auto log_probs = torch::log_softmax(decode_step(decoder_input, state), 1);
+        auto vocab = log_probs.size(1);
+        
+        // Продолжения, недопустимые грамматикой, исключаются маской сразу для всех лучей.
+        // Лучу с законченной структурой остается только конец последовательности
+        if (grammar) {
+            std::vector<const GrammarState*> states;
+            for (const auto& beam_state : beam_grammar) {
+                states.push_back(&beam_state);
+            }
+            auto allowed = grammar_mask(*grammar, states, std::vector<int>(states.size(), options.max_length - i - 1),
+                                        options.max_formulas);
+            if (state.shortlist.defined()) {
+                allowed = allowed.index_select(1, state.shortlist);
+            }
+            log_probs.masked_fill_(allowed.logical_not(), -std::numeric_limits<float>::infinity());
+        }
+        
+        // Единый top-k по всем K x V продолжениям. Берем 2K кандидатов, чтобы после
+        // отсева завершившихся гипотез осталось K живых лучей
+        auto candidate_scores = (beam_scores.unsqueeze(1) + log_probs).view({-1});
+        auto top = candidate_scores.topk(std::min<int64_t>(2 * beam_width, candidate_scores.size(0)));
+        auto top_scores = std::get<0>(top);
+        auto top_indices = std::get<1>(top);
+        auto score_access = top_scores.accessor<float, 1>();
+        auto index_access = top_indices.accessor<int64_t, 1>();
+        
+        std::vector<int64_t> source_beams;
+        std::vector<int64_t> next_tokens;
+        std::vector<float> next_scores;
+        for (int64_t k = 0; k < top_indices.size(0) && static_cast<int64_t>(source_beams.size()) < beam_width; ++k) {
+            float score = score_access[k];
+            if (std::isinf(score)) {
+                break;
+            }
+            
+            int64_t beam = index_access[k] / vocab;
+            int token = static_cast<int>(index_access[k] % vocab);
+            if (state.shortlist.defined()) {
+                // Лучи ищутся среди кандидатов, индекс переводим в токен словаря
+                token = static_cast<int>(state.shortlist[token].item<int64_t>());
+            }
+            
+            if (token == FormulaTokenizer::EOS) {
+                // Гипотеза завершена - откладываем её вместе с токеном конца
+                std::vector<int> tokens = beam_tokens[beam];
+                tokens.push_back(token);
+                finished.push_back({std::move(tokens), normalized(score, beam_tokens[beam].size() + 1)});
+            } else {
+                source_beams.push_back(beam);
+                next_tokens.push_back(token);
+                next_scores.push_back(score);
+            }
+        }
+        
+        // Ранняя остановка: набралось K завершенных гипотез или продолжать нечего
+        if (static_cast<int64_t>(finished.size()) >= beam_width || source_beams.empty()) {
+            break;
+        }
+        
+        // Если живых кандидатов меньше K, лишние лучи гасим
+        while (static_cast<int64_t>(source_beams.size()) < beam_width) {
+            source_beams.push_back(source_beams.front());
+            next_tokens.push_back(next_tokens.front());
+            next_scores.push_back(-std::numeric_limits<float>::infinity());
+        }
+        
+        // Переставляем состояние лучей одной операцией над батчем
+        auto rows = torch::tensor(source_beams, torch::kLong);
+        state = state.index_select(rows);
+        decoder_input = torch::tensor(next_tokens, torch::kLong);
+        beam_scores = torch::tensor(next_scores);
+        
+        std::vector<std::vector<int>> reordered(beam_width);
+        for (int64_t k = 0; k < beam_width; ++k) {
+            reordered[k] = beam_tokens[source_beams[k]];
+            reordered[k].push_back(static_cast<int>(next_tokens[k]));
+        }
+        beam_tokens = std::move(reordered);
+        
+        if (grammar) {
+            std::vector<GrammarState> reordered_grammar(static_cast<size_t>(beam_width));
+            for (int64_t k = 0; k < beam_width; ++k) {
+                reordered_grammar[k] = beam_grammar[source_beams[k]];
+                grammar->advance(reordered_grammar[k], static_cast<int>(next_tokens[k]));
+            }
+            beam_grammar = std::move(reordered_grammar);
+        }
+    }
+    
+    // Если ни одна гипотеза не завершилась, выбираем среди живых лучей
+    if (finished.empty()) {
+        auto score_access = beam_scores.accessor<float, 1>();
+        for (int64_t k = 0; k < beam_width; ++k) {
+            if (!std::isinf(score_access[k]) && !beam_tokens[k].empty()) {
+                finished.push_back({beam_tokens[k], normalized(score_access[k], beam_tokens[k].size())});
+            }
+        }
+    }
+    
+    if (finished.empty()) {
+        return {};
+    }
+    
+    auto best = std::max_element(finished.begin(), finished.end(),
+                                 [](const Hypothesis& a, const Hypothesis& b) { return a.score < b.score; });
+    return best->tokens;
+}
+
+std::vector<std::vector<int>> FormulaModel::generate_batch(const std::vector<std::vector<int>>& inputs,
+                                                           int max_length) {
+    torch::NoGradGuard no_grad;
+    
+    int64_t batch_size = static_cast<int64_t>(inputs.size());
+    std::vector<std::vector<int>> outputs(inputs.size());
+    if (batch_size == 0) {
+        return outputs;
+    }
+    
+    // Находим максимальную длину входа в батче
+    int64_t max_input_length = 0;
+    for (const auto& tokens : inputs) {
+        if (tokens.empty()) {
+            throw std::invalid_argument("Пустая входная последовательность в батче");
+        }
+        max_input_length = std::max(max_input_length, static_cast<int64_t>(tokens.size()));
+    }
+    
+    // Заполняем тензор входов, короткие последовательности дополняются PAD (0)
+    auto input_tensor = torch::zeros({batch_size, max_input_length}, torch::kLong);
+    auto lengths = torch::empty({batch_size}, torch::kLong);
+    auto input_access = input_tensor.accessor<int64_t, 2>();
+    auto length_access = lengths.accessor<int64_t, 1>();
+    for (int64_t row = 0; row < batch_size; ++row) {
+        const auto& tokens = inputs[row];
+        for (size_t k = 0; k < tokens.size(); ++k) {
+            input_access[row][k] = tokens[k];
+        }
+        length_access[row] = static_cast<int64_t>(tokens.size());
+    }
+    
+    // Маска позиций за пределами реальной длины каждой строки
+    auto mask = torch::arange(max_input_length, torch::kLong).unsqueeze(0) >= lengths.unsqueeze(1);
+    auto state = start_decoding(encode(input_tensor, lengths), mask);
+    
+    // Номера исходных задач для строк, которые еще генерируются
+    std::vector<int64_t> active(inputs.size());
+    std::iota(active.begin(), active.end(), 0);
+    
+    auto decoder_input = torch::full({batch_size}, static_cast<int64_t>(FormulaTokenizer::SOS), torch::kLong);
+    
+    for (int i = 0; i < max_length; i++) {
+        auto logits = decode_step(decoder_input, state);
+        auto top_tokens = logits.argmax(1);
+        auto top_access = top_tokens.accessor<int64_t, 1>();
+        
+        // Оставляем только строки, которые еще не выдали конец последовательности
+        std::vector<int64_t> keep_rows;
+        std::vector<int64_t> still_active;
+        for (size_t row = 0; row < active.size(); ++row) {
+            int token = static_cast<int>(top_access[row]);
+            outputs[active[row]].push_back(token);
+            if (token != FormulaTokenizer::EOS) {
+                keep_rows.push_back(static_cast<int64_t>(row));
+                still_active.push_back(active[row]);
+            }
+        }
+        
+        if (still_active.empty()) {
+            break;
+        }
+        
+        if (still_active.size() != active.size()) {
+            auto rows = torch::tensor(keep_rows, torch::kLong);
+            state = state.index_select(rows);
+            top_tokens = top_tokens.index_select(0, rows);
+            active = std::move(still_active);
+        }
+        
+        decoder_input = top_tokens;
+    }
+    
+    return outputs;
+}
+
+QuantizationReport FormulaModel::quantize_int8(int num_probes, int probe_length) {
+    torch::NoGradGuard no_grad;
+    
+    auto report = encoder->quantize();
+    auto decoder_report = decoder->quantize();
+    report.fp32_bytes += decoder_report.fp32_bytes;
+    report.int8_bytes += decoder_report.int8_bytes;
+    
+    // Сравниваем логиты int8 и fp32 на случайных входах. Оба варианта декодируют
+    // одну и ту же последовательность - ту, что выбирает fp32
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> token_distribution(0, vocab_size - 1);
+    
+    double total_error = 0.0;
+    int64_t total_values = 0;
+    int64_t agreed_steps = 0;
+    int64_t total_steps = 0;
+    
+    for (int probe = 0; probe < num_probes; ++probe) {
+        std::vector<int> input_tokens{FormulaTokenizer::SOS};
+        for (int i = 0; i < probe_length; ++i) {
+            input_tokens.push_back(token_distribution(generator));
+        }
+        input_tokens.push_back(FormulaTokenizer::EOS);
+        
+        set_quantized_enabled(false);
+        auto reference_state = prepare(input_tokens);
+        set_quantized_enabled(true);
+        auto quantized_state = prepare(input_tokens);
+        
+        auto decoder_input = torch::full({1}, static_cast<int64_t>(FormulaTokenizer::SOS), torch::kLong);
+        for (int i = 0; i < probe_length; ++i) {
+            set_quantized_enabled(false);
+            auto reference_logits = decode_step(decoder_input, reference_state);
+            set_quantized_enabled(true);
+            auto quantized_logits = decode_step(decoder_input, quantized_state);
+            
+            auto error = (reference_logits - quantized_logits).abs();
+            report.max_logit_error = std::max(report.max_logit_error, error.max().item<double>());
+            total_error += error.sum().item<double>();
+            total_values += error.numel();
+            
+            auto reference_token = reference_logits.argmax(1).item<int64_t>();
+            if (reference_token == quantized_logits.argmax(1).item<int64_t>()) {
+                agreed_steps++;
+            }
+            total_steps++;
+            
+            decoder_input.fill_(reference_token);
+        }
+    }
+    
+    if (total_values > 0) {
+        report.mean_logit_error = total_error / total_values;
+        report.token_agreement = static_cast<double>(agreed_steps) / total_steps;
+    }
+    
+    set_quantized_enabled(true);
+    return report;
+}
+
+void FormulaModel::set_quantized_enabled(bool enabled) {
+    encoder->set_quantized_enabled(enabled);
+    decoder->set_quantized_enabled(enabled);
+}
+
 void FormulaModel::save(const std::string& path) {
     torch::save(shared_from_this(), path);
 }
 
 std::shared_ptr<FormulaModel> FormulaModel::load(const std::string& path, torch::Device device) {
     try {
+        if (BundleFile::is_bundle(path)) {
+            auto model = from_bundle(BundleFile::open(path));
+            if (device != torch::Device(torch::kCPU)) {
+                model->to(device);
+            }
+            return model;
+        }
+        
+        // Размеры модели восстанавливаются по формам весов в архиве
+        torch::serialize::InputArchive archive;
+        archive.load_from(path, device);
+        
+        torch::serialize::InputArchive encoder_archive;
+        torch::serialize::InputArchive embedding_archive;
+        torch::serialize::InputArchive fc_archive;
+        archive.read("encoder", encoder_archive);
+        encoder_archive.read("embedding", embedding_archive);
+        encoder_archive.read("fc", fc_archive);
+        
+        torch::Tensor embedding_weight;
+        torch::Tensor fc_weight;
+        embedding_archive.read("weight", embedding_weight);
+        fc_archive.read("weight", fc_weight);
+        
         // Загрузка модели
-        std::shared_ptr<FormulaModel> model;
-        torch::load(model, path, device);
+        auto model = std::make_shared<FormulaModel>(embedding_weight.size(0), embedding_weight.size(1), fc_weight.size(0));
+        model->torch::nn::Module::load(archive);
+        model->to(device);
         
         return model;
     }
@@ -116,4 +1032,65 @@ std::shared_ptr<FormulaModel> FormulaModel::load(const std::string& path, torch:
     }
 }
 
+std::vector<BundleTensorData> FormulaModel::bundle_tensors(std::vector<torch::Tensor>& contiguous) {
+    auto params = named_parameters();
+    
+    std::vector<BundleTensorData> tensors;
+    contiguous.clear();
+    contiguous.reserve(params.size());
+    for (const auto& param : params) {
+        contiguous.push_back(param.value().detach().to(torch::kCPU, torch::kFloat).contiguous());
+        tensors.push_back({param.key(), contiguous.back().sizes().vec(), contiguous.back().data_ptr<float>()});
+    }
+    return tensors;
+}
+
+void FormulaModel::save_bundle(const std::string& path, const FormulaTokenizer& tokenizer) {
+    torch::NoGradGuard no_grad;
+    
+    // Непрерывные fp32 копии живут до конца записи
+    std::vector<torch::Tensor> contiguous;
+    auto tensors = bundle_tensors(contiguous);
+    
+    auto embedding_dim = named_parameters()["encoder.embedding.weight"].size(1);
+    BundleFile::write(path, vocab_size, static_cast<int>(embedding_dim), hidden_dim, tensors,
+                      tokenizer.vocabulary_entries());
+}
+
+std::shared_ptr<BundleFile> FormulaModel::share_weights(uint64_t key) {
+    torch::NoGradGuard no_grad;
+    
+    std::vector<torch::Tensor> contiguous;
+    auto tensors = bundle_tensors(contiguous);
+    
+    // Словарь в сегмент не входит: он загружается отдельно и невелик
+    auto embedding_dim = named_parameters()["encoder.embedding.weight"].size(1);
+    return BundleFile::publish_shared(key, vocab_size, static_cast<int>(embedding_dim), hidden_dim, tensors, {});
+}
+
+std::shared_ptr<FormulaModel> FormulaModel::from_bundle(const std::shared_ptr<BundleFile>& bundle) {
+    const auto& header = bundle->header();
+    auto model = std::make_shared<FormulaModel>(header.vocab_size, header.embedding_dim, header.hidden_dim);
+    
+    torch::NoGradGuard no_grad;
+    for (auto& param : model->named_parameters()) {
+        const BundleTensor* tensor = bundle->find_tensor(param.key());
+        if (!tensor) {
+            throw std::runtime_error("В пакете модели нет тензора " + param.key());
+        }
+        
+        std::vector<int64_t> shape(tensor->shape, tensor->shape + tensor->ndim);
+        if (param.value().sizes() != torch::IntArrayRef(shape)) {
+            throw std::runtime_error("Размер тензора " + param.key() + " в пакете не совпадает с моделью");
+        }
+        
+        // Тензор ссылается на отображение и держит пакет открытым, пока жив сам
+        auto weights = torch::from_blob(const_cast<float*>(bundle->tensor_data(*tensor)), shape,
+                                        [bundle](void*) {}, torch::kFloat);
+        param.value().set_data(weights);
+    }
+    
+    return model;
+}
+
 } // namespace formula_teacher
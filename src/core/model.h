@@ -1,11 +1,145 @@
 #pragma once
 
+#include "bundle_file.h"
+#include "formula_grammar.h"
+#include "quantization.h"
+#include "request_control.h"
+#include "shortlist.h"
+#include "tokenizer.h"
 #include <torch/torch.h>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace formula_teacher {
 
+// Состояние пошагового декодирования одной или нескольких последовательностей
+struct DecoderState {
+    // Выход энкодера [B, S, H]
+    torch::Tensor encoder_output;
+    
+    // Проекция выхода энкодера слоем внимания [B, S, H], считается один раз на запрос
+    torch::Tensor keys;
+    
+    // Маска дополненных позиций входа [B, S] (true - PAD), может быть не задана
+    torch::Tensor mask;
+    
+    // Скрытое состояние LSTM декодера (h, c), каждое [1, B, H]
+    torch::Tensor h;
+    torch::Tensor c;
+    
+    // Кандидаты выходной проекции [K] и соответствующие строки fc [K, H] и [K].
+    // Если не заданы, шаг считает логиты по всему словарю
+    torch::Tensor shortlist;
+    torch::Tensor shortlist_weight;
+    torch::Tensor shortlist_bias;
+    
+    // Выбор подмножества строк батча (например, при выбывании завершенных)
+    DecoderState index_select(const torch::Tensor& rows) const;
+};
+
+// Заранее выделенные буферы жадного декодирования одной последовательности.
+// Шаг пишет результаты операций в эти буферы (out-варианты операций), поэтому
+// после прогрева декодирование не обращается к аллокатору. Буферы привязаны к весам
+// модели, которая их создала (FormulaModel::create_workspace), и принадлежат
+// одному потоку. Тензоры DecoderState при этом не меняются
+struct DecoderWorkspace {
+    // Вместимость по длине входа, более длинный вход расширяет буферы
+    int64_t max_input_length = 0;
+    
+    // Веса модели, для которой созданы буферы, и сумма смещений LSTM.
+    // Матрицы хранятся транспонированными представлениями (без копирования),
+    // чтобы шаг не создавал их заново
+    torch::Tensor embedding_weight;
+    torch::Tensor query_weight;
+    torch::Tensor weight_ih;
+    torch::Tensor weight_hh;
+    torch::Tensor lstm_bias;
+    torch::Tensor fc_weight;
+    torch::Tensor fc_bias;
+    
+    // Текущий токен [1]
+    torch::Tensor token;
+    
+    // Вход LSTM [1, E + H + H]: эмбеддинг токена, контекст внимания и скрытое состояние h.
+    // embedded, context и h - его части, x - эмбеддинг и контекст вместе.
+    // Поэтому конкатенация на шаге не нужна: операции пишут прямо в свои части
+    torch::Tensor lstm_input;
+    torch::Tensor embedded;
+    torch::Tensor context;
+    torch::Tensor x;
+    torch::Tensor h;
+    torch::Tensor c;
+    
+    // Внимание: запрос [1, H], энергия [S, H], оценки и веса позиций [S]
+    torch::Tensor query;
+    torch::Tensor energy;
+    torch::Tensor scores;
+    torch::Tensor attention;
+    
+    // Гейты LSTM [1, 4H] и их части i, f, g, o
+    torch::Tensor gates;
+    torch::Tensor gate_i;
+    torch::Tensor gate_f;
+    torch::Tensor gate_g;
+    torch::Tensor gate_o;
+    
+    // Логиты по всему словарю [1, V]
+    torch::Tensor logits;
+    
+    // Части буферов и состояния под текущий запрос (FormulaDecoder::bind_workspace)
+    torch::Tensor keys;
+    torch::Tensor encoder_output;
+    torch::Tensor mask;
+    torch::Tensor energy_view;
+    torch::Tensor scores_view;
+    torch::Tensor attention_view;
+    torch::Tensor attention_row;
+    torch::Tensor shortlist;
+    torch::Tensor shortlist_weight;
+    torch::Tensor shortlist_bias;
+    torch::Tensor step_logits;
+    
+    bool defined() const { return lstm_input.defined(); }
+};
+
+// Обработчик очередного сгенерированного токена (потоковая выдача ответа)
+using TokenCallback = std::function<void(int)>;
+
+// Параметры генерации ответа
+struct GenerationOptions {
+    // Максимальная длина ответа в токенах
+    int max_length = 100;
+    
+    // Ширина лучевого поиска, 1 - жадный поиск
+    int beam_width = 1;
+    
+    // Степень нормировки оценки гипотезы на её длину: score / length^length_penalty
+    double length_penalty = 1.0;
+    
+    // При списке кандидатов: если вероятность лучшего кандидата ниже порога,
+    // шаг пересчитывается по всему словарю (только для жадного поиска)
+    double shortlist_min_confidence = 0.5;
+    
+    // Ограничение ответа грамматикой формул (см. FormulaGrammar): на каждом шаге
+    // недопустимые токены исключаются из выбора, поэтому ответ не обрывается
+    // на незакрытой формуле, скобке или окружении
+    bool constrain_formulas = false;
+    
+    // При ограничении: ответ заканчивается без шага декодера, как только закрыто
+    // столько формул верхнего уровня. 0 - конец ответа определяет модель
+    int max_formulas = 0;
+};
+
+// Маска допустимых токенов [B, V] для строк в состояниях states (nullptr - строка
+// без ограничений), remaining - сколько шагов останется строке после этого.
+// Совпадает с FormulaGrammar::allows. Закончившим структуру строкам (FormulaGrammar::complete)
+// допустим только конец последовательности. Если строке не подходит ни один токен,
+// она остается без ограничений
+torch::Tensor grammar_mask(const FormulaGrammar& grammar, const std::vector<const GrammarState*>& states,
+                           const std::vector<int>& remaining, int max_formulas);
+
 // Класс для кодирования текста и формул
 class FormulaEncoder : public torch::nn::Module {
 public:
@@ -14,10 +148,31 @@ public:
     // Прямой проход через энкодер
     torch::Tensor forward(torch::Tensor x);
     
+    // Прямой проход для дополненного батча с реальными длинами последовательностей
+    torch::Tensor forward(torch::Tensor x, torch::Tensor lengths);
+    
+    // Создание int8 копий LSTM и fc для инференса, возвращает объем весов до и после
+    QuantizationReport quantize();
+    
+    // Переключение между int8 и fp32 весами (после quantize)
+    void set_quantized_enabled(bool enabled) { use_quantized = enabled && quantized != nullptr; }
+    
 private:
+    // Прямой проход на int8 весах
+    torch::Tensor quantized_forward(torch::Tensor x, torch::Tensor lengths);
+    
     torch::nn::Embedding embedding = nullptr;
     torch::nn::LSTM lstm = nullptr;
     torch::nn::Linear fc = nullptr;
+    
+    // int8 веса для инференса, обучение всегда идет на fp32 параметрах
+    struct QuantizedWeights {
+        QuantizedLSTMDirection forward_lstm;
+        QuantizedLSTMDirection backward_lstm;
+        QuantizedLinear fc;
+    };
+    std::shared_ptr<QuantizedWeights> quantized;
+    bool use_quantized = false;
 };
 
 // Класс для декодирования ответов
@@ -28,11 +183,65 @@ public:
     // Прямой проход через декодер
     torch::Tensor forward(torch::Tensor x, torch::Tensor encoder_output);
     
+    // Подготовка состояния для пошагового декодирования
+    DecoderState init_state(torch::Tensor encoder_output, torch::Tensor mask = {});
+    
+    // Один шаг декодирования: x - токены [B], результат - логиты [B, vocab_size],
+    // а при заданном state.shortlist - [B, K] по кандидатам. Состояние LSTM в state обновляется на месте
+    torch::Tensor step(torch::Tensor x, DecoderState& state);
+    
+    // Ограничение выходной проекции кандидатами [K]: нужные строки fc копируются в state один раз
+    void restrict_output(DecoderState& state, const torch::Tensor& candidates);
+    
+    // Логиты по всему словарю для скрытого состояния [B, H]
+    torch::Tensor output_logits(const torch::Tensor& hidden);
+    
+    // Буферы пошагового декодирования для входа до max_input_length токенов
+    DecoderWorkspace create_workspace(int64_t max_input_length);
+    
+    // Созданы ли буферы для текущих весов
+    bool accepts(const DecoderWorkspace& workspace) const;
+    
+    // Начало декодирования state в буферах: копия h и c, части буферов под длину входа.
+    // Сам state не меняется, поэтому его можно хранить в кэше
+    void bind_workspace(const DecoderState& state, DecoderWorkspace& workspace);
+    
+    // Шаг декодирования в буферах: token - предыдущий токен, результат - логиты [1, V]
+    // или [1, K] по кандидатам, часть workspace.logits (действительна до следующего шага)
+    const torch::Tensor& step(int64_t token, DecoderWorkspace& workspace);
+    
+    // Логиты по всему словарю для последнего шага в буферах [1, V]
+    const torch::Tensor& output_logits(DecoderWorkspace& workspace);
+    
+    // Создание int8 копий attn, LSTM и fc для пошагового декодирования
+    QuantizationReport quantize();
+    
+    // Переключение между int8 и fp32 весами (после quantize)
+    void set_quantized_enabled(bool enabled) { use_quantized = enabled && quantized != nullptr; }
+    bool quantized_enabled() const { return use_quantized; }
+    
 private:
+    // Части слоя attn: по эмбеддингу токена (без смещения) и по выходу энкодера (со смещением).
+    // Их сумма равна attn(cat(embedded, encoder_output)), поэтому веса attn не меняются
+    torch::Tensor attention_query(const torch::Tensor& embedded);
+    torch::Tensor attention_keys(const torch::Tensor& encoder_output);
+    
+    int embedding_dim;
+    
     torch::nn::Embedding embedding = nullptr;
     torch::nn::LSTM lstm = nullptr;
     torch::nn::Linear fc = nullptr;
     torch::nn::Linear attn = nullptr;
+    
+    // int8 веса для init_state и step, forward для обучения их не использует
+    struct QuantizedWeights {
+        QuantizedLinear attn_query;
+        QuantizedLinear attn_keys;
+        QuantizedLSTMDirection lstm;
+        QuantizedLinear fc;
+    };
+    std::shared_ptr<QuantizedWeights> quantized;
+    bool use_quantized = false;
 };
 
 // Полная модель Seq2Seq с механизмом внимания для работы с формулами
@@ -43,18 +252,118 @@ public:
     // Сохранение модели
     void save(const std::string& path);
     
-    // Загрузка модели - изменен возвращаемый тип
+    // Загрузка модели - изменен возвращаемый тип. Принимает и .pt, и пакет модели
     static std::shared_ptr<FormulaModel> load(const std::string& path, torch::Device device = torch::kCPU);
     
+    // Сохранение модели вместе со словарем в однофайловый пакет (см. BundleFile)
+    void save_bundle(const std::string& path, const FormulaTokenizer& tokenizer);
+    
+    // Модель с весами прямо поверх отображенного пакета, без копирования.
+    // Веса только для чтения: такую модель нельзя дообучать, но можно квантовать
+    static std::shared_ptr<FormulaModel> from_bundle(const std::shared_ptr<BundleFile>& bundle);
+    
+    // Публикация весов в разделяемой памяти под ключом key (см. BundleFile::publish_shared).
+    // Модель поверх возвращенного пакета (from_bundle) делит веса со всеми процессами,
+    // подключившимися с тем же ключом
+    std::shared_ptr<BundleFile> share_weights(uint64_t key);
+    
     // Прямой проход через всю модель
     torch::Tensor forward(torch::Tensor input_seq);
     
+    // Кодирование входной последовательности [B, S] -> [B, S, H]
+    torch::Tensor encode(torch::Tensor input_seq);
+    
+    // Кодирование дополненного батча с длинами последовательностей [B]
+    torch::Tensor encode(torch::Tensor input_seq, torch::Tensor lengths);
+    
+    // Начало пошагового декодирования по выходу энкодера
+    DecoderState start_decoding(torch::Tensor encoder_output, torch::Tensor mask = {});
+    
+    // Один шаг декодирования: токены [B] -> логиты [B, vocab_size]
+    torch::Tensor decode_step(torch::Tensor tokens, DecoderState& state);
+    
     // Генерация ответа на задачу
-    std::vector<int> generate(std::vector<int>& input_tokens, int max_length = 100);
+    std::vector<int> generate(const std::vector<int>& input_tokens, int max_length = 100);
+    
+    // Генерация ответа с заданными параметрами (жадный или лучевой поиск)
+    std::vector<int> generate(const std::vector<int>& input_tokens, const GenerationOptions& options);
+    
+    // Подготовка состояния декодера для одной последовательности: энкодер и ключи внимания
+    DecoderState prepare(const std::vector<int>& input_tokens);
+    
+    // Список кандидатов для выходной проекции, nullptr - всегда полный словарь.
+    // Применяется в prepare, то есть к generate и decode. Подменяется атомарно,
+    // поэтому его можно менять, пока другие потоки генерируют ответы
+    void set_shortlist(std::shared_ptr<const VocabularyShortlist> candidates) {
+        std::atomic_store(&shortlist, std::move(candidates));
+    }
+    
+    // Логиты по всему словарю для последнего шага state [B, vocab_size]
+    torch::Tensor full_logits(const DecoderState& state);
+    
+    // Грамматика для GenerationOptions::constrain_formulas, строится по словарю модели.
+    // Подменяется атомарно, как список кандидатов. Без нее ответ не ограничивается
+    void set_grammar(std::shared_ptr<const FormulaGrammar> grammar) {
+        std::atomic_store(&output_grammar, std::move(grammar));
+    }
+    std::shared_ptr<const FormulaGrammar> get_grammar() const { return std::atomic_load(&output_grammar); }
+    
+    // Размер словаря (число логитов шага)
+    int get_vocab_size() const { return vocab_size; }
+    
+    // Генерация из заранее подготовленного состояния. Тензоры state на месте не меняются,
+    // поэтому одно подготовленное состояние можно декодировать повторно.
+    // on_token вызывается для каждого токена ответа: при жадном поиске сразу после шага,
+    // при лучевом - после выбора лучшей гипотезы.
+    // limits проверяются между шагами: по истечении срока или отмене возвращается
+    // уже сгенерированная часть ответа (без токена конца последовательности)
+    std::vector<int> decode(DecoderState state, const GenerationOptions& options,
+                            const TokenCallback& on_token = nullptr, const RequestLimits* limits = nullptr);
+    
+    // То же в заранее выделенных буферах: ответ пишется в output_tokens, емкость которого
+    // сохраняется между запросами. Жадный поиск fp32 модели идет без выделения памяти
+    // на шагах (грамматика проверяет токены прямо по буферу логитов), лучевой поиск
+    // и int8 веса декодируются обычным decode
+    void decode(const DecoderState& state, const GenerationOptions& options, DecoderWorkspace& workspace,
+                std::vector<int>& output_tokens, const TokenCallback& on_token = nullptr,
+                const RequestLimits* limits = nullptr);
+    
+    // Буферы декодирования для входа до max_input_length токенов (см. DecoderWorkspace)
+    DecoderWorkspace create_workspace(int max_input_length);
+    
+    // Созданы ли буферы для текущих весов модели
+    bool accepts(const DecoderWorkspace& workspace) const { return decoder->accepts(workspace); }
+    
+    // Прогрев: энкодер на входе полной вместимости буферов и output_length шагов декодера.
+    // Выделяет память отложенной инициализации LibTorch и BLAS до первого запроса
+    void warm_up(DecoderWorkspace& workspace, int output_length);
+    
+    // Жадная генерация для нескольких задач одним батчем.
+    // Строки, выдавшие токен конца последовательности, выбывают из батча
+    std::vector<std::vector<int>> generate_batch(const std::vector<std::vector<int>>& inputs,
+                                                 int max_length = 100);
+    
+    // Квантование линейных слоев и матриц LSTM в int8 для инференса на CPU.
+    // В отчете - расхождение логитов с fp32 на num_probes случайных входах
+    QuantizationReport quantize_int8(int num_probes = 8, int probe_length = 16);
+    
+    // Переключение между int8 и fp32 весами после quantize_int8
+    void set_quantized_enabled(bool enabled);
     
 private:
+    // Лучевой поиск: все лучи декодируются одним батчем
+    std::vector<int> beam_search(DecoderState state, const GenerationOptions& options, const RequestLimits* limits);
+    
+    // Грамматика для options, nullptr - ответ без ограничений
+    std::shared_ptr<const FormulaGrammar> active_grammar(const GenerationOptions& options) const;
+    
+    // Описание весов для пакета. contiguous держит непрерывные fp32 копии, на которые ссылается результат
+    std::vector<BundleTensorData> bundle_tensors(std::vector<torch::Tensor>& contiguous);
+    
     int hidden_dim;
     int vocab_size;
+    std::shared_ptr<const VocabularyShortlist> shortlist;
+    std::shared_ptr<const FormulaGrammar> output_grammar;
     std::shared_ptr<FormulaEncoder> encoder = nullptr;
     std::shared_ptr<FormulaDecoder> decoder = nullptr;
 };
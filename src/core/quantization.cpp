@@ -0,0 +1,139 @@
+#include "quantization.h"
+#include <ATen/core/dispatch/Dispatcher.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace formula_teacher {
+
+namespace {
+
+// Выбор int8-бэкенда: FBGEMM на x86, QNNPACK на ARM
+bool select_quantized_engine() {
+    const auto& engines = at::globalContext().supportedQEngines();
+    for (auto engine : {at::QEngine::FBGEMM, at::QEngine::QNNPACK}) {
+        if (std::find(engines.begin(), engines.end(), engine) != engines.end()) {
+            at::globalContext().setQEngine(engine);
+            return true;
+        }
+    }
+    return false;
+}
+
+const c10::OperatorHandle& linear_prepack_op() {
+    static auto op = c10::Dispatcher::singleton().findSchemaOrThrow("quantized::linear_prepack", "");
+    return op;
+}
+
+const c10::OperatorHandle& linear_dynamic_op() {
+    static auto op = c10::Dispatcher::singleton().findSchemaOrThrow("quantized::linear_dynamic", "");
+    return op;
+}
+
+} // namespace
+
+bool quantization_supported() {
+    static bool supported = select_quantized_engine();
+    return supported;
+}
+
+QuantizedLinear::QuantizedLinear(const torch::Tensor& weight, const torch::Tensor& bias) {
+    if (!quantization_supported()) {
+        throw std::runtime_error("LibTorch собран без поддержки int8-квантования");
+    }
+    
+    torch::NoGradGuard no_grad;
+    auto w = weight.detach().to(torch::kFloat).contiguous();
+    
+    // Симметричное квантование с масштабом на каждую строку (выходной канал)
+    auto max_abs = std::get<0>(w.abs().max(1)).clamp_min(1e-8);
+    auto scales = (max_abs / 127.0).to(torch::kDouble);
+    auto zero_points = torch::zeros({w.size(0)}, torch::kLong);
+    auto qweight = torch::quantize_per_channel(w, scales, zero_points, 0, torch::kQInt8);
+    
+    c10::optional<torch::Tensor> qbias;
+    if (bias.defined()) {
+        qbias = bias.detach().to(torch::kFloat).contiguous();
+    }
+    
+    std::vector<c10::IValue> stack{qweight, qbias};
+    linear_prepack_op().callBoxed(&stack);
+    packed = std::move(stack[0]);
+    
+    original_bytes = w.numel() * static_cast<int64_t>(sizeof(float));
+    quantized_bytes = w.numel() + w.size(0) * static_cast<int64_t>(sizeof(double) + sizeof(int64_t));
+}
+
+torch::Tensor QuantizedLinear::forward(const torch::Tensor& input) const {
+    // reduce_range защищает от переполнения 16-битных аккумуляторов FBGEMM
+    std::vector<c10::IValue> stack{input.contiguous(), packed, true};
+    linear_dynamic_op().callBoxed(&stack);
+    return stack[0].toTensor();
+}
+
+QuantizedLSTMDirection::QuantizedLSTMDirection(const torch::Tensor& weight_ih, const torch::Tensor& weight_hh,
+                                               const torch::Tensor& bias_ih, const torch::Tensor& bias_hh)
+    : input_projection(weight_ih, bias_ih + bias_hh),
+      hidden_projection(weight_hh, torch::Tensor()) {
+}
+
+std::tuple<torch::Tensor, torch::Tensor> QuantizedLSTMDirection::cell(
+    const torch::Tensor& x, const torch::Tensor& h, const torch::Tensor& c) const {
+    return apply_gates(input_projection.forward(x) + hidden_projection.forward(h), c);
+}
+
+std::tuple<torch::Tensor, torch::Tensor> QuantizedLSTMDirection::apply_gates(
+    const torch::Tensor& gates, const torch::Tensor& c) {
+    auto chunks = gates.chunk(4, 1);
+    
+    auto input_gate = torch::sigmoid(chunks[0]);
+    auto forget_gate = torch::sigmoid(chunks[1]);
+    auto cell_gate = torch::tanh(chunks[2]);
+    auto output_gate = torch::sigmoid(chunks[3]);
+    
+    auto next_c = forget_gate * c + input_gate * cell_gate;
+    auto next_h = output_gate * torch::tanh(next_c);
+    return std::make_tuple(next_h, next_c);
+}
+
+torch::Tensor QuantizedLSTMDirection::run(const torch::Tensor& x, const torch::Tensor& lengths, bool reverse) const {
+    auto batch = x.size(0);
+    auto steps = x.size(1);
+    
+    // Для обратного направления разворачиваем каждую строку в пределах её длины.
+    // Такая перестановка обратна сама себе, поэтому ею же возвращаем порядок выхода
+    torch::Tensor order;
+    auto input = x;
+    if (reverse) {
+        auto positions = torch::arange(steps, torch::kLong).unsqueeze(0).expand({batch, steps});
+        if (lengths.defined()) {
+            auto row_lengths = lengths.unsqueeze(1);
+            order = torch::where(positions < row_lengths, row_lengths - 1 - positions, positions);
+        } else {
+            order = steps - 1 - positions;
+        }
+        input = x.gather(1, order.unsqueeze(2).expand({batch, steps, x.size(2)}));
+    }
+    
+    // Входная проекция сразу для всех шагов
+    auto projected = input_projection.forward(input.reshape({batch * steps, x.size(2)})).view({batch, steps, -1});
+    auto hidden_size = projected.size(2) / 4;
+    
+    auto h = torch::zeros({batch, hidden_size}, x.options());
+    auto c = torch::zeros({batch, hidden_size}, x.options());
+    
+    std::vector<torch::Tensor> outputs;
+    outputs.reserve(steps);
+    for (int64_t t = 0; t < steps; ++t) {
+        std::tie(h, c) = apply_gates(projected.select(1, t) + hidden_projection.forward(h), c);
+        outputs.push_back(h);
+    }
+    
+    auto output = torch::stack(outputs, 1);
+    if (reverse) {
+        output = output.gather(1, order.unsqueeze(2).expand({batch, steps, hidden_size}));
+    }
+    return output;
+}
+
+} // namespace formula_teacher
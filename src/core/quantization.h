@@ -0,0 +1,75 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <cstdint>
+#include <tuple>
+
+namespace formula_teacher {
+
+// Доступен ли на этой сборке LibTorch int8-бэкенд (FBGEMM или QNNPACK)
+bool quantization_supported();
+
+// Линейный слой с int8 весами и масштабом на каждый выходной канал.
+// Активации квантуются динамически на каждом вызове, умножение выполняется int8 GEMM
+class QuantizedLinear {
+public:
+    QuantizedLinear() = default;
+    QuantizedLinear(const torch::Tensor& weight, const torch::Tensor& bias);
+    
+    // input [..., in_features] -> [..., out_features], fp32
+    torch::Tensor forward(const torch::Tensor& input) const;
+    
+    // Объем весов до и после квантования
+    int64_t fp32_bytes() const { return original_bytes; }
+    int64_t int8_bytes() const { return quantized_bytes; }
+    
+private:
+    // Упакованные веса quantized::linear_prepack
+    c10::IValue packed;
+    
+    int64_t original_bytes = 0;
+    int64_t quantized_bytes = 0;
+};
+
+// Одно направление LSTM с int8 весами (порядок гейтов как в torch::nn::LSTM: i, f, g, o)
+class QuantizedLSTMDirection {
+public:
+    QuantizedLSTMDirection() = default;
+    QuantizedLSTMDirection(const torch::Tensor& weight_ih, const torch::Tensor& weight_hh,
+                           const torch::Tensor& bias_ih, const torch::Tensor& bias_hh);
+    
+    // Один шаг ячейки: x [B, in], h и c [B, H] -> новые (h, c)
+    std::tuple<torch::Tensor, torch::Tensor> cell(const torch::Tensor& x, const torch::Tensor& h,
+                                                  const torch::Tensor& c) const;
+    
+    // Проход по батчу [B, S, in] с нулевого состояния -> [B, S, H].
+    // При reverse каждая строка обходится с конца своей длины (lengths может быть не задан)
+    torch::Tensor run(const torch::Tensor& x, const torch::Tensor& lengths, bool reverse) const;
+    
+    int64_t fp32_bytes() const { return input_projection.fp32_bytes() + hidden_projection.fp32_bytes(); }
+    int64_t int8_bytes() const { return input_projection.int8_bytes() + hidden_projection.int8_bytes(); }
+    
+private:
+    // Применение гейтов [B, 4H] к состоянию ячейки c -> (h, c)
+    static std::tuple<torch::Tensor, torch::Tensor> apply_gates(const torch::Tensor& gates, const torch::Tensor& c);
+    
+    // Вход проецируется вместе с обоими смещениями, скрытое состояние - без смещения
+    QuantizedLinear input_projection;
+    QuantizedLinear hidden_projection;
+};
+
+// Отчет о расхождении int8 и fp32 на пробных входах
+struct QuantizationReport {
+    // Максимальное и среднее абсолютное отклонение логитов
+    double max_logit_error = 0.0;
+    double mean_logit_error = 0.0;
+    
+    // Доля шагов, на которых совпал самый вероятный токен
+    double token_agreement = 1.0;
+    
+    // Объем квантованных матриц до и после
+    int64_t fp32_bytes = 0;
+    int64_t int8_bytes = 0;
+};
+
+} // namespace formula_teacher
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+namespace formula_teacher {
+
+// Класс приоритета запроса в очереди движка. Значения входят в C API и протокол демона,
+// порядок не менять: меньшее значение - более срочный класс
+enum class RequestPriority {
+    // Пользователь ждет ответа в окне приложения
+    Interactive = 0,
+    Normal = 1,
+    // Пакетные задачи, занимают свободные мощности
+    Background = 2
+};
+
+const int REQUEST_PRIORITY_COUNT = 3;
+
+// Класс по числу из C API или протокола, неизвестные значения - Normal
+inline RequestPriority request_priority_from_int(int value) {
+    return value >= 0 && value < REQUEST_PRIORITY_COUNT ? static_cast<RequestPriority>(value)
+                                                        : RequestPriority::Normal;
+}
+
+// Признак отмены запроса. Выставляется из любого потока, декодер проверяет его между шагами
+class CancellationToken {
+public:
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool is_cancelled() const { return cancelled.load(std::memory_order_relaxed); }
+    
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+// Ограничения одного запроса: срок и отмена. По умолчанию ограничений нет
+struct RequestLimits {
+    using Clock = std::chrono::steady_clock;
+    
+    Clock::time_point deadline = Clock::time_point::max();
+    std::shared_ptr<const CancellationToken> cancellation;
+    
+    // Точка вытеснения между шагами декодера: исполнитель может решить в ней более
+    // срочные запросы и вернуться к этому. Пустая - без вытеснения
+    std::function<void()> preemption_point;
+    
+    // Срок через timeout от текущего момента, неположительный timeout - без срока
+    static RequestLimits with_timeout(std::chrono::milliseconds timeout) {
+        RequestLimits limits;
+        if (timeout.count() > 0) {
+            limits.deadline = Clock::now() + timeout;
+        }
+        return limits;
+    }
+    
+    bool cancelled() const { return cancellation && cancellation->is_cancelled(); }
+    bool expired() const { return deadline != Clock::time_point::max() && Clock::now() >= deadline; }
+    
+    // Пора ли прекратить генерацию
+    bool should_stop() const { return cancelled() || expired(); }
+    
+    // Граница шага декодера: точка вытеснения, затем проверка срока и отмены
+    bool step_boundary() const {
+        if (preemption_point) {
+            preemption_point();
+        }
+        return should_stop();
+    }
+};
+
+} // namespace formula_teacher
@@ -0,0 +1,168 @@
+#include "scripted_model.h"
+#include <torch/csrc/jit/codegen/fuser/interface.h>
+#include <torch/csrc/jit/passes/freeze_module.h>
+#include <torch/csrc/jit/passes/frozen_graph_optimizations.h>
+#include <utility>
+
+namespace formula_teacher {
+
+namespace {
+
+// Параметры FormulaModel и имена, под которыми они хранятся в TorchScript-модуле
+const std::vector<std::pair<std::string, std::string>> PARAMETER_NAMES = {
+    {"encoder.embedding.weight", "encoder_embedding"},
+    {"encoder.lstm.weight_ih_l0", "encoder_w_ih"},
+    {"encoder.lstm.weight_hh_l0", "encoder_w_hh"},
+    {"encoder.lstm.bias_ih_l0", "encoder_b_ih"},
+    {"encoder.lstm.bias_hh_l0", "encoder_b_hh"},
+    {"encoder.lstm.weight_ih_l0_reverse", "encoder_w_ih_reverse"},
+    {"encoder.lstm.weight_hh_l0_reverse", "encoder_w_hh_reverse"},
+    {"encoder.lstm.bias_ih_l0_reverse", "encoder_b_ih_reverse"},
+    {"encoder.lstm.bias_hh_l0_reverse", "encoder_b_hh_reverse"},
+    {"encoder.fc.weight", "encoder_fc_weight"},
+    {"encoder.fc.bias", "encoder_fc_bias"},
+    {"decoder.embedding.weight", "decoder_embedding"},
+    {"decoder.lstm.weight_ih_l0", "decoder_w_ih"},
+    {"decoder.lstm.weight_hh_l0", "decoder_w_hh"},
+    {"decoder.lstm.bias_ih_l0", "decoder_b_ih"},
+    {"decoder.lstm.bias_hh_l0", "decoder_b_hh"},
+    {"decoder.attn.bias", "attn_bias"},
+    {"decoder.fc.weight", "decoder_fc_weight"},
+    {"decoder.fc.bias", "decoder_fc_bias"},
+};
+
+// Те же вычисления, что FormulaEncoder::forward + FormulaDecoder::init_state и FormulaDecoder::step
+const char* SCRIPT_SOURCE = R"JIT(
+def encode(self, tokens: Tensor) -> Tuple[Tensor, Tensor]:
+    embedded = torch.embedding(self.encoder_embedding, tokens)
+    zeros = torch.zeros([2, tokens.size(0), self.hidden_dim])
+    lstm_output = torch.lstm(embedded, [zeros, zeros],
+                             [self.encoder_w_ih, self.encoder_w_hh, self.encoder_b_ih, self.encoder_b_hh,
+                              self.encoder_w_ih_reverse, self.encoder_w_hh_reverse,
+                              self.encoder_b_ih_reverse, self.encoder_b_hh_reverse],
+                             True, 1, 0.0, False, True, True)
+    encoder_output = torch.linear(lstm_output[0], self.encoder_fc_weight, self.encoder_fc_bias)
+    keys = torch.linear(encoder_output, self.attn_keys_weight, self.attn_bias)
+    return encoder_output, keys
+
+def step(self, token: Tensor, encoder_output: Tensor, keys: Tensor, h: Tensor, c: Tensor) -> Tuple[Tensor, Tensor, Tensor]:
+    embedded = torch.embedding(self.decoder_embedding, token)
+    query = torch.linear(embedded, self.attn_query_weight)
+    energy = torch.tanh(keys + query.unsqueeze(1))
+    attention_weights = torch.softmax(energy.sum(2), 1)
+    context = torch.bmm(attention_weights.unsqueeze(1), encoder_output).squeeze(1)
+    rnn_input = torch.cat([embedded, context], 1)
+    next_h, next_c = torch.lstm_cell(rnn_input, [h, c], self.decoder_w_ih, self.decoder_w_hh,
+                                     self.decoder_b_ih, self.decoder_b_hh)
+    logits = torch.linear(next_h, self.decoder_fc_weight, self.decoder_fc_bias)
+    return logits, next_h, next_c
+
+def forward(self, tokens: Tensor) -> Tuple[Tensor, Tensor]:
+    return self.encode(tokens)
+)JIT";
+
+} // namespace
+
+ScriptedFormulaModel::ScriptedFormulaModel(torch::jit::Module module)
+    : module(std::move(module)),
+      encode_method(this->module.get_method("encode")),
+      step_method(this->module.get_method("step")) {
+}
+
+void ScriptedFormulaModel::export_model(FormulaModel& model, const std::string& path) {
+    torch::NoGradGuard no_grad;
+    
+    auto params = model.named_parameters();
+    
+    torch::jit::Module module("FormulaScriptedModel");
+    for (const auto& names : PARAMETER_NAMES) {
+        module.register_parameter(names.second, params[names.first].detach().clone(), false);
+    }
+    
+    // attn делится на части по эмбеддингу токена и по выходу энкодера, как в FormulaDecoder
+    auto attn_weight = params["decoder.attn.weight"].detach();
+    auto embedding_dim = params["decoder.embedding.weight"].size(1);
+    auto hidden_dim = params["encoder.fc.weight"].size(0);
+    module.register_parameter("attn_query_weight", attn_weight.narrow(1, 0, embedding_dim).clone(), false);
+    module.register_parameter("attn_keys_weight", attn_weight.narrow(1, embedding_dim, hidden_dim).clone(), false);
+    module.register_attribute("hidden_dim", c10::IntType::get(), hidden_dim);
+    
+    module.define(SCRIPT_SOURCE);
+    module.eval();
+    
+    // Заморозка превращает веса в константы графа, затем граф оптимизируется
+    // (свертка констант, слияние conv/linear с соседними операциями)
+    auto frozen = torch::jit::freeze_module(module, {"encode", "step"});
+    for (auto method : frozen.get_methods()) {
+        auto graph = method.graph();
+        torch::jit::OptimizeFrozenGraph(graph, true);
+    }
+    
+    frozen.save(path);
+}
+
+std::shared_ptr<ScriptedFormulaModel> ScriptedFormulaModel::load(const std::string& path) {
+    // Разрешаем JIT сливать поэлементные операции на CPU
+    torch::jit::overrideCanFuseOnCPU(true);
+    
+    auto module = torch::jit::load(path);
+    module.eval();
+    
+    std::shared_ptr<ScriptedFormulaModel> scripted(new ScriptedFormulaModel(std::move(module)));
+    
+    // Профилирующий исполнитель JIT специализирует и оптимизирует граф на первых вызовах,
+    // поэтому прогреваем его до первого настоящего запроса
+    for (int i = 0; i < 3; ++i) {
+        scripted->generate({FormulaTokenizer::SOS, FormulaTokenizer::UNK, FormulaTokenizer::EOS}, 4);
+    }
+    
+    return scripted;
+}
+
+std::vector<int> ScriptedFormulaModel::generate(const std::vector<int>& input_tokens, int max_length,
+                                                const TokenCallback& on_token, const RequestLimits* limits) {
+    torch::NoGradGuard no_grad;
+    
+    std::vector<int64_t> input_ids(input_tokens.begin(), input_tokens.end());
+    auto input_tensor = torch::tensor(input_ids, torch::kLong).unsqueeze(0);
+    
+    // Энкодер и ключи внимания - один вызов на запрос
+    auto encoded = encode_method({input_tensor}).toTuple();
+    auto encoder_output = encoded->elements()[0].toTensor();
+    auto keys = encoded->elements()[1].toTensor();
+    
+    auto hidden_dim = encoder_output.size(2);
+    auto h = torch::zeros({1, hidden_dim});
+    auto c = torch::zeros({1, hidden_dim});
+    
+    std::vector<int> output_tokens;
+    auto decoder_input = torch::full({1}, static_cast<int64_t>(FormulaTokenizer::SOS), torch::kLong);
+    
+    for (int i = 0; i < max_length; i++) {
+        if (limits && limits->step_boundary()) {
+            break;
+        }
+        
+        auto outputs = step_method({decoder_input, encoder_output, keys, h, c}).toTuple();
+        auto logits = outputs->elements()[0].toTensor();
+        h = outputs->elements()[1].toTensor();
+        c = outputs->elements()[2].toTensor();
+        
+        auto top_token = logits.argmax(1).item<int64_t>();
+        output_tokens.push_back(static_cast<int>(top_token));
+        if (on_token) {
+            on_token(static_cast<int>(top_token));
+        }
+        
+        // Проверка на токен конца последовательности
+        if (top_token == FormulaTokenizer::EOS) {
+            break;
+        }
+        
+        decoder_input = torch::full({1}, top_token, torch::kLong);
+    }
+    
+    return output_tokens;
+}
+
+} // namespace formula_teacher
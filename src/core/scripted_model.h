@@ -0,0 +1,36 @@
+#pragma once
+
+#include "model.h"
+#include <torch/script.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace formula_teacher {
+
+// Замороженный TorchScript-вариант FormulaModel для инференса.
+// Модуль содержит два метода: encode (энкодер и ключи внимания) и step (один шаг декодера).
+// После заморозки веса становятся константами графа, JIT сворачивает константы
+// и сливает поэлементные операции, что снижает накладные расходы на каждый токен
+class ScriptedFormulaModel {
+public:
+    // Экспорт обученной модели в замороженный TorchScript-файл
+    static void export_model(FormulaModel& model, const std::string& path);
+    
+    // Загрузка экспортированного модуля
+    static std::shared_ptr<ScriptedFormulaModel> load(const std::string& path);
+    
+    // Жадная генерация ответа, on_token вызывается после каждого шага.
+    // limits проверяются между шагами, как в FormulaModel::decode
+    std::vector<int> generate(const std::vector<int>& input_tokens, int max_length = 100,
+                              const TokenCallback& on_token = nullptr, const RequestLimits* limits = nullptr);
+    
+private:
+    explicit ScriptedFormulaModel(torch::jit::Module module);
+    
+    torch::jit::Module module;
+    torch::jit::Method encode_method;
+    torch::jit::Method step_method;
+};
+
+} // namespace formula_teacher
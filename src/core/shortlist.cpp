@@ -0,0 +1,155 @@
+#include "shortlist.h"
+#include "tokenizer.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace formula_teacher {
+
+namespace {
+
+const char SHORTLIST_MAGIC[8] = {'F', 'T', 'S', 'H', 'O', 'R', 'T', '1'};
+
+// Индексы токенов, отсортированные по убыванию счетчика, не больше limit
+std::vector<int> top_tokens(const std::unordered_map<int, int>& counts, int limit) {
+    std::vector<std::pair<int, int>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    
+    std::vector<int> tokens;
+    for (size_t i = 0; i < sorted.size() && static_cast<int>(i) < limit; ++i) {
+        tokens.push_back(sorted[i].first);
+    }
+    return tokens;
+}
+
+template <typename T>
+void write_vector(std::ofstream& file, const std::vector<T>& values) {
+    file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+template <typename T>
+void read_vector(std::ifstream& file, std::vector<T>& values, size_t count) {
+    values.resize(count);
+    file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+} // namespace
+
+VocabularyShortlist VocabularyShortlist::build(const std::vector<std::vector<int>>& sequences, int vocab_size,
+                                               int frequent_count, int neighbours_per_token) {
+    std::unordered_map<int, int> token_counts;
+    std::unordered_map<int, std::unordered_map<int, int>> cooccurrence;
+    
+    for (const auto& sequence : sequences) {
+        // Каждая пара учитывается один раз на строку
+        std::vector<int> unique(sequence.begin(), sequence.end());
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+        unique.erase(std::remove_if(unique.begin(), unique.end(),
+                                    [&](int token) { return token < 0 || token >= vocab_size; }),
+                     unique.end());
+        
+        for (int token : unique) {
+            token_counts[token]++;
+            auto& row = cooccurrence[token];
+            for (int other : unique) {
+                if (other != token) {
+                    row[other]++;
+                }
+            }
+        }
+    }
+    
+    VocabularyShortlist shortlist;
+    shortlist.vocabulary_size = vocab_size;
+    shortlist.frequent = top_tokens(token_counts, frequent_count);
+    
+    shortlist.offsets.assign(vocab_size + 1, 0);
+    for (int token = 0; token < vocab_size; ++token) {
+        auto it = cooccurrence.find(token);
+        if (it != cooccurrence.end()) {
+            auto row = top_tokens(it->second, neighbours_per_token);
+            shortlist.neighbours.insert(shortlist.neighbours.end(), row.begin(), row.end());
+        }
+        shortlist.offsets[token + 1] = static_cast<uint32_t>(shortlist.neighbours.size());
+    }
+    
+    return shortlist;
+}
+
+VocabularyShortlist VocabularyShortlist::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Не удалось открыть файл кандидатов: " + path);
+    }
+    
+    char magic[sizeof(SHORTLIST_MAGIC)];
+    int32_t vocab_size = 0;
+    uint32_t frequent_count = 0;
+    uint32_t neighbour_count = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&vocab_size), sizeof(vocab_size));
+    file.read(reinterpret_cast<char*>(&frequent_count), sizeof(frequent_count));
+    file.read(reinterpret_cast<char*>(&neighbour_count), sizeof(neighbour_count));
+    if (!file || std::memcmp(magic, SHORTLIST_MAGIC, sizeof(magic)) != 0 || vocab_size < 0) {
+        throw std::runtime_error("Неизвестный формат файла кандидатов: " + path);
+    }
+    
+    VocabularyShortlist shortlist;
+    shortlist.vocabulary_size = vocab_size;
+    read_vector(file, shortlist.frequent, frequent_count);
+    read_vector(file, shortlist.offsets, static_cast<size_t>(vocab_size) + 1);
+    read_vector(file, shortlist.neighbours, neighbour_count);
+    if (!file || shortlist.offsets.back() != neighbour_count ||
+        !std::is_sorted(shortlist.offsets.begin(), shortlist.offsets.end())) {
+        throw std::runtime_error("Поврежден файл кандидатов: " + path);
+    }
+    
+    return shortlist;
+}
+
+void VocabularyShortlist::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Не удалось создать файл кандидатов: " + path);
+    }
+    
+    int32_t vocab_size = vocabulary_size;
+    uint32_t frequent_count = static_cast<uint32_t>(frequent.size());
+    uint32_t neighbour_count = static_cast<uint32_t>(neighbours.size());
+    file.write(SHORTLIST_MAGIC, sizeof(SHORTLIST_MAGIC));
+    file.write(reinterpret_cast<const char*>(&vocab_size), sizeof(vocab_size));
+    file.write(reinterpret_cast<const char*>(&frequent_count), sizeof(frequent_count));
+    file.write(reinterpret_cast<const char*>(&neighbour_count), sizeof(neighbour_count));
+    write_vector(file, frequent);
+    write_vector(file, offsets);
+    write_vector(file, neighbours);
+    
+    if (!file.flush()) {
+        throw std::runtime_error("Ошибка записи файла кандидатов: " + path);
+    }
+}
+
+std::vector<int64_t> VocabularyShortlist::candidates(const std::vector<int>& input_tokens) const {
+    std::vector<int64_t> result = {FormulaTokenizer::PAD, FormulaTokenizer::SOS,
+                                   FormulaTokenizer::EOS, FormulaTokenizer::UNK};
+    result.insert(result.end(), frequent.begin(), frequent.end());
+    
+    for (int token : input_tokens) {
+        if (token < 0 || token >= vocabulary_size) {
+            continue;
+        }
+        result.push_back(token);
+        result.insert(result.end(), neighbours.begin() + offsets[token], neighbours.begin() + offsets[token + 1]);
+    }
+    
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+} // namespace formula_teacher
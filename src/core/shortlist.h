@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace formula_teacher {
+
+// Список кандидатов для выходной проекции декодера.
+// Для входа кандидаты - специальные токены, самые частые токены корпуса, токены самого входа
+// и их соседи: токены, чаще всего встречавшиеся с ними в одной строке обучающего корпуса.
+// Таблица соседей строится при обучении и хранится рядом с моделью (.shortlist)
+class VocabularyShortlist {
+public:
+    VocabularyShortlist() = default;
+    
+    // Построение по обучающим последовательностям
+    static VocabularyShortlist build(const std::vector<std::vector<int>>& sequences, int vocab_size,
+                                     int frequent_count = 2000, int neighbours_per_token = 64);
+    
+    // Загрузка и сохранение. Бросают std::runtime_error при ошибке
+    static VocabularyShortlist load(const std::string& path);
+    void save(const std::string& path) const;
+    
+    // Отсортированные без повторов индексы кандидатов для входа
+    std::vector<int64_t> candidates(const std::vector<int>& input_tokens) const;
+    
+    int vocab_size() const { return vocabulary_size; }
+    
+private:
+    int vocabulary_size = 0;
+    
+    // Самые частые токены корпуса
+    std::vector<int> frequent;
+    
+    // Соседи токена t - neighbours[offsets[t] .. offsets[t + 1])
+    std::vector<uint32_t> offsets;
+    std::vector<int> neighbours;
+};
+
+} // namespace formula_teacher
@@ -0,0 +1,358 @@
+#include "solution_cache.h"
+#include "digest.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace formula_teacher {
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'F', 'S', 'C', 'A', 'C', 'H', 'E', '1'};
+const uint32_t CACHE_VERSION = 1;
+
+// Записи начинаются после заголовка с выравниванием на 64 байта
+const uint64_t DATA_START = 64;
+
+// Минимальный размер файла и число ячеек индекса
+const size_t MIN_CAPACITY = 1 << 16;
+const size_t MIN_SLOTS = 1024;
+
+static_assert(sizeof(int) == sizeof(int32_t), "токены хранятся как int32");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "заголовок кэша требует lock-free атомиков");
+
+uint64_t align8(uint64_t value) {
+    return (value + 7) & ~uint64_t(7);
+}
+
+size_t next_power_of_two(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+std::unique_ptr<SolutionCache> SolutionCache::open(const std::string& path, size_t capacity_bytes) {
+    std::unique_ptr<SolutionCache> cache(new SolutionCache());
+    cache->path = path;
+    
+    cache->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    cache->writable = true;
+    if (cache->fd < 0) {
+        cache->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        cache->writable = false;
+    }
+    if (cache->fd < 0) {
+        throw std::runtime_error("Не удалось открыть файл кэша решений: " + path);
+    }
+    
+    // Писатель у файла может быть только один, остальные процессы только читают
+    if (cache->writable && flock(cache->fd, LOCK_EX | LOCK_NB) != 0) {
+        cache->writable = false;
+    }
+    
+    // Читатель, открывший файл раньше, чем писатель записал заголовок, считает кэш пустым
+    // и повторяет отображение при следующем поиске
+    if (!cache->writable) {
+        cache->attach();
+        return cache;
+    }
+    
+    struct stat file_stat;
+    if (fstat(cache->fd, &file_stat) != 0) {
+        throw std::runtime_error("Не удалось получить размер файла кэша решений: " + path);
+    }
+    
+    bool created = file_stat.st_size == 0;
+    if (created) {
+        cache->mapping_size = std::max(capacity_bytes, MIN_CAPACITY);
+        if (ftruncate(cache->fd, static_cast<off_t>(cache->mapping_size)) != 0) {
+            throw std::runtime_error("Не удалось выделить место под кэш решений: " + path);
+        }
+        
+        void* mapping = mmap(nullptr, cache->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Не удалось отобразить кэш решений в память: " + path);
+        }
+        cache->mapping = static_cast<unsigned char*>(mapping);
+        
+        // Магия пишется последней: читатель не примет файл с недописанным заголовком
+        FileHeader* file_header = new (cache->mapping) FileHeader{};
+        file_header->version = CACHE_VERSION;
+        file_header->capacity = cache->mapping_size;
+        file_header->used.store(DATA_START, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(file_header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        
+        munmap(cache->mapping, cache->mapping_size);
+        cache->mapping = nullptr;
+    }
+    
+    // Файл писателя готов всегда: пустой он только что создал, остальные обязаны быть целыми
+    if (!cache->attach()) {
+        throw std::runtime_error("Неизвестный формат файла кэша решений: " + path);
+    }
+    
+    return cache;
+}
+
+bool SolutionCache::attach() {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        throw std::runtime_error("Не удалось получить размер файла кэша решений: " + path);
+    }
+    
+    size_t file_size = static_cast<size_t>(file_stat.st_size);
+    if (file_size < DATA_START) {
+        // Пустой файл у читателя - писатель его еще создает
+        if (!writable) {
+            return false;
+        }
+        throw std::runtime_error("Поврежден файл кэша решений: " + path);
+    }
+    
+    int protection = PROT_READ | (writable ? PROT_WRITE : 0);
+    void* file_mapping = mmap(nullptr, file_size, protection, MAP_SHARED, fd, 0);
+    if (file_mapping == MAP_FAILED) {
+        throw std::runtime_error("Не удалось отобразить кэш решений в память: " + path);
+    }
+    
+    const FileHeader* file_header = reinterpret_cast<const FileHeader*>(file_mapping);
+    char magic[sizeof(CACHE_MAGIC)];
+    std::memcpy(magic, file_header->magic, sizeof(magic));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    
+    if (std::memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        file_header->version != CACHE_VERSION ||
+        file_header->capacity != file_size) {
+        munmap(file_mapping, file_size);
+        
+        // Нулевая магия у читателя - писатель еще не дописал заголовок
+        static const char NO_MAGIC[sizeof(CACHE_MAGIC)] = {};
+        if (!writable && std::memcmp(magic, NO_MAGIC, sizeof(magic)) == 0) {
+            return false;
+        }
+        throw std::runtime_error("Неизвестный формат файла кэша решений: " + path);
+    }
+    
+    mapping = static_cast<unsigned char*>(file_mapping);
+    mapping_size = file_size;
+    
+    // Запись с SOS и EOS занимает не меньше 56 байт, поэтому индекса на capacity / 32 ячеек
+    // хватает до заполнения файла
+    size_t slot_count = next_power_of_two(std::max(MIN_SLOTS, mapping_size / 32));
+    slots.reset(new std::atomic<uint64_t>[slot_count]);
+    for (size_t i = 0; i < slot_count; ++i) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+    slot_mask = slot_count - 1;
+    
+    uint64_t used = header()->used.load(std::memory_order_acquire);
+    if (used < DATA_START || used > mapping_size) {
+        used = DATA_START;
+    }
+    uint64_t offset = index_records(DATA_START, used);
+    
+    // Недописанный хвост (например, после аварийного завершения) отбрасываем
+    if (writable && offset != header()->used.load(std::memory_order_relaxed)) {
+        header()->used.store(offset, std::memory_order_release);
+    }
+    
+    indexed_end.store(offset, std::memory_order_relaxed);
+    attached.store(true, std::memory_order_release);
+    return true;
+}
+
+SolutionCache::~SolutionCache() {
+    if (mapping) {
+        if (writable) {
+            msync(mapping, mapping_size, MS_ASYNC);
+        }
+        munmap(mapping, mapping_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+uint64_t SolutionCache::hash_key(const SolutionKey& key) {
+    uint64_t hash = digest_bytes(&key.model_digest, sizeof(key.model_digest));
+    hash = digest_bytes(&key.vocabulary_digest, sizeof(key.vocabulary_digest), hash);
+    hash = digest_bytes(&key.options_digest, sizeof(key.options_digest), hash);
+    return digest_bytes(key.input_tokens->data(), key.input_tokens->size() * sizeof(int), hash);
+}
+
+bool SolutionCache::matches(uint64_t offset, uint64_t hash, const SolutionKey& key) const {
+    RecordHeader record;
+    std::memcpy(&record, mapping + offset, sizeof(record));
+    
+    if (record.key_hash != hash ||
+        record.model_digest != key.model_digest ||
+        record.vocabulary_digest != key.vocabulary_digest ||
+        record.options_digest != key.options_digest ||
+        record.token_count != key.input_tokens->size()) {
+        return false;
+    }
+    
+    return std::memcmp(mapping + offset + sizeof(record), key.input_tokens->data(),
+                       record.token_count * sizeof(int)) == 0;
+}
+
+bool SolutionCache::find(uint64_t hash, const SolutionKey& key, std::string& solution) const {
+    size_t slot = hash & slot_mask;
+    for (size_t probe = 0; probe <= slot_mask; ++probe) {
+        uint64_t offset = slots[slot].load(std::memory_order_acquire);
+        if (offset == 0) {
+            return false;
+        }
+        
+        if (matches(offset, hash, key)) {
+            RecordHeader record;
+            std::memcpy(&record, mapping + offset, sizeof(record));
+            const char* text = reinterpret_cast<const char*>(
+                mapping + offset + sizeof(record) + record.token_count * sizeof(int));
+            solution.assign(text, record.solution_size);
+            return true;
+        }
+        
+        slot = (slot + 1) & slot_mask;
+    }
+    
+    return false;
+}
+
+bool SolutionCache::lookup(const SolutionKey& key, std::string& solution) {
+    if (!attached.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        try {
+            if (!attached.load(std::memory_order_relaxed) && !attach()) {
+                return false;
+            }
+        } catch (const std::exception&) {
+            // Чужой формат файла у читателя - просто промах, как у пустого кэша
+            return false;
+        }
+    }
+    
+    uint64_t hash = hash_key(key);
+    if (find(hash, key, solution)) {
+        return true;
+    }
+    
+    // Читатель не видит вставок писателя, пока не проиндексирует дописанные записи
+    return catch_up() && find(hash, key, solution);
+}
+
+bool SolutionCache::catch_up() {
+    if (writable) {
+        return false;
+    }
+    
+    uint64_t used = std::min<uint64_t>(header()->used.load(std::memory_order_acquire), mapping_size);
+    if (used <= indexed_end.load(std::memory_order_acquire)) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(index_mutex);
+    uint64_t from = indexed_end.load(std::memory_order_relaxed);
+    if (used <= from) {
+        return true;
+    }
+    uint64_t offset = index_records(from, used);
+    indexed_end.store(offset, std::memory_order_release);
+    return offset != from;
+}
+
+bool SolutionCache::index_record(uint64_t hash, uint64_t offset) {
+    // Индекс заполняется не более чем на 70%, иначе поиск промахов станет долгим
+    if ((record_count.load(std::memory_order_relaxed) + 1) * 10 > (slot_mask + 1) * 7) {
+        return false;
+    }
+    
+    size_t slot = hash & slot_mask;
+    while (true) {
+        uint64_t expected = 0;
+        if (slots[slot].compare_exchange_strong(expected, offset, std::memory_order_release)) {
+            record_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        slot = (slot + 1) & slot_mask;
+    }
+}
+
+bool SolutionCache::insert(const SolutionKey& key, const std::string& solution) {
+    if (!writable) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(write_mutex);
+    
+    // Решение могло быть добавлено другим потоком
+    std::string existing;
+    if (lookup(key, existing)) {
+        return true;
+    }
+    
+    size_t tokens_size = key.input_tokens->size() * sizeof(int);
+    uint64_t record_size = align8(sizeof(RecordHeader) + tokens_size + solution.size());
+    if (record_size > UINT32_MAX) {
+        return false;
+    }
+    
+    uint64_t offset = header()->used.load(std::memory_order_acquire);
+    if (offset + record_size > mapping_size) {
+        return false;
+    }
+    
+    RecordHeader record{};
+    record.record_size = static_cast<uint32_t>(record_size);
+    record.token_count = static_cast<uint32_t>(key.input_tokens->size());
+    record.solution_size = static_cast<uint32_t>(solution.size());
+    record.key_hash = hash_key(key);
+    record.model_digest = key.model_digest;
+    record.vocabulary_digest = key.vocabulary_digest;
+    record.options_digest = key.options_digest;
+    
+    // Сначала запись целиком, затем публикация размера и смещения в индексе
+    std::memcpy(mapping + offset, &record, sizeof(record));
+    std::memcpy(mapping + offset + sizeof(record), key.input_tokens->data(), tokens_size);
+    std::memcpy(mapping + offset + sizeof(record) + tokens_size, solution.data(), solution.size());
+    
+    if (!index_record(record.key_hash, offset)) {
+        return false;
+    }
+    header()->used.store(offset + record_size, std::memory_order_release);
+    
+    return true;
+}
+
+uint64_t SolutionCache::index_records(uint64_t from, uint64_t used) {
+    uint64_t offset = from;
+    while (offset + sizeof(RecordHeader) <= used) {
+        RecordHeader record;
+        std::memcpy(&record, mapping + offset, sizeof(record));
+        
+        uint64_t payload = sizeof(RecordHeader) + uint64_t(record.token_count) * sizeof(int) + record.solution_size;
+        if (record.record_size < payload || record.record_size != align8(record.record_size) ||
+            offset + record.record_size > used) {
+            break;
+        }
+        
+        if (!index_record(record.key_hash, offset)) {
+            break;
+        }
+        offset += record.record_size;
+    }
+    return offset;
+}
+
+} // namespace formula_teacher
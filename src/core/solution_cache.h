@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace formula_teacher {
+
+// Ключ кэша решений: модель, словарь, параметры генерации и токены задачи
+struct SolutionKey {
+    uint64_t model_digest = 0;
+    uint64_t vocabulary_digest = 0;
+    uint64_t options_digest = 0;
+    const std::vector<int>* input_tokens = nullptr;
+};
+
+// Постоянный кэш решений в файле, отображенном в память.
+// Записи только дописываются в конец файла и переживают перезапуск процесса.
+// Поиск не берет блокировок: индекс - открытая адресация на атомарных смещениях,
+// смещение публикуется только после того, как запись целиком скопирована в файл.
+// Писать в один файл может только один процесс, остальные открывают его для чтения:
+// при промахе читатель индексирует записи, дописанные писателем после прошлой проверки,
+// а файл, который писатель еще создает, считается пустым кэшем до следующего поиска
+class SolutionCache {
+public:
+    // Открытие или создание файла кэша. capacity_bytes - размер нового файла,
+    // у существующего файла размер берется из заголовка
+    static std::unique_ptr<SolutionCache> open(const std::string& path, size_t capacity_bytes);
+    
+    ~SolutionCache();
+    
+    SolutionCache(const SolutionCache&) = delete;
+    SolutionCache& operator=(const SolutionCache&) = delete;
+    
+    // Поиск решения. Попадание не берет блокировок, промах у читателя
+    // берет блокировку индекса, если писатель дописал новые записи
+    bool lookup(const SolutionKey& key, std::string& solution);
+    
+    // Добавление решения. Возвращает false, если файл или индекс заполнены
+    // либо кэш открыт только для чтения
+    bool insert(const SolutionKey& key, const std::string& solution);
+    
+    // Количество записей
+    size_t size() const { return record_count.load(std::memory_order_relaxed); }
+    
+    bool is_writable() const { return writable; }
+    
+private:
+    SolutionCache() = default;
+    
+    // Заголовок файла
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t capacity;
+        std::atomic<uint64_t> used;
+    };
+    
+    // Заголовок записи, за ним следуют токены (int32) и текст решения
+    struct RecordHeader {
+        uint32_t record_size;
+        uint32_t token_count;
+        uint32_t solution_size;
+        uint32_t reserved;
+        uint64_t key_hash;
+        uint64_t model_digest;
+        uint64_t vocabulary_digest;
+        uint64_t options_digest;
+    };
+    
+    static uint64_t hash_key(const SolutionKey& key);
+    
+    // Совпадает ли запись по смещению offset с ключом
+    bool matches(uint64_t offset, uint64_t hash, const SolutionKey& key) const;
+    
+    // Поиск по уже проиндексированным записям
+    bool find(uint64_t hash, const SolutionKey& key, std::string& solution) const;
+    
+    // Вставка смещения в индекс
+    bool index_record(uint64_t hash, uint64_t offset);
+    
+    // Индексирование целых записей от from до used, возвращает конец последней из них
+    uint64_t index_records(uint64_t from, uint64_t used);
+    
+    // Отображение файла и индекс по его записям. false - файл еще не готов
+    // (читатель открыл его раньше, чем писатель записал заголовок)
+    bool attach();
+    
+    // Индексирование записей, дописанных писателем. true, если добавились новые
+    bool catch_up();
+    
+    FileHeader* header() const { return reinterpret_cast<FileHeader*>(mapping); }
+    
+    std::string path;
+    int fd = -1;
+    bool writable = false;
+    unsigned char* mapping = nullptr;
+    size_t mapping_size = 0;
+    
+    // Файл отображен и индекс построен: до этого читатель отвечает промахом
+    std::atomic<bool> attached{false};
+    
+    // Конец проиндексированных записей и блокировка, под которой читатель их догоняет
+    std::atomic<uint64_t> indexed_end{0};
+    std::mutex index_mutex;
+    
+    // Индекс: смещения записей, 0 - пустая ячейка
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    size_t slot_mask = 0;
+    std::atomic<size_t> record_count{0};
+    
+    // Сериализация писателей внутри процесса
+    std::mutex write_mutex;
+};
+
+} // namespace formula_teacher
@@ -0,0 +1,1518 @@
+#include "symbolic.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <regex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace formula_teacher {
+
+namespace {
+
+// Промежуточные произведения рациональной арифметики (расширение GCC и Clang)
+__extension__ typedef __int128 wide_int;
+
+// Рациональное число: несократимая дробь с положительным знаменателем.
+// Бросает std::overflow_error, если результат не помещается в int64_t
+class Rational {
+public:
+    Rational(int64_t numerator = 0, int64_t denominator = 1) { set(numerator, denominator); }
+    
+    int64_t num() const { return numerator; }
+    int64_t den() const { return denominator; }
+    
+    bool is_zero() const { return numerator == 0; }
+    bool is_negative() const { return numerator < 0; }
+    bool is_integer() const { return denominator == 1; }
+    
+    Rational operator-() const { return from(-static_cast<wide_int>(numerator), denominator); }
+    Rational operator+(const Rational& other) const {
+        return from(static_cast<wide_int>(numerator) * other.denominator +
+                    static_cast<wide_int>(other.numerator) * denominator,
+                    static_cast<wide_int>(denominator) * other.denominator);
+    }
+    Rational operator-(const Rational& other) const { return *this + (-other); }
+    Rational operator*(const Rational& other) const {
+        return from(static_cast<wide_int>(numerator) * other.numerator,
+                    static_cast<wide_int>(denominator) * other.denominator);
+    }
+    Rational operator/(const Rational& other) const {
+        if (other.is_zero()) {
+            throw std::domain_error("Деление на ноль");
+        }
+        return from(static_cast<wide_int>(numerator) * other.denominator,
+                    static_cast<wide_int>(denominator) * other.numerator);
+    }
+    
+    bool operator==(const Rational& other) const {
+        return numerator == other.numerator && denominator == other.denominator;
+    }
+    bool operator!=(const Rational& other) const { return !(*this == other); }
+    bool operator<(const Rational& other) const {
+        return static_cast<wide_int>(numerator) * other.denominator <
+               static_cast<wide_int>(other.numerator) * denominator;
+    }
+    
+    Rational abs() const { return is_negative() ? -*this : *this; }
+    
+private:
+    static Rational from(wide_int numerator, wide_int denominator) {
+        Rational result;
+        result.set(numerator, denominator);
+        return result;
+    }
+    
+    void set(wide_int new_numerator, wide_int new_denominator) {
+        if (new_denominator == 0) {
+            throw std::domain_error("Деление на ноль");
+        }
+        if (new_denominator < 0) {
+            new_numerator = -new_numerator;
+            new_denominator = -new_denominator;
+        }
+        
+        wide_int a = new_numerator < 0 ? -new_numerator : new_numerator;
+        wide_int b = new_denominator;
+        while (b != 0) {
+            wide_int t = a % b;
+            a = b;
+            b = t;
+        }
+        if (a > 1) {
+            new_numerator /= a;
+            new_denominator /= a;
+        }
+        
+        if (new_numerator > INT64_MAX || new_numerator < -INT64_MAX || new_denominator > INT64_MAX) {
+            throw std::overflow_error("Переполнение в рациональной арифметике");
+        }
+        numerator = static_cast<int64_t>(new_numerator);
+        denominator = static_cast<int64_t>(new_denominator);
+    }
+    
+    int64_t numerator = 0;
+    int64_t denominator = 1;
+};
+
+// Наибольший показатель степени числа и наибольшая степень корня
+const int64_t MAX_EXPONENT = 64;
+
+// Целый корень степени degree, если он точный
+bool exact_root(int64_t value, int64_t degree, int64_t& root) {
+    if (value < 0 || degree < 1) {
+        return false;
+    }
+    if (value <= 1) {
+        root = value;
+        return true;
+    }
+    
+    // Двоичный поиск r с r^degree = value
+    int64_t low = 0;
+    int64_t high = std::min<int64_t>(value, 3037000499LL) + 1;
+    while (low < high) {
+        int64_t middle = low + (high - low) / 2;
+        wide_int power = 1;
+        for (int64_t i = 0; i < degree && power <= value; ++i) {
+            power *= middle;
+        }
+        if (power < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    wide_int power = 1;
+    for (int64_t i = 0; i < degree && power <= value; ++i) {
+        power *= low;
+    }
+    root = low;
+    return power == value;
+}
+
+enum class Kind {
+    Number,
+    Variable,
+    Sum,
+    Product,
+    Power,
+    Function
+};
+
+enum class Function {
+    Sin,
+    Cos,
+    Exp,
+    Ln,
+    Abs
+};
+
+struct Node;
+using NodePtr = std::shared_ptr<const Node>;
+
+// Узел выражения от одной переменной. Узлы создаются только функциями make_*,
+// которые сразу приводят выражение к канонической форме, и больше не меняются
+struct Node {
+    Kind kind = Kind::Number;
+    
+    // Значение числа или показатель степени
+    Rational value;
+    
+    Function function = Function::Sin;
+    
+    // Слагаемые, множители (число - первым), основание степени или аргумент функции
+    std::vector<NodePtr> args;
+    
+    // Структурный ключ: равные выражения имеют равные ключи
+    std::string key;
+};
+
+std::string rational_key(const Rational& value) {
+    return std::to_string(value.num()) + "/" + std::to_string(value.den());
+}
+
+const char* function_name(Function function) {
+    switch (function) {
+        case Function::Sin: return "sin";
+        case Function::Cos: return "cos";
+        case Function::Exp: return "exp";
+        case Function::Ln: return "ln";
+        case Function::Abs: return "abs";
+    }
+    return "?";
+}
+
+NodePtr node(Kind kind, Rational value, Function function, std::vector<NodePtr> args) {
+    auto result = std::make_shared<Node>();
+    result->kind = kind;
+    result->value = value;
+    result->function = function;
+    result->args = std::move(args);
+    
+    std::string inner;
+    for (const auto& arg : result->args) {
+        inner += (inner.empty() ? "" : ",") + arg->key;
+    }
+    switch (kind) {
+        case Kind::Number: result->key = "#" + rational_key(value); break;
+        case Kind::Variable: result->key = "x"; break;
+        case Kind::Sum: result->key = "+(" + inner + ")"; break;
+        case Kind::Product: result->key = "*(" + inner + ")"; break;
+        case Kind::Power: result->key = "^(" + inner + "," + rational_key(value) + ")"; break;
+        case Kind::Function: result->key = std::string(function_name(function)) + "(" + inner + ")"; break;
+    }
+    return result;
+}
+
+NodePtr number(const Rational& value) {
+    return node(Kind::Number, value, Function::Sin, {});
+}
+
+NodePtr variable() {
+    return node(Kind::Variable, Rational(), Function::Sin, {});
+}
+
+bool is_number(const NodePtr& expression, const Rational& value) {
+    return expression->kind == Kind::Number && expression->value == value;
+}
+
+NodePtr make_sum(const std::vector<NodePtr>& terms);
+NodePtr make_product(const std::vector<NodePtr>& factors);
+NodePtr make_power(const NodePtr& base, const Rational& exponent);
+NodePtr make_function(Function function, const NodePtr& arg);
+
+// Коэффициент слагаемого и остальная часть (nullptr у числа)
+std::pair<Rational, NodePtr> split_coefficient(const NodePtr& term) {
+    if (term->kind == Kind::Number) {
+        return {term->value, nullptr};
+    }
+    if (term->kind == Kind::Product && term->args.front()->kind == Kind::Number) {
+        std::vector<NodePtr> rest(term->args.begin() + 1, term->args.end());
+        return {term->args.front()->value,
+                rest.size() == 1 ? rest.front() : node(Kind::Product, Rational(), Function::Sin, rest)};
+    }
+    return {Rational(1), term};
+}
+
+// Степень x у слагаемого x или x^n, иначе false
+bool monomial_degree(const NodePtr& rest, Rational& degree) {
+    if (rest->kind == Kind::Variable) {
+        degree = Rational(1);
+        return true;
+    }
+    if (rest->kind == Kind::Power && rest->args.front()->kind == Kind::Variable) {
+        degree = rest->value;
+        return true;
+    }
+    return false;
+}
+
+// Порядок слагаемых: степени x по убыванию, затем остальные, число последним
+bool term_before(const NodePtr& a, const NodePtr& b) {
+    auto rest_a = split_coefficient(a).second;
+    auto rest_b = split_coefficient(b).second;
+    Rational degree_a;
+    Rational degree_b;
+    bool monomial_a = monomial_degree(rest_a, degree_a);
+    bool monomial_b = monomial_degree(rest_b, degree_b);
+    if (monomial_a != monomial_b) {
+        return monomial_a;
+    }
+    if (monomial_a) {
+        return degree_b < degree_a;
+    }
+    return rest_a->key < rest_b->key;
+}
+
+// Порядок множителей: степени x, затем функции, затем остальные
+int factor_rank(const NodePtr& factor) {
+    const NodePtr& base = factor->kind == Kind::Power ? factor->args.front() : factor;
+    switch (base->kind) {
+        case Kind::Number: return 0;
+        case Kind::Variable: return 1;
+        case Kind::Function: return 2;
+        default: return 3;
+    }
+}
+
+NodePtr make_sum(const std::vector<NodePtr>& terms) {
+    std::vector<NodePtr> flat;
+    for (const auto& term : terms) {
+        if (term->kind == Kind::Sum) {
+            flat.insert(flat.end(), term->args.begin(), term->args.end());
+        } else {
+            flat.push_back(term);
+        }
+    }
+    
+    // Подобные слагаемые складываются по ключу остальной части
+    Rational constant;
+    std::vector<std::pair<NodePtr, Rational>> groups;
+    std::map<std::string, size_t> group_index;
+    for (const auto& term : flat) {
+        auto [coefficient, rest] = split_coefficient(term);
+        if (!rest) {
+            constant = constant + coefficient;
+            continue;
+        }
+        auto it = group_index.find(rest->key);
+        if (it == group_index.end()) {
+            group_index.emplace(rest->key, groups.size());
+            groups.emplace_back(rest, coefficient);
+        } else {
+            groups[it->second].second = groups[it->second].second + coefficient;
+        }
+    }
+    
+    std::vector<NodePtr> result;
+    for (const auto& [rest, coefficient] : groups) {
+        if (!coefficient.is_zero()) {
+            result.push_back(make_product({number(coefficient), rest}));
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), term_before);
+    if (!constant.is_zero()) {
+        result.push_back(number(constant));
+    }
+    
+    if (result.empty()) {
+        return number(Rational(0));
+    }
+    if (result.size() == 1) {
+        return result.front();
+    }
+    return node(Kind::Sum, Rational(), Function::Sin, result);
+}
+
+NodePtr make_product(const std::vector<NodePtr>& factors) {
+    // Числа перемножаются, степени одного основания складываются по показателям
+    Rational coefficient(1);
+    std::vector<std::pair<NodePtr, Rational>> bases;
+    std::map<std::string, size_t> base_index;
+    
+    std::vector<NodePtr> pending(factors.rbegin(), factors.rend());
+    while (!pending.empty()) {
+        NodePtr factor = pending.back();
+        pending.pop_back();
+        
+        if (factor->kind == Kind::Product) {
+            pending.insert(pending.end(), factor->args.rbegin(), factor->args.rend());
+            continue;
+        }
+        if (factor->kind == Kind::Number) {
+            coefficient = coefficient * factor->value;
+            continue;
+        }
+        
+        NodePtr base = factor->kind == Kind::Power ? factor->args.front() : factor;
+        Rational exponent = factor->kind == Kind::Power ? factor->value : Rational(1);
+        auto it = base_index.find(base->key);
+        if (it == base_index.end()) {
+            base_index.emplace(base->key, bases.size());
+            bases.emplace_back(base, exponent);
+        } else {
+            bases[it->second].second = bases[it->second].second + exponent;
+        }
+    }
+    
+    if (coefficient.is_zero()) {
+        return number(Rational(0));
+    }
+    
+    std::vector<NodePtr> result;
+    for (const auto& [base, exponent] : bases) {
+        if (exponent.is_zero()) {
+            continue;
+        }
+        auto power = make_power(base, exponent);
+        if (power->kind == Kind::Number) {
+            coefficient = coefficient * power->value;
+        } else {
+            result.push_back(power);
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const NodePtr& a, const NodePtr& b) {
+        int rank_a = factor_rank(a);
+        int rank_b = factor_rank(b);
+        return rank_a != rank_b ? rank_a < rank_b : a->key < b->key;
+    });
+    
+    if (coefficient.is_zero()) {
+        return number(Rational(0));
+    }
+    if (result.empty()) {
+        return number(coefficient);
+    }
+    if (coefficient == Rational(1) && result.size() == 1) {
+        return result.front();
+    }
+    if (coefficient != Rational(1)) {
+        result.insert(result.begin(), number(coefficient));
+    }
+    return node(Kind::Product, Rational(), Function::Sin, result);
+}
+
+NodePtr make_power(const NodePtr& base, const Rational& exponent) {
+    if (exponent.is_zero()) {
+        return number(Rational(1));
+    }
+    if (exponent == Rational(1)) {
+        return base;
+    }
+    if (exponent.den() > MAX_EXPONENT) {
+        throw std::overflow_error("Слишком большая степень корня");
+    }
+    
+    switch (base->kind) {
+        case Kind::Number: {
+            const Rational& value = base->value;
+            if (value.is_zero()) {
+                if (exponent.is_negative()) {
+                    throw std::domain_error("Деление на ноль");
+                }
+                return number(Rational(0));
+            }
+            
+            // Дробный показатель: точный корень, если он есть
+            if (!exponent.is_integer()) {
+                int64_t numerator_root;
+                int64_t denominator_root;
+                if (value.is_negative() ||
+                    !exact_root(value.num(), exponent.den(), numerator_root) ||
+                    !exact_root(value.den(), exponent.den(), denominator_root)) {
+                    if (value.is_negative()) {
+                        throw std::domain_error("Корень из отрицательного числа");
+                    }
+                    return node(Kind::Power, exponent, Function::Sin, {base});
+                }
+                return make_power(number(Rational(numerator_root, denominator_root)), Rational(exponent.num()));
+            }
+            
+            if (exponent.num() > MAX_EXPONENT || exponent.num() < -MAX_EXPONENT) {
+                throw std::overflow_error("Слишком большой показатель степени");
+            }
+            Rational result(1);
+            for (int64_t i = 0; i < (exponent.is_negative() ? -exponent.num() : exponent.num()); ++i) {
+                result = result * value;
+            }
+            return number(exponent.is_negative() ? Rational(1) / result : result);
+        }
+        case Kind::Power:
+            if (exponent.is_integer()) {
+                return make_power(base->args.front(), base->value * exponent);
+            }
+            break;
+        case Kind::Product:
+            if (exponent.is_integer()) {
+                std::vector<NodePtr> powers;
+                for (const auto& factor : base->args) {
+                    powers.push_back(make_power(factor, exponent));
+                }
+                return make_product(powers);
+            }
+            break;
+        case Kind::Function:
+            if (base->function == Function::Exp) {
+                return make_function(Function::Exp, make_product({number(exponent), base->args.front()}));
+            }
+            break;
+        default:
+            break;
+    }
+    return node(Kind::Power, exponent, Function::Sin, {base});
+}
+
+NodePtr make_function(Function function, const NodePtr& arg) {
+    if (arg->kind == Kind::Number) {
+        const Rational& value = arg->value;
+        if (value.is_zero()) {
+            switch (function) {
+                case Function::Sin: return number(Rational(0));
+                case Function::Cos: return number(Rational(1));
+                case Function::Exp: return number(Rational(1));
+                case Function::Ln: throw std::domain_error("Логарифм нуля");
+                case Function::Abs: return number(Rational(0));
+            }
+        }
+        if (function == Function::Ln && value == Rational(1)) {
+            return number(Rational(0));
+        }
+        if (function == Function::Abs) {
+            return number(value.abs());
+        }
+    }
+    if (function == Function::Exp && arg->kind == Kind::Function && arg->function == Function::Ln) {
+        return arg->args.front();
+    }
+    if (function == Function::Ln && arg->kind == Kind::Function && arg->function == Function::Exp) {
+        return arg->args.front();
+    }
+    return node(Kind::Function, Rational(), function, {arg});
+}
+
+bool depends_on_variable(const NodePtr& expression) {
+    if (expression->kind == Kind::Variable) {
+        return true;
+    }
+    return std::any_of(expression->args.begin(), expression->args.end(), depends_on_variable);
+}
+
+NodePtr negate(const NodePtr& expression) {
+    return make_product({number(Rational(-1)), expression});
+}
+
+NodePtr derivative(const NodePtr& expression) {
+    switch (expression->kind) {
+        case Kind::Number:
+            return number(Rational(0));
+        case Kind::Variable:
+            return number(Rational(1));
+        case Kind::Sum: {
+            std::vector<NodePtr> terms;
+            for (const auto& term : expression->args) {
+                terms.push_back(derivative(term));
+            }
+            return make_sum(terms);
+        }
+        case Kind::Product: {
+            // (fg)' = f'g + fg'
+            std::vector<NodePtr> terms;
+            for (size_t i = 0; i < expression->args.size(); ++i) {
+                std::vector<NodePtr> factors = expression->args;
+                factors[i] = derivative(factors[i]);
+                terms.push_back(make_product(factors));
+            }
+            return make_sum(terms);
+        }
+        case Kind::Power: {
+            const auto& base = expression->args.front();
+            const Rational& exponent = expression->value;
+            return make_product({number(exponent), make_power(base, exponent - Rational(1)), derivative(base)});
+        }
+        case Kind::Function: {
+            const auto& arg = expression->args.front();
+            auto inner = derivative(arg);
+            switch (expression->function) {
+                case Function::Sin:
+                    return make_product({make_function(Function::Cos, arg), inner});
+                case Function::Cos:
+                    return make_product({number(Rational(-1)), make_function(Function::Sin, arg), inner});
+                case Function::Exp:
+                    return make_product({expression, inner});
+                case Function::Ln:
+                    return make_product({make_power(arg, Rational(-1)), inner});
+                case Function::Abs:
+                    break;
+            }
+            break;
+        }
+    }
+    throw std::runtime_error("Производная не поддерживается");
+}
+
+// Наибольшая степень многочлена, до которой раскрываются скобки
+const size_t MAX_POLYNOMIAL_DEGREE = 16;
+
+// Коэффициенты многочлена по возрастанию степени, false - выражение не многочлен
+bool to_polynomial(const NodePtr& expression, std::vector<Rational>& coefficients) {
+    auto multiply = [](const std::vector<Rational>& a, const std::vector<Rational>& b) {
+        std::vector<Rational> product(a.size() + b.size() - 1);
+        for (size_t i = 0; i < a.size(); ++i) {
+            for (size_t j = 0; j < b.size(); ++j) {
+                product[i + j] = product[i + j] + a[i] * b[j];
+            }
+        }
+        return product;
+    };
+    
+    switch (expression->kind) {
+        case Kind::Number:
+            coefficients = {expression->value};
+            break;
+        case Kind::Variable:
+            coefficients = {Rational(0), Rational(1)};
+            break;
+        case Kind::Sum: {
+            coefficients = {Rational(0)};
+            for (const auto& term : expression->args) {
+                std::vector<Rational> term_coefficients;
+                if (!to_polynomial(term, term_coefficients)) {
+                    return false;
+                }
+                coefficients.resize(std::max(coefficients.size(), term_coefficients.size()));
+                for (size_t i = 0; i < term_coefficients.size(); ++i) {
+                    coefficients[i] = coefficients[i] + term_coefficients[i];
+                }
+            }
+            break;
+        }
+        case Kind::Product: {
+            coefficients = {Rational(1)};
+            for (const auto& factor : expression->args) {
+                std::vector<Rational> factor_coefficients;
+                if (!to_polynomial(factor, factor_coefficients)) {
+                    return false;
+                }
+                coefficients = multiply(coefficients, factor_coefficients);
+                if (coefficients.size() > MAX_POLYNOMIAL_DEGREE + 1) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case Kind::Power: {
+            const Rational& exponent = expression->value;
+            std::vector<Rational> base;
+            if (!exponent.is_integer() || exponent.is_negative() ||
+                exponent.num() > static_cast<int64_t>(MAX_POLYNOMIAL_DEGREE) ||
+                !to_polynomial(expression->args.front(), base)) {
+                return false;
+            }
+            coefficients = {Rational(1)};
+            for (int64_t i = 0; i < exponent.num(); ++i) {
+                coefficients = multiply(coefficients, base);
+                if (coefficients.size() > MAX_POLYNOMIAL_DEGREE + 1) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case Kind::Function:
+            return false;
+    }
+    
+    while (coefficients.size() > 1 && coefficients.back().is_zero()) {
+        coefficients.pop_back();
+    }
+    return true;
+}
+
+NodePtr from_polynomial(const std::vector<Rational>& coefficients) {
+    std::vector<NodePtr> terms;
+    for (size_t i = 0; i < coefficients.size(); ++i) {
+        terms.push_back(make_product({number(coefficients[i]), make_power(variable(), Rational(static_cast<int64_t>(i)))}));
+    }
+    return make_sum(terms);
+}
+
+// Аргумент вида a x + b с a != 0
+bool linear(const NodePtr& expression, Rational& slope) {
+    std::vector<Rational> coefficients;
+    if (!to_polynomial(expression, coefficients) || coefficients.size() != 2) {
+        return false;
+    }
+    slope = coefficients[1];
+    return true;
+}
+
+NodePtr integral(const NodePtr& expression);
+
+// Первообразная слагаемого без числового коэффициента
+NodePtr term_integral(const NodePtr& term) {
+    // Многочлен интегрируется почленно
+    std::vector<Rational> coefficients;
+    if (to_polynomial(term, coefficients)) {
+        std::vector<Rational> integrated(coefficients.size() + 1);
+        for (size_t i = 0; i < coefficients.size(); ++i) {
+            integrated[i + 1] = coefficients[i] / Rational(static_cast<int64_t>(i + 1));
+        }
+        return from_polynomial(integrated);
+    }
+    
+    Rational slope;
+    if (term->kind == Kind::Power && linear(term->args.front(), slope)) {
+        // Степень линейного аргумента, (ax + b)^-1 - логарифм модуля
+        const auto& base = term->args.front();
+        const Rational& exponent = term->value;
+        if (exponent == Rational(-1)) {
+            return make_product({number(Rational(1) / slope),
+                                 make_function(Function::Ln, make_function(Function::Abs, base))});
+        }
+        return make_product({number(Rational(1) / ((exponent + Rational(1)) * slope)),
+                             make_power(base, exponent + Rational(1))});
+    }
+    
+    if (term->kind == Kind::Function && linear(term->args.front(), slope)) {
+        const auto& arg = term->args.front();
+        auto scale = number(Rational(1) / slope);
+        switch (term->function) {
+            case Function::Sin:
+                return make_product({number(Rational(-1) / slope), make_function(Function::Cos, arg)});
+            case Function::Cos:
+                return make_product({scale, make_function(Function::Sin, arg)});
+            case Function::Exp:
+                return make_product({scale, term});
+            case Function::Ln:
+                // Интеграл ln u = u ln u - u
+                return make_product({scale, make_sum({make_product({arg, term}), negate(arg)})});
+            case Function::Abs:
+                break;
+        }
+    }
+    
+    throw std::runtime_error("Интеграл не поддерживается");
+}
+
+NodePtr integral(const NodePtr& expression) {
+    if (expression->kind == Kind::Sum) {
+        std::vector<NodePtr> terms;
+        for (const auto& term : expression->args) {
+            terms.push_back(integral(term));
+        }
+        return make_sum(terms);
+    }
+    
+    auto [coefficient, rest] = split_coefficient(expression);
+    if (!rest) {
+        return make_product({number(coefficient), variable()});
+    }
+    return make_product({number(coefficient), term_integral(rest)});
+}
+
+// Запись выражения в LaTeX
+class Printer {
+public:
+    explicit Printer(std::string variable_name) : variable_name(std::move(variable_name)) {}
+    
+    std::string print(const NodePtr& expression) const {
+        switch (expression->kind) {
+            case Kind::Number: return print_number(expression->value);
+            case Kind::Variable: return variable_name;
+            case Kind::Sum: return print_sum(expression);
+            case Kind::Product: return print_product(expression);
+            case Kind::Power: return print_power(expression);
+            case Kind::Function: return print_function(expression);
+        }
+        return "";
+    }
+    
+private:
+    static std::string print_number(const Rational& value) {
+        if (value.is_integer()) {
+            return std::to_string(value.num());
+        }
+        Rational magnitude = value.abs();
+        return std::string(value.is_negative() ? "-" : "") + "\\frac{" + std::to_string(magnitude.num()) + "}{" +
+               std::to_string(magnitude.den()) + "}";
+    }
+    
+    static bool is_negative_term(const NodePtr& term) {
+        return split_coefficient(term).first.is_negative();
+    }
+    
+    std::string print_sum(const NodePtr& expression) const {
+        std::string result = print(expression->args.front());
+        for (size_t i = 1; i < expression->args.size(); ++i) {
+            const auto& term = expression->args[i];
+            result += is_negative_term(term) ? " - " + print(negate(term)) : " + " + print(term);
+        }
+        return result;
+    }
+    
+    // Множители подряд, между двумя числами - \cdot
+    std::string join_factors(std::string prefix, const std::vector<NodePtr>& factors) const {
+        for (const auto& factor : factors) {
+            std::string text = factor->kind == Kind::Sum ? "(" + print(factor) + ")" : print(factor);
+            if (!prefix.empty() && std::isdigit(static_cast<unsigned char>(prefix.back())) &&
+                std::isdigit(static_cast<unsigned char>(text.front()))) {
+                prefix += " \\cdot ";
+            }
+            prefix += text;
+        }
+        return prefix;
+    }
+    
+    std::string print_product(const NodePtr& expression) const {
+        Rational coefficient(1);
+        std::vector<NodePtr> numerator;
+        std::vector<NodePtr> denominator;
+        for (const auto& factor : expression->args) {
+            if (factor->kind == Kind::Number) {
+                coefficient = factor->value;
+            } else if (factor->kind == Kind::Power && factor->value.is_negative()) {
+                denominator.push_back(make_power(factor->args.front(), -factor->value));
+            } else {
+                numerator.push_back(factor);
+            }
+        }
+        
+        Rational magnitude = coefficient.abs();
+        std::string sign = coefficient.is_negative() ? "-" : "";
+        std::string numerator_text = join_factors(
+            magnitude.num() != 1 || numerator.empty() ? std::to_string(magnitude.num()) : "", numerator);
+        std::string denominator_text = join_factors(magnitude.den() != 1 ? std::to_string(magnitude.den()) : "",
+                                                    denominator);
+        if (denominator_text.empty()) {
+            return sign + numerator_text;
+        }
+        return sign + "\\frac{" + numerator_text + "}{" + denominator_text + "}";
+    }
+    
+    std::string print_power(const NodePtr& expression) const {
+        const auto& base = expression->args.front();
+        const Rational& exponent = expression->value;
+        
+        if (exponent.is_negative()) {
+            return "\\frac{1}{" + print(make_power(base, -exponent)) + "}";
+        }
+        if (exponent.num() == 1) {
+            std::string index = exponent.den() == 2 ? "" : "[" + std::to_string(exponent.den()) + "]";
+            return "\\sqrt" + index + "{" + print(base) + "}";
+        }
+        
+        std::string exponent_text = exponent.is_integer() ? std::to_string(exponent.num()) : print_number(exponent);
+        
+        // sin^2(x) вместо (sin(x))^2
+        if (base->kind == Kind::Function && exponent.is_integer() &&
+            (base->function == Function::Sin || base->function == Function::Cos || base->function == Function::Ln)) {
+            return "\\" + std::string(function_name(base->function)) + "^{" + exponent_text + "}(" +
+                   print(base->args.front()) + ")";
+        }
+        
+        bool simple = base->kind == Kind::Variable ||
+                      (base->kind == Kind::Number && base->value.is_integer() && !base->value.is_negative()) ||
+                      (base->kind == Kind::Function && base->function == Function::Abs);
+        std::string base_text = simple ? print(base) : "(" + print(base) + ")";
+        return base_text + "^{" + exponent_text + "}";
+    }
+    
+    std::string print_function(const NodePtr& expression) const {
+        const auto& arg = expression->args.front();
+        switch (expression->function) {
+            case Function::Exp:
+                return is_number(arg, Rational(1)) ? "e" : "e^{" + print(arg) + "}";
+            case Function::Abs:
+                return "|" + print(arg) + "|";
+            case Function::Ln:
+                if (arg->kind == Kind::Function && arg->function == Function::Abs) {
+                    return "\\ln" + print(arg);
+                }
+                break;
+            default:
+                break;
+        }
+        return "\\" + std::string(function_name(expression->function)) + "(" + print(arg) + ")";
+    }
+    
+    std::string variable_name;
+};
+
+// Разбор формулы в обычной записи или в LaTeX. Переменная - единственная латинская
+// буква, кроме e. Бросает std::runtime_error, если формула вне поддерживаемого класса
+class Parser {
+public:
+    explicit Parser(const std::string& formula) : text(normalize(formula)) {}
+    
+    NodePtr parse() {
+        auto result = expression();
+        skip_spaces();
+        if (position != text.size()) {
+            throw std::runtime_error("Лишние символы в формуле");
+        }
+        return result;
+    }
+    
+    // Буква переменной, 0 - переменной в формуле нет
+    char variable_name() const { return variable_letter; }
+    
+    // В записи есть деление на выражение с переменной или корень из него. Каноническая
+    // форма такие ограничения теряет: x^2/x становится x, (\sqrt{x})^2 - просто x
+    bool restricts_domain() const { return restricted_domain; }
+    
+private:
+    // Обозначения Unicode и команды LaTeX, равносильные обычным знакам
+    static std::string normalize(std::string formula) {
+        static const std::vector<std::pair<std::string, std::string>> replacements = {
+            {"\\left", ""}, {"\\right", ""}, {"\\,", " "}, {"\\;", " "}, {"\\!", ""}, {"\\ ", " "},
+            {"\\cdot", "*"}, {"\\times", "*"}, {"\\dfrac", "\\frac"}, {"\\tfrac", "\\frac"},
+            {"\xE2\x88\x92", "-"}, {"\xC2\xB7", "*"}, {"\xC3\x97", "*"}, {"\xC2\xB2", "^2"},
+            {"\xC2\xB3", "^3"}, {"\xE2\x88\x9A", "\\sqrt "}, {"**", "^"}
+        };
+        for (const auto& [from, to] : replacements) {
+            size_t found = 0;
+            while ((found = formula.find(from, found)) != std::string::npos) {
+                formula.replace(found, from.size(), to);
+                found += to.size();
+            }
+        }
+        return formula;
+    }
+    
+    void skip_spaces() {
+        while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) {
+            ++position;
+        }
+    }
+    
+    char peek() {
+        skip_spaces();
+        return position < text.size() ? text[position] : '\0';
+    }
+    
+    void expect(char c) {
+        if (peek() != c) {
+            throw std::runtime_error(std::string("Ожидался символ ") + c);
+        }
+        ++position;
+    }
+    
+    bool at_function() const {
+        static const char* names[] = {"sin", "cos", "exp", "ln"};
+        size_t start = position < text.size() && text[position] == '\\' ? position + 1 : position;
+        for (const char* name : names) {
+            if (text.compare(start, std::string(name).size(), name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    bool starts_primary() {
+        char c = peek();
+        return std::isdigit(static_cast<unsigned char>(c)) || std::isalpha(static_cast<unsigned char>(c)) ||
+               c == '\\' || c == '(' || c == '{';
+    }
+    
+    NodePtr expression() {
+        std::vector<NodePtr> terms = {term()};
+        while (true) {
+            char c = peek();
+            if (c == '+') {
+                ++position;
+                terms.push_back(term());
+            } else if (c == '-') {
+                ++position;
+                terms.push_back(negate(term()));
+            } else {
+                break;
+            }
+        }
+        return make_sum(terms);
+    }
+    
+    NodePtr term() {
+        std::vector<NodePtr> factors = {unary()};
+        while (true) {
+            char c = peek();
+            if (c == '*') {
+                ++position;
+                factors.push_back(unary());
+            } else if (c == '/') {
+                ++position;
+                factors.push_back(power_of(unary(), Rational(-1)));
+            } else if (starts_primary()) {
+                // Умножение без знака: 2x, x(x + 1), 3\sin x
+                factors.push_back(power());
+            } else {
+                break;
+            }
+        }
+        return make_product(factors);
+    }
+    
+    NodePtr unary() {
+        char c = peek();
+        if (c == '-') {
+            ++position;
+            return negate(unary());
+        }
+        if (c == '+') {
+            ++position;
+            return unary();
+        }
+        return power();
+    }
+    
+    NodePtr power() {
+        auto base = primary();
+        if (peek() == '^') {
+            ++position;
+            return raise(base, exponent());
+        }
+        return base;
+    }
+    
+    // Показатель после ^: группа в скобках или одно число, буква, команда со знаком
+    NodePtr exponent() {
+        char c = peek();
+        if (c == '-') {
+            ++position;
+            return negate(exponent());
+        }
+        if (c == '+') {
+            ++position;
+        }
+        return primary();
+    }
+    
+    NodePtr raise(const NodePtr& base, const NodePtr& exponent_value) {
+        if (base->kind == Kind::Function && base->function == Function::Exp) {
+            return make_function(Function::Exp, make_product({base->args.front(), exponent_value}));
+        }
+        if (exponent_value->kind != Kind::Number) {
+            throw std::runtime_error("Показатель степени должен быть числом");
+        }
+        return power_of(base, exponent_value->value);
+    }
+    
+    // Степень с учетом области определения (см. restricts_domain)
+    NodePtr power_of(const NodePtr& base, const Rational& exponent) {
+        if ((exponent.is_negative() || !exponent.is_integer()) && depends_on_variable(base)) {
+            restricted_domain = true;
+        }
+        return make_power(base, exponent);
+    }
+    
+    NodePtr group(char open, char close) {
+        expect(open);
+        auto result = expression();
+        expect(close);
+        return result;
+    }
+    
+    NodePtr primary() {
+        char c = peek();
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            return number_literal();
+        }
+        if (c == '(') {
+            return group('(', ')');
+        }
+        if (c == '{') {
+            return group('{', '}');
+        }
+        if (c == '\\') {
+            return command();
+        }
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            return identifier();
+        }
+        throw std::runtime_error("Неожиданный символ в формуле");
+    }
+    
+    NodePtr number_literal() {
+        // Целая и дробная части, разделитель - точка или запятая
+        int64_t numerator = 0;
+        int64_t denominator = 1;
+        int digits = 0;
+        bool fraction = false;
+        for (; position < text.size(); ++position) {
+            char c = text[position];
+            if (std::isdigit(static_cast<unsigned char>(c))) {
+                if (++digits > 18) {
+                    throw std::overflow_error("Слишком длинное число");
+                }
+                numerator = numerator * 10 + (c - '0');
+                if (fraction) {
+                    denominator *= 10;
+                }
+            } else if ((c == '.' || c == ',') && !fraction && position + 1 < text.size() &&
+                       std::isdigit(static_cast<unsigned char>(text[position + 1]))) {
+                fraction = true;
+            } else {
+                break;
+            }
+        }
+        return number(Rational(numerator, denominator));
+    }
+    
+    std::string command_name() {
+        ++position;
+        size_t start = position;
+        while (position < text.size() && std::isalpha(static_cast<unsigned char>(text[position]))) {
+            ++position;
+        }
+        return text.substr(start, position - start);
+    }
+    
+    NodePtr command() {
+        std::string name = command_name();
+        if (name == "frac") {
+            auto numerator = group('{', '}');
+            auto denominator = group('{', '}');
+            return make_product({numerator, power_of(denominator, Rational(-1))});
+        }
+        if (name == "sqrt") {
+            int64_t degree = 2;
+            if (peek() == '[') {
+                ++position;
+                auto index = number_literal();
+                expect(']');
+                if (!index->value.is_integer() || index->value.num() < 2) {
+                    throw std::runtime_error("Неверная степень корня");
+                }
+                degree = index->value.num();
+            }
+            auto radicand = peek() == '{' ? group('{', '}') : power();
+            return power_of(radicand, Rational(1, degree));
+        }
+        if (name == "sin") {
+            return function_call(Function::Sin);
+        }
+        if (name == "cos") {
+            return function_call(Function::Cos);
+        }
+        if (name == "exp") {
+            return function_call(Function::Exp);
+        }
+        if (name == "ln") {
+            return function_call(Function::Ln);
+        }
+        throw std::runtime_error("Неподдерживаемая команда \\" + name);
+    }
+    
+    NodePtr identifier() {
+        static const std::pair<const char*, Function> functions[] = {
+            {"sin", Function::Sin}, {"cos", Function::Cos}, {"exp", Function::Exp}, {"ln", Function::Ln}
+        };
+        for (const auto& [name, function] : functions) {
+            size_t length = std::string(name).size();
+            if (text.compare(position, length, name) == 0) {
+                position += length;
+                return function_call(function);
+            }
+        }
+        
+        char letter = text[position++];
+        if (letter == 'e') {
+            return make_function(Function::Exp, number(Rational(1)));
+        }
+        if (variable_letter != 0 && variable_letter != letter) {
+            throw std::runtime_error("Выражение от нескольких переменных");
+        }
+        variable_letter = letter;
+        return variable();
+    }
+    
+    // Аргумент функции: в скобках или без них (\sin 2x), sin^2 x - квадрат синуса
+    NodePtr function_call(Function function) {
+        Rational power_of_result(1);
+        if (peek() == '^') {
+            ++position;
+            auto value = exponent();
+            if (value->kind != Kind::Number || value->value.is_negative()) {
+                throw std::runtime_error("Неподдерживаемая степень функции");
+            }
+            power_of_result = value->value;
+        }
+        
+        NodePtr arg;
+        char c = peek();
+        if (c == '(') {
+            arg = group('(', ')');
+        } else if (c == '{') {
+            arg = group('{', '}');
+        } else {
+            std::vector<NodePtr> factors = {power()};
+            while (starts_primary() && !at_function()) {
+                factors.push_back(power());
+            }
+            arg = make_product(factors);
+        }
+        return power_of(make_function(function, arg), power_of_result);
+    }
+    
+    std::string text;
+    size_t position = 0;
+    char variable_letter = 0;
+    bool restricted_domain = false;
+};
+
+// Формулы длиннее не разбираются: разбор рекурсивный, а простые задачи короткие
+const size_t MAX_FORMULA_LENGTH = 256;
+
+// Формула из задачи и насколько надежно она выделена
+struct ExtractedFormula {
+    std::string text;
+    
+    // Формула размечена ($...$, \[...\]), а не выделена из текста
+    bool delimited = false;
+    
+    // В задаче несколько формул: возможны условия, которые решатель не учитывает
+    bool ambiguous = false;
+    
+    // Текст задачи без формулы: по нему проверяется, что спрашивают именно то, что решатель решает
+    std::string wording;
+};
+
+std::string trim(const std::string& text, const std::string& extra = "") {
+    std::string strip = " \t\r\n" + extra;
+    size_t start = text.find_first_not_of(strip);
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(strip);
+    return text.substr(start, end - start + 1);
+}
+
+bool starts_with(const std::string& text, const std::string& prefix) {
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool ends_with(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool contains(const std::string& text, const std::string& part) {
+    return text.find(part) != std::string::npos;
+}
+
+ExtractedFormula extract_formula(const std::string& task_text) {
+    ExtractedFormula result;
+    
+    // Размеченные формулы - как их выделяет FormulaTokenizer
+    static const std::regex formula_regex(
+        "\\$(.*?)\\$|\\\\\\[(.*?)\\\\\\]|\\\\begin\\{equation\\}(.*?)\\\\end\\{equation\\}");
+    int count = 0;
+    for (auto it = std::sregex_iterator(task_text.begin(), task_text.end(), formula_regex);
+         it != std::sregex_iterator(); ++it) {
+        if (count++ == 0) {
+            for (size_t i = 1; i < it->size(); ++i) {
+                if ((*it)[i].matched) {
+                    result.text = (*it)[i].str();
+                    break;
+                }
+            }
+        }
+    }
+    if (count > 0) {
+        result.delimited = true;
+        result.ambiguous = count > 1;
+        result.wording = std::regex_replace(task_text, formula_regex, " ");
+        return result;
+    }
+    
+    // Без разметки формула - самый длинный кусок между русскими словами
+    // (буквы кириллицы в UTF-8 начинаются с байтов 0xD0 и 0xD1)
+    std::vector<std::string> runs;
+    std::string run;
+    auto flush = [&] {
+        std::string piece = trim(run, ",.:;?!");
+        bool formula_like = std::any_of(piece.begin(), piece.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c));
+        });
+        if (formula_like) {
+            runs.push_back(piece);
+        }
+        run.clear();
+    };
+    for (size_t i = 0; i < task_text.size(); ++i) {
+        unsigned char byte = static_cast<unsigned char>(task_text[i]);
+        if ((byte == 0xD0 || byte == 0xD1) && i + 1 < task_text.size()) {
+            flush();
+            ++i;
+        } else {
+            run += task_text[i];
+        }
+    }
+    flush();
+    
+    if (runs.empty()) {
+        return result;
+    }
+    result.text = *std::max_element(runs.begin(), runs.end(), [](const std::string& a, const std::string& b) {
+        return a.size() < b.size();
+    });
+    result.ambiguous = runs.size() > 1;
+    result.wording = task_text;
+    result.wording.erase(result.wording.find(result.text), result.text.size());
+    return result;
+}
+
+// "f(x) = ..." или "y = ..." - берется правая часть
+std::string strip_definition(const std::string& formula) {
+    static const std::regex definition("^\\s*[a-zA-Z]\\s*(\\(\\s*[a-zA-Z]\\s*\\))?\\s*=(.*)$");
+    std::smatch match;
+    if (std::regex_match(formula, match, definition)) {
+        return trim(match[2].str());
+    }
+    if (contains(formula, "=")) {
+        throw std::runtime_error("Лишний знак равенства");
+    }
+    return formula;
+}
+
+// Класс задачи и назван ли он словами
+struct DetectedTask {
+    SymbolicTask task = SymbolicTask::None;
+    bool named = false;
+};
+
+// Формулировка без лишних пробелов и знаков препинания по краям
+std::string normalize_wording(const std::string& wording) {
+    std::string result;
+    for (char c : wording) {
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            if (!result.empty() && result.back() != ' ') {
+                result += ' ';
+            }
+        } else {
+            result += c;
+        }
+    }
+    return trim(result, ".,:;!?");
+}
+
+// Класс задачи по формулировке. Допускаются только известные шаблоны целиком: любое
+// уточнение ("по t", "в точке", "на отрезке", "найдите сумму корней", "вторую") меняет
+// вопрос, и такую задачу решает модель. Без слов класс задает сама формула
+DetectedTask detect_task(const ExtractedFormula& formula) {
+    static const std::regex derivative_wording(
+        "((Н|н)айдите|(В|в)ычислите) производную( функции)?|(П|п)родифференцируйте( функцию)?");
+    static const std::regex integral_wording(
+        "((Н|н)айдите|(В|в)ычислите) (неопределенный |неопределённый )?интеграл|"
+        "(Н|н)айдите (первообразную|общий вид первообразных)( функции)?");
+    static const std::regex equation_wording("(Р|р)ешите уравнение|(Н|н)айдите (корни|корень) уравнения");
+    static const std::regex operator_wording("((Н|н)айдите|(В|в)ычислите)?");
+    static const std::regex equality_wording("((Р|р)ешите)?");
+    
+    std::string wording = normalize_wording(formula.wording);
+    if (std::regex_match(wording, derivative_wording)) {
+        return {SymbolicTask::Derivative, true};
+    }
+    if (std::regex_match(wording, integral_wording)) {
+        return {SymbolicTask::Integral, true};
+    }
+    if (std::regex_match(wording, equation_wording)) {
+        return {SymbolicTask::Equation, true};
+    }
+    
+    // Знак интеграла и штрих однозначны, голое равенство может оказаться чем угодно
+    std::string text = trim(formula.text);
+    if (std::regex_match(wording, operator_wording)) {
+        if (starts_with(text, "\xE2\x88\xAB") || starts_with(text, "\\int")) {
+            return {SymbolicTask::Integral, true};
+        }
+        if (ends_with(text, "'") || starts_with(text, "d/dx") || starts_with(text, "\\frac{d}{dx}")) {
+            return {SymbolicTask::Derivative, true};
+        }
+    }
+    if (std::regex_match(wording, equality_wording) && contains(text, "=")) {
+        return {SymbolicTask::Equation, false};
+    }
+    return {};
+}
+
+std::string formula_text(const std::string& latex) {
+    return "$" + latex + "$";
+}
+
+std::string solve_derivative(std::string formula) {
+    formula = trim(formula);
+    for (const char* prefix : {"\\frac{d}{dx}", "d/dx"}) {
+        if (starts_with(formula, prefix)) {
+            formula = trim(formula.substr(std::string(prefix).size()));
+        }
+    }
+    if (ends_with(formula, "'")) {
+        formula = trim(formula.substr(0, formula.size() - 1));
+    }
+    
+    Parser parser(strip_definition(formula));
+    auto function = parser.parse();
+    Printer printer(std::string(1, parser.variable_name() ? parser.variable_name() : 'x'));
+    return formula_text("(" + printer.print(function) + ")' = " + printer.print(derivative(function)));
+}
+
+std::string solve_integral(std::string formula) {
+    formula = trim(formula);
+    for (const char* sign : {"\xE2\x88\xAB", "\\int"}) {
+        if (starts_with(formula, sign)) {
+            formula = trim(formula.substr(std::string(sign).size()));
+            
+            // Определенные интегралы не решаются
+            if (starts_with(formula, "_") || starts_with(formula, "^")) {
+                throw std::runtime_error("Определенный интеграл");
+            }
+        }
+    }
+    
+    // Дифференциал в конце: dx, \,dx, \mathrm{d}x
+    static const std::regex differential("^(.*?)\\s*(\\\\,)?\\s*(\\\\mathrm\\{d\\}|d)\\s*([a-zA-Z])\\s*$");
+    std::smatch match;
+    char differential_letter = 0;
+    if (std::regex_match(formula, match, differential)) {
+        formula = match[1].str();
+        differential_letter = match[4].str()[0];
+    }
+    
+    Parser parser(strip_definition(formula));
+    auto function = parser.parse();
+    char letter = parser.variable_name();
+    if (letter && differential_letter && letter != differential_letter) {
+        throw std::runtime_error("Интегрирование по другой переменной");
+    }
+    letter = letter ? letter : differential_letter ? differential_letter : 'x';
+    
+    Printer printer(std::string(1, letter));
+    std::string integrand = printer.print(function);
+    if (function->kind == Kind::Sum) {
+        integrand = "(" + integrand + ")";
+    }
+    return formula_text("\\int " + integrand + "\\,d" + std::string(1, letter) + " = " +
+                        printer.print(integral(function)) + " + C");
+}
+
+// sqrt(value) = factor * sqrt(radicand), radicand без квадратов до 10^12
+void split_square_root(int64_t value, int64_t& factor, int64_t& radicand) {
+    factor = 1;
+    radicand = value;
+    for (int64_t i = 2; i <= 1000000 && i * i <= radicand; ++i) {
+        while (radicand % (i * i) == 0) {
+            factor *= i;
+            radicand /= i * i;
+        }
+    }
+    int64_t root;
+    if (exact_root(radicand, 2, root)) {
+        factor *= root;
+        radicand = 1;
+    }
+}
+
+std::string solve_equation(const std::string& formula) {
+    size_t equals = formula.find('=');
+    if (equals == std::string::npos || formula.find('=', equals + 1) != std::string::npos) {
+        throw std::runtime_error("Нужно одно равенство");
+    }
+    
+    Parser left_parser(formula.substr(0, equals));
+    auto left = left_parser.parse();
+    Parser right_parser(formula.substr(equals + 1));
+    auto right = right_parser.parse();
+    
+    // Корень, потерянный или приобретенный при упрощении, дал бы неверный ответ
+    if (left_parser.restricts_domain() || right_parser.restricts_domain()) {
+        throw std::runtime_error("Уравнение с ограничением области определения");
+    }
+    
+    char letter = left_parser.variable_name() ? left_parser.variable_name() : right_parser.variable_name();
+    if (!letter || (left_parser.variable_name() && right_parser.variable_name() &&
+                    left_parser.variable_name() != right_parser.variable_name())) {
+        throw std::runtime_error("Нужна одна переменная");
+    }
+    std::string name(1, letter);
+    Printer printer(name);
+    
+    std::vector<Rational> coefficients;
+    if (!to_polynomial(make_sum({left, negate(right)}), coefficients) || coefficients.size() > 3) {
+        throw std::runtime_error("Уравнение не линейное и не квадратное");
+    }
+    
+    if (coefficients.size() == 1) {
+        return coefficients[0].is_zero() ? "Равенство верно при любом " + formula_text(name) : "Решений нет";
+    }
+    if (coefficients.size() == 2) {
+        return formula_text(name + " = " + printer.print(number(-coefficients[0] / coefficients[1])));
+    }
+    
+    const Rational& a = coefficients[2];
+    const Rational& b = coefficients[1];
+    const Rational& c = coefficients[0];
+    Rational discriminant = b * b - Rational(4) * a * c;
+    std::string text = formula_text(printer.print(from_polynomial(coefficients)) + " = 0") + ", " +
+                       formula_text("D = " + printer.print(number(discriminant)));
+    
+    if (discriminant.is_negative()) {
+        return text + ", действительных корней нет";
+    }
+    
+    Rational vertex = -b / (Rational(2) * a);
+    if (discriminant.is_zero()) {
+        return text + ", " + formula_text(name + " = " + printer.print(number(vertex)));
+    }
+    
+    // sqrt(p/q) = sqrt(pq)/q = factor * sqrt(radicand) / q
+    Rational scaled = Rational(discriminant.num()) * Rational(discriminant.den());
+    int64_t factor;
+    int64_t radicand;
+    split_square_root(scaled.num(), factor, radicand);
+    Rational offset = Rational(factor) / (Rational(discriminant.den()) * (Rational(2) * a).abs());
+    NodePtr root_part = make_product({number(offset), make_power(number(Rational(radicand)), Rational(1, 2))});
+    
+    auto first = make_sum({number(vertex), negate(root_part)});
+    auto second = make_sum({number(vertex), root_part});
+    return text + ", " + formula_text(name + "_{1} = " + printer.print(first)) + ", " +
+           formula_text(name + "_{2} = " + printer.print(second));
+}
+
+} // namespace
+
+SymbolicAnswer solve_symbolic(const std::string& task_text) {
+    SymbolicAnswer answer;
+    try {
+        auto formula = extract_formula(task_text);
+        if (formula.text.empty() || formula.text.size() > MAX_FORMULA_LENGTH) {
+            return answer;
+        }
+        
+        // Уравнение без слов решается, но с меньшей уверенностью
+        auto detected = detect_task(formula);
+        SymbolicTask task = detected.task;
+        switch (task) {
+            case SymbolicTask::Derivative: answer.text = solve_derivative(formula.text); break;
+            case SymbolicTask::Integral: answer.text = solve_integral(formula.text); break;
+            case SymbolicTask::Equation: answer.text = solve_equation(formula.text); break;
+            case SymbolicTask::None: return answer;
+        }
+        
+        answer.solved = true;
+        answer.task = task;
+        answer.confidence = detected.named ? (formula.delimited ? 1.0 : 0.9) : (formula.delimited ? 0.8 : 0.6);
+        if (formula.ambiguous) {
+            answer.confidence = std::min(answer.confidence, 0.5);
+        }
+    } catch (const std::exception&) {
+        // Задача вне класса символьного решателя
+        return SymbolicAnswer();
+    }
+    return answer;
+}
+
+} // namespace formula_teacher
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+namespace formula_teacher {
+
+// Класс задачи, распознанной символьным решателем
+enum class SymbolicTask {
+    None,
+    Derivative,
+    Integral,
+    Equation
+};
+
+// Ответ символьного решателя
+struct SymbolicAnswer {
+    // Задача распознана и решена
+    bool solved = false;
+    SymbolicTask task = SymbolicTask::None;
+    
+    // Решение с формулами в $...$ (LaTeX)
+    std::string text;
+    
+    // Уверенность в том, что задача понята верно, от 0 до 1: формула в $...$ и формулировка
+    // по известному шаблону ("Найдите производную", "Решите уравнение") - 1, формула без
+    // разметки или уравнение без слов - меньше. Сами вычисления точные
+    double confidence = 0.0;
+};
+
+// Символьное решение простых задач без модели: производные и неопределенные интегралы
+// выражений от одной переменной из многочленов, sin, cos, exp и ln (интегралы - линейные
+// комбинации степеней и функций линейного аргумента), линейные и квадратные уравнения.
+// Формула берется из $...$, \[...\] или из текста задачи, записи вида x^2, x², 2x, sin x,
+// \frac{1}{x}, \sqrt{x}, e^{2x} понимаются. Арифметика рациональная, без округлений.
+// Задачи вне этого класса и с формулировкой вне шаблонов возвращают solved = false
+SymbolicAnswer solve_symbolic(const std::string& task_text);
+
+} // namespace formula_teacher
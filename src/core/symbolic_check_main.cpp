@@ -0,0 +1,88 @@
+#include "symbolic.h"
+#include <iostream>
+#include <string>
+
+// Сверка символьного решателя с таблицей ожидаемых ответов. Пустой ответ - задача
+// должна остаться модели (solved = false или уверенность ниже порога движка)
+
+namespace {
+
+struct Case {
+    const char* task;
+    const char* expected;
+};
+
+const Case CASES[] = {
+    // Производные
+    {"Найдите производную функции $x^2$", "$(x^{2})' = 2x$"},
+    {"Найдите производную x^3 - 2x + 1", "$(x^{3} - 2x + 1)' = 3x^{2} - 2$"},
+    {"Найдите производную $f(x) = \\sin(2x) + e^{3x}$", "$(e^{3x} + \\sin(2x))' = 2\\cos(2x) + 3e^{3x}$"},
+    {"Продифференцируйте $\\ln(x) \\cdot x$", "$(x\\ln(x))' = \\ln(x) + 1$"},
+    {"Найдите производную $\\sqrt{x}$", "$(\\sqrt{x})' = \\frac{1}{2\\sqrt{x}}$"},
+    {"Найдите производную $\\frac{1}{x}$", "$(\\frac{1}{x})' = -\\frac{1}{x^{2}}$"},
+    {"Найдите производную $\\sin^2 x$", "$(\\sin^{2}(x))' = 2\\cos(x)\\sin(x)$"},
+    {"Найдите производную $\\arcsin x$", ""},
+    {"Найдите вторую производную $x^3$", ""},
+    {"Найдите производную $x^3$ при x = 2", ""},
+    {"Найдите производную $x^3$ в точке $x = 2$", ""},
+    {"Найдите производную $\\sin t$ по x", ""},
+    {"Найдите производную $(x^2)$ по переменной t", ""},
+    {"Найдите $(x^3)'$", "$(x^{3})' = 3x^{2}$"},
+    
+    // Интегралы
+    {"Вычислите интеграл $\\int x^2 \\, dx$", "$\\int x^{2}\\,dx = \\frac{x^{3}}{3} + C$"},
+    {"Найдите первообразную $\\sin x + \\cos(3x)$",
+     "$\\int (\\cos(3x) + \\sin(x))\\,dx = -\\cos(x) + \\frac{\\sin(3x)}{3} + C$"},
+    {"Вычислите $\\int \\frac{1}{x} dx$", "$\\int \\frac{1}{x}\\,dx = \\ln|x| + C$"},
+    {"Вычислите $\\int e^{2x} dx$", "$\\int e^{2x}\\,dx = \\frac{e^{2x}}{2} + C$"},
+    {"Найдите интеграл $\\int \\ln x \\, dx$", "$\\int \\ln(x)\\,dx = -x + x\\ln(x) + C$"},
+    {"Вычислите $\\int_0^1 x dx$", ""},
+    {"Вычислите интеграл от 0 до 1 $x^2$", ""},
+    {"Вычислите $\\int x \\sin x dx$", ""},
+    {"Вычислите определенный интеграл $\\int x dx$ на отрезке [0, 1]", ""},
+    
+    // Уравнения
+    {"Решите уравнение $2x + 3 = 7$", "$x = 2$"},
+    {"Решите уравнение $0.5x = 1,5$", "$x = 3$"},
+    {"Решите уравнение $x^2 - 5x + 6 = 0$", "$x^{2} - 5x + 6 = 0$, $D = 1$, $x_{1} = 2$, $x_{2} = 3$"},
+    {"Решите уравнение $x^2 + 1 = 0$", "$x^{2} + 1 = 0$, $D = -4$, действительных корней нет"},
+    {"Решите уравнение $x^2 - 2 = 0$", "$x^{2} - 2 = 0$, $D = 8$, $x_{1} = -\\sqrt{2}$, $x_{2} = \\sqrt{2}$"},
+    {"Решите уравнение x² − 4x + 4 = 0", "$x^{2} - 4x + 4 = 0$, $D = 0$, $x = 2$"},
+    {"Решите уравнение $x + y = 1$", ""},
+    {"Решите уравнение $x^3 = 1$", ""},
+    {"Решите уравнение $\\frac{x^2}{x} = 0$", ""},
+    {"Решите уравнение $(\\sqrt{x})^2 = -1$", ""},
+    {"Решите систему $x = 1$ и $y = 2$", ""},
+    {"Решите уравнение $x^2 = 4$, где x > 0", ""},
+    {"Решите уравнение $x^2-4=0$ на промежутке [0; 5]", ""},
+    {"Решите уравнение $x^2 - 5x + 6 = 0$. Найдите сумму корней", ""},
+    {"$3x = 6$", "$x = 2$"},
+    {"Упростите $x + x = 2x$", ""},
+    
+    // Огромная степень корня не должна занимать исполнитель
+    {"Найдите производную $\\sqrt[1000000000]{2} x$", ""},
+    {"Найдите производную $x\\sqrt[100000000000000000]{2}$", ""},
+};
+
+// Порог уверенности движка по умолчанию (см. FormulaInference::set_symbolic_solver)
+const double MIN_CONFIDENCE = 0.8;
+
+} // namespace
+
+int main() {
+    int failures = 0;
+    for (const auto& check : CASES) {
+        auto answer = formula_teacher::solve_symbolic(check.task);
+        std::string actual = answer.solved && answer.confidence >= MIN_CONFIDENCE ? answer.text : "";
+        if (actual != check.expected) {
+            std::cerr << "Расхождение: " << check.task << "\n"
+                      << "  ожидалось: " << check.expected << "\n"
+                      << "  получено:  " << actual << std::endl;
+            ++failures;
+        }
+    }
+    
+    std::cout << "symbolic-check: " << sizeof(CASES) / sizeof(CASES[0]) - failures << " из "
+              << sizeof(CASES) / sizeof(CASES[0]) << " совпали" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include "threading.h"
+#include <algorithm>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace formula_teacher {
+
+std::vector<SessionThreads> plan_sessions(const ThreadBudget& budget) {
+    std::vector<int> cpus = budget.cpus;
+    
+    // Без списка ядер считаем те, что разрешены процессу: привязка и cpuset на общем
+    // хосте бывают уже, чем hardware_concurrency
+    int threads = budget.threads;
+    if (threads <= 0) {
+        size_t available = !cpus.empty() ? cpus.size() : allowed_cpus().size();
+        threads = available > 0 ? static_cast<int>(available)
+                                : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    
+    int sessions = budget.sessions;
+    int intra_op = budget.intra_op_threads;
+    if (sessions <= 0 && intra_op <= 0) {
+        // Для задержки одного запроса выгоднее много однопоточных сессий
+        intra_op = 1;
+    }
+    if (sessions <= 0) {
+        sessions = std::max(1, threads / intra_op);
+    }
+    if (intra_op <= 0) {
+        intra_op = std::max(1, threads / sessions);
+    }
+    
+    std::vector<SessionThreads> plan(sessions);
+    for (int session = 0; session < sessions; ++session) {
+        plan[session].intra_op_threads = intra_op;
+        if (cpus.empty()) {
+            continue;
+        }
+        
+        // Сессия получает intra_op подряд идущих ядер, по кругу при нехватке
+        int count = std::min(intra_op, static_cast<int>(cpus.size()));
+        for (int i = 0; i < count; ++i) {
+            plan[session].cpus.push_back(cpus[(static_cast<size_t>(session) * intra_op + i) % cpus.size()]);
+        }
+        std::sort(plan[session].cpus.begin(), plan[session].cpus.end());
+        plan[session].cpus.erase(std::unique(plan[session].cpus.begin(), plan[session].cpus.end()),
+                                 plan[session].cpus.end());
+    }
+    
+    return plan;
+}
+
+std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream stream(text);
+    std::string item;
+    
+    while (std::getline(stream, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        
+        try {
+            size_t dash = item.find('-');
+            int first = std::stoi(item.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+            if (first < 0 || last < first || last >= CPU_SETSIZE) {
+                throw std::out_of_range(item);
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Неверный список ядер: " + text);
+        }
+    }
+    
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    if (cpus.empty()) {
+        throw std::runtime_error("Пустой список ядер: " + text);
+    }
+    return cpus;
+}
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+bool pin_current_thread(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return true;
+    }
+    
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        std::cerr << "Не удалось привязать поток к ядрам: код " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace formula_teacher
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace formula_teacher {
+
+// Бюджет процессорных потоков для инференса или обучения.
+// Нули означают "подобрать": всего потоков - по числу разрешенных ядер,
+// сессий - столько, чтобы каждой досталось intra_op_threads потоков
+struct ThreadBudget {
+    // Всего потоков на все сессии
+    int threads = 0;
+    
+    // Одновременно решаемых запросов (потоков-исполнителей движка)
+    int sessions = 0;
+    
+    // Потоков внутри операций LibTorch на одну сессию
+    int intra_op_threads = 0;
+    
+    // Разрешенные ядра. Пусто - без привязки, потоки планирует ОС
+    std::vector<int> cpus;
+};
+
+// Потоки одной сессии: число потоков внутри операций и ядра, к которым она привязана
+struct SessionThreads {
+    int intra_op_threads;
+    std::vector<int> cpus;
+};
+
+// Разбиение бюджета на сессии. Ядра делятся между сессиями без пересечений,
+// пока их хватает; если сессий больше, чем ядер, ядра назначаются по кругу
+std::vector<SessionThreads> plan_sessions(const ThreadBudget& budget);
+
+// Разбор списка ядер вида "0-3,8,10-11". Бросает std::runtime_error при ошибке
+std::vector<int> parse_cpu_list(const std::string& text);
+
+// Ядра, на которых процессу разрешено выполняться (sched_getaffinity)
+std::vector<int> allowed_cpus();
+
+// Привязка текущего потока к ядрам. Потоки, созданные им после этого
+// (в том числе пул OpenMP), наследуют привязку. Пустой список - без изменений
+bool pin_current_thread(const std::vector<int>& cpus);
+
+} // namespace formula_teacher
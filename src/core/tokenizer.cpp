@@ -37,7 +37,14 @@ FormulaTokenizer::FormulaTokenizer(const std::string& vocab_path) : FormulaToken
     }
 }
 
-std::vector<std::string> FormulaTokenizer::split_text(const std::string& text) {
+FormulaTokenizer::FormulaTokenizer(const std::vector<std::pair<std::string, int>>& entries) : FormulaTokenizer() {
+    for (const auto& [token, id] : entries) {
+        token_to_id[token] = id;
+        id_to_token[id] = token;
+    }
+}
+
+std::vector<std::string> FormulaTokenizer::split_text(const std::string& text) const {
     std::vector<std::string> tokens;
     
     // Находим формулы и заменяем их специальными токенами
@@ -78,7 +85,7 @@ std::vector<std::string> FormulaTokenizer::split_text(const std::string& text) {
     return tokens;
 }
 
-std::string FormulaTokenizer::process_formula(const std::string& formula) {
+std::string FormulaTokenizer::process_formula(const std::string& formula) const {
     // Заменяем пробелы на специальные токены
     std::string processed = formula;
     std::replace(processed.begin(), processed.end(), ' ', '_');
@@ -87,53 +94,95 @@ std::string FormulaTokenizer::process_formula(const std::string& formula) {
     return "<formula>" + processed + "</formula>";
 }
 
-std::vector<int> FormulaTokenizer::tokenize(const std::string& text) {
-    std::vector<std::string> tokens = split_text(text);
+std::vector<int> FormulaTokenizer::tokenize(const std::string& text) const {
     std::vector<int> token_ids;
+    tokenize(text, token_ids);
+    return token_ids;
+}
+
+void FormulaTokenizer::tokenize(const std::string& text, std::vector<int>& token_ids) const {
+    std::vector<std::string> tokens = split_text(text);
     
+    // Только чтение словаря - метод можно вызывать из нескольких потоков
     for (const auto& token : tokens) {
-        if (token_to_id.find(token) != token_to_id.end()) {
-            token_ids.push_back(token_to_id[token]);
-        } else {
-            token_ids.push_back(UNK);
-        }
+        auto it = token_to_id.find(token);
+        token_ids.push_back(it != token_to_id.end() ? it->second : UNK);
     }
-    
-    return token_ids;
 }
 
-std::string FormulaTokenizer::detokenize(const std::vector<int>& tokens) {
-    std::string result;
-    bool in_formula = false;
+std::string FormulaTokenizer::detokenize(const std::vector<int>& tokens) const {
+    StreamingDetokenizer detokenizer(*this);
     
+    std::string result;
     for (int token_id : tokens) {
-        if (token_id == EOS) break;
-        if (token_id == SOS || token_id == PAD) continue;
-        
-        std::string token = (id_to_token.find(token_id) != id_to_token.end()) ? 
-                            id_to_token[token_id] : "<unk>";
-        
-        if (token == "<formula>") {
-            in_formula = true;
-            result += " $";
-        } else if (token == "</formula>") {
-            in_formula = false;
-            result += "$ ";
-        } else {
-            if (in_formula) {
-                // В формулах заменяем подчеркивания на пробелы
-                std::string processed = token;
-                std::replace(processed.begin(), processed.end(), '_', ' ');
-                result += processed;
-            } else {
-                result += " " + token;
-            }
-        }
+        result += detokenizer.push(token_id);
+        if (detokenizer.finished()) break;
     }
+    result += detokenizer.finish();
     
     return result;
 }
 
+const std::string& FormulaTokenizer::token_text(int token_id) const {
+    static const std::string unknown = "<unk>";
+    auto it = id_to_token.find(token_id);
+    return it != id_to_token.end() ? it->second : unknown;
+}
+
+std::string StreamingDetokenizer::push(int token_id) {
+    if (done) return "";
+    if (token_id == FormulaTokenizer::EOS) {
+        done = true;
+        return "";
+    }
+    if (token_id == FormulaTokenizer::SOS || token_id == FormulaTokenizer::PAD) return "";
+    
+    const std::string& token = tokenizer.token_text(token_id);
+    
+    static const std::string open_tag = "<formula>";
+    static const std::string close_tag = "</formula>";
+    
+    // Формула целиком в одном токене (так её выдает FormulaTokenizer::tokenize)
+    if (!in_formula && token.size() >= open_tag.size() + close_tag.size() &&
+        token.compare(0, open_tag.size(), open_tag) == 0 &&
+        token.compare(token.size() - close_tag.size(), close_tag.size(), close_tag) == 0) {
+        std::string formula = token.substr(open_tag.size(), token.size() - open_tag.size() - close_tag.size());
+        std::replace(formula.begin(), formula.end(), '_', ' ');
+        return " $" + formula + "$ ";
+    }
+    
+    if (token == open_tag) {
+        in_formula = true;
+        pending = " $";
+        return "";
+    }
+    
+    if (token == close_tag) {
+        in_formula = false;
+        std::string fragment = std::move(pending) + "$ ";
+        pending.clear();
+        return fragment;
+    }
+    
+    if (in_formula) {
+        // В формулах заменяем подчеркивания на пробелы
+        std::string processed = token;
+        std::replace(processed.begin(), processed.end(), '_', ' ');
+        pending += processed;
+        return "";
+    }
+    
+    return " " + token;
+}
+
+std::string StreamingDetokenizer::finish() {
+    std::string fragment = std::move(pending);
+    pending.clear();
+    in_formula = false;
+    done = true;
+    return fragment;
+}
+
 void FormulaTokenizer::build_vocabulary(const std::string& corpus_path, int max_vocab_size) {
     std::ifstream file(corpus_path);
     if (!file) {
@@ -185,4 +234,11 @@ void FormulaTokenizer::save_vocabulary(const std::string& vocab_path) {
     std::cout << "Словарь сохранен в: " << vocab_path << std::endl;
 }
 
+std::vector<std::pair<std::string, int>> FormulaTokenizer::vocabulary_entries() const {
+    std::vector<std::pair<std::string, int>> entries(token_to_id.begin(), token_to_id.end());
+    std::sort(entries.begin(), entries.end(),
+              [](const auto& a, const auto& b) { return a.second < b.second; });
+    return entries;
+}
+
 } // namespace formula_teacher
@@ -16,11 +16,20 @@ public:
     // Конструктор для загрузки существующего словаря
     explicit FormulaTokenizer(const std::string& vocab_path);
     
+    // Конструктор из готовой таблицы (токен, индекс), например из пакета модели
+    explicit FormulaTokenizer(const std::vector<std::pair<std::string, int>>& entries);
+    
     // Токенизация текста с формулами
-    std::vector<int> tokenize(const std::string& text);
+    std::vector<int> tokenize(const std::string& text) const;
+    
+    // Токенизация с добавлением индексов в конец существующего вектора
+    void tokenize(const std::string& text, std::vector<int>& token_ids) const;
     
     // Детокенизация - превращение токенов в текст
-    std::string detokenize(const std::vector<int>& tokens);
+    std::string detokenize(const std::vector<int>& tokens) const;
+    
+    // Текст токена по индексу, "<unk>" для неизвестного
+    const std::string& token_text(int token_id) const;
     
     // Создание словаря из текстового корпуса
     void build_vocabulary(const std::string& corpus_path, int max_vocab_size = 50000);
@@ -28,6 +37,9 @@ public:
     // Сохранение словаря
     void save_vocabulary(const std::string& vocab_path);
     
+    // Таблица словаря (токен, индекс), упорядоченная по индексу
+    std::vector<std::pair<std::string, int>> vocabulary_entries() const;
+    
     // Получить размер словаря
     int vocab_size() const { return token_to_id.size(); }
     
@@ -41,10 +53,10 @@ public:
     
 private:
     // Разделение текста на токены
-    std::vector<std::string> split_text(const std::string& text);
+    std::vector<std::string> split_text(const std::string& text) const;
     
     // Обработка математических формул
-    std::string process_formula(const std::string& formula);
+    std::string process_formula(const std::string& formula) const;
     
     // Словари для преобразования токенов в индексы и обратно
     std::unordered_map<std::string, int> token_to_id;
@@ -54,4 +66,30 @@ private:
     std::regex formula_regex;
 };
 
+// Пошаговая детокенизация для потоковой выдачи ответа.
+// Склейка всех фрагментов push и finish совпадает с FormulaTokenizer::detokenize.
+// Формула выдается одним фрагментом после закрывающего токена, чтобы ни один
+// фрагмент не разрывал $...$ посередине
+class StreamingDetokenizer {
+public:
+    explicit StreamingDetokenizer(const FormulaTokenizer& tokenizer) : tokenizer(tokenizer) {}
+    
+    // Очередной токен -> готовый к показу фрагмент (может быть пустым)
+    std::string push(int token_id);
+    
+    // Остаток после конца генерации: незакрытая формула выдается как есть
+    std::string finish();
+    
+    // Встретился ли токен конца последовательности
+    bool finished() const { return done; }
+    
+private:
+    const FormulaTokenizer& tokenizer;
+    bool in_formula = false;
+    bool done = false;
+    
+    // Накопленная незакрытая формула
+    std::string pending;
+};
+
 } // namespace formula_teacher
@@ -1,4 +1,6 @@
 #include "model.h"
+#include "scripted_model.h"
+#include "threading.h"
 #include "trainer.h"
 #include "tokenizer.h"
 #include <iostream>
@@ -16,6 +18,10 @@ void print_usage() {
               << "  --emb-dim N        Размерность эмбеддингов (по умолчанию 256)\n"
               << "  --hidden-dim N     Размер скрытых слоёв (по умолчанию 512)\n"
               << "  --learning-rate N  Скорость обучения (по умолчанию 0.001)\n"
+              << "  --threads N        Потоков LibTorch для обучения (по умолчанию по числу ядер)\n"
+              << "  --cpus LIST        Ядра для обучения, например 0-3,8 (по умолчанию без привязки)\n"
+              << "  --export-script FILE  Экспорт обученной модели в замороженный TorchScript\n"
+              << "  --bundle FILE      Сохранить модель и словарь одним файлом (.ftb)\n"
               << "  --help             Показать эту справку\n";
 }
 
@@ -28,6 +34,9 @@ int main(int argc, char* argv[]) {
     int embedding_dim = 256;
     int hidden_dim = 512;
     double learning_rate = 0.001;
+    formula_teacher::ThreadBudget threads;
+    std::string script_path;
+    std::string bundle_path;
     
     // Разбор аргументов командной строки
     for (int i = 1; i < argc; i++) {
@@ -47,6 +56,14 @@ int main(int argc, char* argv[]) {
             hidden_dim = std::stoi(argv[++i]);
         } else if (strcmp(argv[i], "--learning-rate") == 0 && i + 1 < argc) {
             learning_rate = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads.threads = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+            threads.cpus = formula_teacher::parse_cpu_list(argv[++i]);
+        } else if (strcmp(argv[i], "--export-script") == 0 && i + 1 < argc) {
+            script_path = argv[++i];
+        } else if (strcmp(argv[i], "--bundle") == 0 && i + 1 < argc) {
+            bundle_path = argv[++i];
         } else if (strcmp(argv[i], "--help") == 0) {
             print_usage();
             return 0;
@@ -86,7 +103,7 @@ int main(int argc, char* argv[]) {
         formula_teacher::FormulaModel model(vocab_size, embedding_dim, hidden_dim);
         
         std::cout << "Инициализация тренера..." << std::endl;
-        formula_teacher::FormulaTrainer trainer(model, tokenizer, learning_rate);
+        formula_teacher::FormulaTrainer trainer(model, tokenizer, learning_rate, threads);
         
         std::cout << "Подготовка данных для обучения..." << std::endl;
         trainer.prepare_data(input_path);
@@ -97,6 +114,23 @@ int main(int argc, char* argv[]) {
         
         std::cout << "Обучение завершено. Модель сохранена в " << output_path << std::endl;
         
+        // Кандидаты выходной проекции для быстрого инференса
+        auto shortlist = trainer.build_shortlist();
+        shortlist.save(output_path + ".shortlist");
+        std::cout << "Список кандидатов сохранен в " << output_path << ".shortlist" << std::endl;
+        
+        if (!bundle_path.empty()) {
+            std::cout << "Сохранение пакета модели в " << bundle_path << std::endl;
+            model.save_bundle(bundle_path, tokenizer);
+            shortlist.save(bundle_path + ".shortlist");
+        }
+        
+        if (!script_path.empty()) {
+            std::cout << "Экспорт TorchScript-модели в " << script_path << std::endl;
+            model.eval();
+            formula_teacher::ScriptedFormulaModel::export_model(model, script_path);
+        }
+        
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Ошибка: " << e.what() << std::endl;
@@ -6,8 +6,9 @@
 
 namespace formula_teacher {
 
-FormulaTrainer::FormulaTrainer(FormulaModel& model, FormulaTokenizer& tokenizer, double learning_rate)
-    : model(model), tokenizer(tokenizer), optimizer(model.parameters(), learning_rate) {
+FormulaTrainer::FormulaTrainer(FormulaModel& model, FormulaTokenizer& tokenizer, double learning_rate,
+                               const ThreadBudget& threads)
+    : model(model), tokenizer(tokenizer), optimizer(model.parameters(), learning_rate), threads(threads) {
 }
 
 void FormulaTrainer::prepare_data(const std::string& text_path) {
@@ -45,6 +46,13 @@ void FormulaTrainer::prepare_data(const std::string& text_path) {
               << validation_data.size() << " примеров для валидации." << std::endl;
 }
 
+VocabularyShortlist FormulaTrainer::build_shortlist(int frequent_count, int neighbours_per_token) const {
+    // Соседи считаются по всему корпусу, включая валидационную часть
+    std::vector<std::vector<int>> all_data(training_data);
+    all_data.insert(all_data.end(), validation_data.begin(), validation_data.end());
+    return VocabularyShortlist::build(all_data, tokenizer.vocab_size(), frequent_count, neighbours_per_token);
+}
+
 std::vector<torch::Tensor> FormulaTrainer::create_batches(
     const std::vector<std::vector<int>>& data, int batch_size) {
     
@@ -97,6 +105,16 @@ std::vector<torch::Tensor> FormulaTrainer::create_batches(
 }
 
 void FormulaTrainer::train(int epochs, int batch_size, const std::string& checkpoint_path) {
+    // Обучение - одна сессия, весь бюджет уходит на потоки внутри операций
+    if (threads.threads > 0 || !threads.cpus.empty()) {
+        ThreadBudget budget = threads;
+        budget.sessions = 1;
+        budget.intra_op_threads = 0;
+        auto plan = plan_sessions(budget);
+        pin_current_thread(plan[0].cpus);
+        torch::set_num_threads(plan[0].intra_op_threads);
+    }
+    
     // Переводим модель в режим обучения
     model.train();
     
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "model.h"
+#include "threading.h"
 #include "tokenizer.h"
 #include <torch/torch.h>
 #include <string>
@@ -10,8 +11,10 @@ namespace formula_teacher {
 
 class FormulaTrainer {
 public:
+    // threads - бюджет потоков обучения: число потоков LibTorch и ядра, к которым
+    // привязывается поток, вызывающий train. По умолчанию настройки LibTorch не меняются
     FormulaTrainer(FormulaModel& model, FormulaTokenizer& tokenizer, 
-                   double learning_rate = 0.001);
+                   double learning_rate = 0.001, const ThreadBudget& threads = ThreadBudget());
     
     // Подготовка данных из текстового файла
     void prepare_data(const std::string& text_path);
@@ -22,6 +25,9 @@ public:
     // Валидация модели
     double validate(int batch_size);
     
+    // Список кандидатов выходной проекции по обучающим данным (после prepare_data)
+    VocabularyShortlist build_shortlist(int frequent_count = 2000, int neighbours_per_token = 64) const;
+    
     // Тестирование на примере
     std::string test_example(const std::string& input_text);
     
@@ -37,6 +43,9 @@ private:
     // Оптимизатор
     torch::optim::Adam optimizer;
     
+    // Бюджет потоков обучения
+    ThreadBudget threads;
+    
     // Создание батчей для обучения
     std::vector<torch::Tensor> create_batches(const std::vector<std::vector<int>>& data, 
                                             int batch_size);
@@ -0,0 +1,219 @@
+#include "client.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace formula_teacher {
+namespace daemon {
+
+namespace {
+
+// Строка, которую можно освободить в Vala через free
+char* copy_string(const std::string& text) {
+    char* result = (char*)malloc(text.length() + 1);
+    strcpy(result, text.c_str());
+    return result;
+}
+
+} // namespace
+
+std::unique_ptr<SolverClient> SolverClient::connect(const std::string& socket_path) {
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Слишком длинный путь к сокету: " + socket_path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Не удалось создать сокет: ") + std::strerror(errno));
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Демон недоступен (" + socket_path + "): " + std::strerror(error));
+    }
+    
+    return std::unique_ptr<SolverClient>(new SolverClient(fd));
+}
+
+SolverClient::SolverClient(int fd) : fd(fd) {}
+
+SolverClient::~SolverClient() {
+    close(fd);
+}
+
+void SolverClient::send(const std::string& bytes) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t result = ::send(fd, bytes.data() + written, bytes.size() - written, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Ошибка записи в сокет демона: ") + std::strerror(errno));
+        }
+        written += static_cast<size_t>(result);
+    }
+}
+
+Frame SolverClient::receive(uint32_t request_id) {
+    Frame frame;
+    char chunk[4096];
+    
+    while (true) {
+        size_t consumed = parse_frame(read_buffer.data(), read_buffer.size(), frame);
+        if (consumed > 0) {
+            read_buffer.erase(0, consumed);
+            if (frame.type == FrameType::Error) {
+                throw std::runtime_error("Ошибка демона: " + frame.payload);
+            }
+            if (frame.request_id == request_id) {
+                return frame;
+            }
+            continue;
+        }
+        
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            throw std::runtime_error("Соединение с демоном разорвано");
+        }
+        read_buffer.append(chunk, static_cast<size_t>(result));
+    }
+}
+
+SolveReply SolverClient::solve(const std::string& task_text, uint32_t timeout_ms,
+                               const std::function<void(const std::string&)>& on_fragment,
+                               RequestPriority priority) {
+    std::lock_guard<std::mutex> lock(request_mutex);
+    
+    uint32_t request_id = next_request_id++;
+    std::string bytes;
+    append_frame(bytes, FrameType::Solve, request_id, timeout_ms, task_text, static_cast<uint16_t>(priority));
+    
+    active_request.store(request_id);
+    send(bytes);
+    
+    while (true) {
+        Frame frame = receive(request_id);
+        if (frame.type == FrameType::Fragment) {
+            if (on_fragment) {
+                on_fragment(frame.payload);
+            }
+        } else if (frame.type == FrameType::Result) {
+            active_request.store(0);
+            return {static_cast<int>(payload_value(frame)), payload_text(frame)};
+        }
+    }
+}
+
+void SolverClient::cancel() {
+    uint32_t request_id = active_request.load();
+    if (request_id == 0) {
+        return;
+    }
+    
+    std::string bytes;
+    append_frame(bytes, FrameType::Cancel, request_id);
+    send(bytes);
+}
+
+DaemonInfo SolverClient::info() {
+    std::lock_guard<std::mutex> lock(request_mutex);
+    
+    uint32_t request_id = next_request_id++;
+    std::string bytes;
+    append_frame(bytes, FrameType::Info, request_id);
+    send(bytes);
+    
+    while (true) {
+        Frame frame = receive(request_id);
+        if (frame.type == FrameType::InfoReply) {
+            return {payload_value(frame), payload_text(frame)};
+        }
+    }
+}
+
+} // namespace daemon
+} // namespace formula_teacher
+
+// C API реализация
+extern "C" {
+
+formula_teacher::daemon::SolverClient* formula_client_connect(const char* socket_path) {
+    try {
+        auto path = socket_path ? std::string(socket_path) : formula_teacher::daemon::default_socket_path();
+        return formula_teacher::daemon::SolverClient::connect(path).release();
+    } catch (const std::exception&) {
+        // Демон не запущен - обычная ситуация, вызывающий перейдет на локальную модель
+        return nullptr;
+    }
+}
+
+void formula_client_free(formula_teacher::daemon::SolverClient* client) {
+    delete client;
+}
+
+char* formula_client_solve(formula_teacher::daemon::SolverClient* client, const char* task_text, int timeout_ms,
+                           formula_client_fragment_callback callback, void* user_data, int* status) {
+    if (!client) {
+        return nullptr;
+    }
+    
+    try {
+        std::function<void(const std::string&)> on_fragment;
+        if (callback) {
+            on_fragment = [callback, user_data](const std::string& fragment) {
+                callback(fragment.c_str(), user_data);
+            };
+        }
+        
+        auto reply = client->solve(task_text, timeout_ms > 0 ? static_cast<uint32_t>(timeout_ms) : 0, on_fragment,
+                                   formula_teacher::RequestPriority::Interactive);
+        if (status) {
+            *status = reply.status;
+        }
+        return formula_teacher::daemon::copy_string(reply.text);
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при обращении к демону: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+void formula_client_cancel(formula_teacher::daemon::SolverClient* client) {
+    if (!client) {
+        return;
+    }
+    
+    try {
+        client->cancel();
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при отмене запроса: " << e.what() << std::endl;
+    }
+}
+
+char* formula_client_model_path(formula_teacher::daemon::SolverClient* client) {
+    if (!client) {
+        return nullptr;
+    }
+    
+    try {
+        return formula_teacher::daemon::copy_string(client->info().model_path);
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка при обращении к демону: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "protocol.h"
+#include "../core/request_control.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace formula_teacher {
+namespace daemon {
+
+// Ответ демона на задачу: статус (значение SolveStatus) и текст решения
+struct SolveReply {
+    int status;
+    std::string text;
+};
+
+// Сведения о модели, загруженной в демон
+struct DaemonInfo {
+    uint32_t workers;
+    std::string model_path;
+};
+
+// Тонкий клиент formula-solverd. Одно соединение решает задачи по одной,
+// cancel можно вызывать из другого потока
+class SolverClient {
+public:
+    // Подключение к демону. Бросает std::runtime_error, если демон не запущен
+    static std::unique_ptr<SolverClient> connect(const std::string& socket_path = default_socket_path());
+    
+    ~SolverClient();
+    
+    SolverClient(const SolverClient&) = delete;
+    SolverClient& operator=(const SolverClient&) = delete;
+    
+    // Решение задачи. on_fragment вызывается в текущем потоке для каждого фрагмента.
+    // priority - класс задачи в очереди демона.
+    // Бросает std::runtime_error при обрыве соединения или ошибке протокола
+    SolveReply solve(const std::string& task_text, uint32_t timeout_ms = 0,
+                     const std::function<void(const std::string&)>& on_fragment = nullptr,
+                     RequestPriority priority = RequestPriority::Normal);
+    
+    // Отмена выполняющегося solve: он вернет уже сгенерированную часть решения
+    void cancel();
+    
+    DaemonInfo info();
+    
+private:
+    explicit SolverClient(int fd);
+    
+    void send(const std::string& bytes);
+    
+    // Следующий кадр для request_id, кадры других запросов пропускаются
+    Frame receive(uint32_t request_id);
+    
+    int fd;
+    
+    // Запросы идут по одному, запись отдельно - для cancel из другого потока
+    std::mutex request_mutex;
+    std::mutex write_mutex;
+    
+    uint32_t next_request_id = 1;
+    std::atomic<uint32_t> active_request{0};
+    std::string read_buffer;
+};
+
+} // namespace daemon
+} // namespace formula_teacher
+
+// C API для использования в Vala
+extern "C" {
+    typedef void (*formula_client_fragment_callback)(const char* fragment, void* user_data);
+    
+    // NULL socket_path - путь по умолчанию. Возвращает NULL, если демон не запущен
+    formula_teacher::daemon::SolverClient* formula_client_connect(const char* socket_path);
+    void formula_client_free(formula_teacher::daemon::SolverClient* client);
+    
+    // Решение задачи через демон, как process_task_request, с интерактивным приоритетом.
+    // NULL - соединение потеряно
+    char* formula_client_solve(formula_teacher::daemon::SolverClient* client, const char* task_text, int timeout_ms,
+                               formula_client_fragment_callback callback, void* user_data, int* status);
+    void formula_client_cancel(formula_teacher::daemon::SolverClient* client);
+    
+    // Путь к модели демона, NULL при ошибке
+    char* formula_client_model_path(formula_teacher::daemon::SolverClient* client);
+}
@@ -0,0 +1,102 @@
+#include "client.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void print_usage() {
+    std::cout << "Использование: formula-client [опции] [задача ...]\n"
+              << "Решает задачи через запущенный formula-solverd. Без задач в аргументах\n"
+              << "читает по одной задаче на строку из stdin. Решение выводится по мере генерации\n"
+              << "Опции:\n"
+              << "  --socket PATH      Путь к сокету демона\n"
+              << "  --timeout MS       Срок решения одной задачи в миллисекундах (0 - без срока)\n"
+              << "  --priority CLASS   Класс задач в очереди демона: interactive, normal (по умолчанию)\n"
+              << "                     или background\n"
+              << "  --info             Показать модель и число потоков демона\n"
+              << "  --help             Показать эту справку\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = formula_teacher::daemon::default_socket_path();
+    uint32_t timeout_ms = 0;
+    auto priority = formula_teacher::RequestPriority::Normal;
+    bool show_info = false;
+    std::vector<std::string> tasks;
+    
+    // Разбор аргументов командной строки
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            timeout_ms = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--priority") == 0 && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "interactive") {
+                priority = formula_teacher::RequestPriority::Interactive;
+            } else if (name == "normal") {
+                priority = formula_teacher::RequestPriority::Normal;
+            } else if (name == "background") {
+                priority = formula_teacher::RequestPriority::Background;
+            } else {
+                std::cerr << "Неизвестный класс приоритета: " << name << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--info") == 0) {
+            show_info = true;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage();
+            return 0;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            std::cerr << "Неизвестный аргумент: " << argv[i] << std::endl;
+            print_usage();
+            return 1;
+        } else {
+            tasks.push_back(argv[i]);
+        }
+    }
+    
+    try {
+        auto client = formula_teacher::daemon::SolverClient::connect(socket_path);
+        
+        if (show_info) {
+            auto info = client->info();
+            std::cout << "Модель: " << info.model_path << "\n"
+                      << "Потоков: " << info.workers << std::endl;
+            return 0;
+        }
+        
+        // Коды статуса совпадают с SolveStatus
+        static const char* status_names[] = {"completed", "max_length", "deadline_exceeded", "cancelled", "error"};
+        
+        int exit_code = 0;
+        auto solve = [&](const std::string& task) {
+            auto reply = client->solve(task, timeout_ms, [](const std::string& fragment) {
+                std::cout << fragment << std::flush;
+            }, priority);
+            std::cout << std::endl;
+            
+            if (reply.status >= 2) {
+                const char* name = reply.status <= 4 ? status_names[reply.status] : "unknown";
+                std::cerr << "Решение не завершено: " << name << std::endl;
+                exit_code = 2;
+            }
+        };
+        
+        if (tasks.empty()) {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                solve(line);
+            }
+        } else {
+            for (const auto& task : tasks) {
+                solve(task);
+            }
+        }
+        
+        return exit_code;
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 1;
+    }
+}
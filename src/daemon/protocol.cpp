@@ -0,0 +1,119 @@
+#include "protocol.h"
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace formula_teacher {
+namespace daemon {
+
+namespace {
+
+void put_u16(std::string& buffer, uint16_t value) {
+    buffer.push_back(static_cast<char>(value & 0xff));
+    buffer.push_back(static_cast<char>(value >> 8));
+}
+
+void put_u32(std::string& buffer, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        buffer.push_back(static_cast<char>((value >> shift) & 0xff));
+    }
+}
+
+uint16_t get_u16(const char* data) {
+    auto bytes = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t get_u32(const char* data) {
+    auto bytes = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+bool known_type(uint16_t type) {
+    switch (static_cast<FrameType>(type)) {
+        case FrameType::Solve:
+        case FrameType::Cancel:
+        case FrameType::Info:
+        case FrameType::Fragment:
+        case FrameType::Result:
+        case FrameType::InfoReply:
+        case FrameType::Error:
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+void append_frame(std::string& buffer, FrameType type, uint32_t request_id, const std::string& payload,
+                  uint16_t flags) {
+    if (payload.size() > MAX_FRAME_PAYLOAD) {
+        throw std::runtime_error("Слишком длинный кадр: " + std::to_string(payload.size()) + " байт");
+    }
+    
+    buffer.reserve(buffer.size() + FRAME_HEADER_SIZE + payload.size());
+    put_u32(buffer, static_cast<uint32_t>(payload.size()));
+    put_u16(buffer, static_cast<uint16_t>(type));
+    put_u16(buffer, flags);
+    put_u32(buffer, request_id);
+    buffer += payload;
+}
+
+void append_frame(std::string& buffer, FrameType type, uint32_t request_id, uint32_t value,
+                  const std::string& text, uint16_t flags) {
+    std::string payload;
+    payload.reserve(4 + text.size());
+    put_u32(payload, value);
+    payload += text;
+    append_frame(buffer, type, request_id, payload, flags);
+}
+
+size_t parse_frame(const char* data, size_t size, Frame& frame) {
+    if (size < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    
+    uint32_t length = get_u32(data);
+    uint16_t type = get_u16(data + 4);
+    if (length > MAX_FRAME_PAYLOAD) {
+        throw std::runtime_error("Слишком длинный кадр: " + std::to_string(length) + " байт");
+    }
+    if (!known_type(type)) {
+        throw std::runtime_error("Неизвестный тип кадра: " + std::to_string(type));
+    }
+    if (size < FRAME_HEADER_SIZE + length) {
+        return 0;
+    }
+    
+    frame.type = static_cast<FrameType>(type);
+    frame.flags = get_u16(data + 6);
+    frame.request_id = get_u32(data + 8);
+    frame.payload.assign(data + FRAME_HEADER_SIZE, length);
+    return FRAME_HEADER_SIZE + length;
+}
+
+uint32_t payload_value(const Frame& frame) {
+    if (frame.payload.size() < 4) {
+        throw std::runtime_error("Короткие данные кадра");
+    }
+    return get_u32(frame.payload.data());
+}
+
+std::string payload_text(const Frame& frame) {
+    if (frame.payload.size() < 4) {
+        throw std::runtime_error("Короткие данные кадра");
+    }
+    return frame.payload.substr(4);
+}
+
+std::string default_socket_path() {
+    const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && *runtime_dir) {
+        return std::string(runtime_dir) + "/formula-solverd.sock";
+    }
+    return "/tmp/formula-solverd-" + std::to_string(getuid()) + ".sock";
+}
+
+} // namespace daemon
+} // namespace formula_teacher
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace formula_teacher {
+namespace daemon {
+
+// Протокол formula-solverd поверх Unix-сокета.
+// Кадр - заголовок из 12 байт и данные. Все числа в little-endian:
+//   uint32 length      длина данных без заголовка
+//   uint16 type        FrameType
+//   uint16 flags       для Solve - класс приоритета (RequestPriority), для остальных 0
+//   uint32 request_id  номер запроса, выбранный клиентом
+// Ответы на один запрос приходят в порядке генерации: ноль или больше Fragment, затем Result.
+// Запросы разных клиентов и запросы одного клиента обрабатываются независимо
+enum class FrameType : uint16_t {
+    // Клиент -> демон
+    Solve = 1,      // uint32 timeout_ms (0 - без срока) + текст задачи
+    Cancel = 2,     // без данных
+    Info = 3,       // без данных
+    
+    // Демон -> клиент
+    Fragment = 16,  // очередной фрагмент решения
+    Result = 17,    // uint32 статус (SolveStatus) + полный текст решения
+    InfoReply = 18, // uint32 число потоков-исполнителей + путь к модели
+    Error = 19      // сообщение об ошибке протокола, соединение закрывается
+};
+
+const size_t FRAME_HEADER_SIZE = 12;
+
+// Максимальная длина данных кадра: задачи и решения короткие, больше - ошибка протокола
+const uint32_t MAX_FRAME_PAYLOAD = 1 << 20;
+
+struct Frame {
+    FrameType type;
+    uint16_t flags;
+    uint32_t request_id;
+    std::string payload;
+};
+
+// Дописывает кадр в конец buffer
+void append_frame(std::string& buffer, FrameType type, uint32_t request_id, const std::string& payload = "",
+                  uint16_t flags = 0);
+
+// Кадр с числом в начале данных (Solve, Result, InfoReply)
+void append_frame(std::string& buffer, FrameType type, uint32_t request_id, uint32_t value,
+                  const std::string& text, uint16_t flags = 0);
+
+// Разбор первого кадра из data. Возвращает число прочитанных байт или 0, если кадр
+// еще не пришел целиком. Бросает std::runtime_error при нарушении протокола
+size_t parse_frame(const char* data, size_t size, Frame& frame);
+
+// Число в начале данных кадра и текст после него. Бросает std::runtime_error, если данных меньше 4 байт
+uint32_t payload_value(const Frame& frame);
+std::string payload_text(const Frame& frame);
+
+// Путь к сокету по умолчанию: $XDG_RUNTIME_DIR/formula-solverd.sock
+// или /tmp/formula-solverd-<uid>.sock
+std::string default_socket_path();
+
+} // namespace daemon
+} // namespace formula_teacher
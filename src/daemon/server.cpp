@@ -0,0 +1,420 @@
+#include "server.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace formula_teacher {
+namespace daemon {
+
+namespace {
+
+// Служебные идентификаторы в epoll_event.data.u64, клиенты нумеруются после них
+const uint64_t LISTEN_ID = 1;
+const uint64_t WAKE_ID = 2;
+const uint64_t SIGNAL_ID = 3;
+const uint64_t FIRST_CONNECTION_ID = 16;
+
+// Клиент, не читающий ответы, отключается, чтобы не копить вывод бесконечно
+const size_t MAX_PENDING_OUTPUT = 16 << 20;
+
+std::runtime_error system_error(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void watch(int epoll_fd, int fd, uint64_t id, uint32_t events, int operation = EPOLL_CTL_ADD) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll_fd, operation, fd, &event) != 0) {
+        throw system_error("Ошибка epoll_ctl");
+    }
+}
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Слишком длинный путь к сокету: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+} // namespace
+
+void SolverServer::block_stop_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
+    // Запись в отключившийся сокет не должна завершать процесс
+    std::signal(SIGPIPE, SIG_IGN);
+}
+
+SolverServer::SolverServer(FormulaEngine& engine, const std::string& socket_path, const std::string& model_path)
+    : engine(engine), socket_path(socket_path), model_path(model_path), next_connection_id(FIRST_CONNECTION_ID) {
+    auto address = socket_address(socket_path);
+    
+    // Оставшийся от упавшего демона файл сокета удаляем, живой демон не трогаем
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        bool alive = connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        close(probe);
+        if (alive) {
+            throw std::runtime_error("Демон уже запущен на сокете " + socket_path);
+        }
+    }
+    unlink(socket_path.c_str());
+    
+    try {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            throw system_error("Не удалось создать сокет");
+        }
+        if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            throw system_error("Не удалось привязать сокет " + socket_path);
+        }
+        // Решения доступны только владельцу демона
+        chmod(socket_path.c_str(), S_IRUSR | S_IWUSR);
+        if (listen(listen_fd, SOMAXCONN) != 0) {
+            throw system_error("Ошибка listen");
+        }
+        
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || wake_fd < 0) {
+            throw system_error("Не удалось создать epoll или eventfd");
+        }
+        
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGHUP);
+        signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd < 0) {
+            throw system_error("Не удалось создать signalfd");
+        }
+        
+        watch(epoll_fd, listen_fd, LISTEN_ID, EPOLLIN);
+        watch(epoll_fd, wake_fd, WAKE_ID, EPOLLIN);
+        watch(epoll_fd, signal_fd, SIGNAL_ID, EPOLLIN);
+    } catch (...) {
+        for (int fd : {listen_fd, epoll_fd, wake_fd, signal_fd}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        unlink(socket_path.c_str());
+        throw;
+    }
+}
+
+SolverServer::~SolverServer() {
+    for (auto& entry : connections) {
+        close(entry.second.fd);
+    }
+    for (int fd : {listen_fd, epoll_fd, wake_fd, signal_fd}) {
+        close(fd);
+    }
+    unlink(socket_path.c_str());
+}
+
+void SolverServer::run() {
+    std::vector<epoll_event> events(64);
+    bool stopping = false;
+    
+    while (!stopping) {
+        int count = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error("Ошибка epoll_wait");
+        }
+        
+        for (int i = 0; i < count; ++i) {
+            uint64_t id = events[i].data.u64;
+            uint32_t flags = events[i].events;
+            
+            if (id == LISTEN_ID) {
+                accept_clients();
+            } else if (id == WAKE_ID) {
+                deliver_outgoing();
+            } else if (id == SIGNAL_ID) {
+                signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    // SIGHUP - перезагрузка модели без остановки, она идет на потоке движка
+                    if (info.ssi_signo == SIGHUP && reload_handler) {
+                        reload_handler();
+                    } else if (info.ssi_signo != SIGHUP) {
+                        stopping = true;
+                    }
+                }
+            } else {
+                auto it = connections.find(id);
+                if (it == connections.end()) {
+                    continue;
+                }
+                if (flags & (EPOLLERR | EPOLLHUP)) {
+                    close_client(id);
+                    continue;
+                }
+                if ((flags & EPOLLOUT) && !flush(id, it->second)) {
+                    continue;
+                }
+                if (flags & EPOLLIN) {
+                    read_client(id);
+                }
+            }
+        }
+    }
+    
+    // Отменяем все запросы и ждем их результатов: после возврата исполнители
+    // больше не обращаются к серверу
+    for (auto& entry : connections) {
+        for (auto& request : entry.second.requests) {
+            request.second->cancel();
+        }
+    }
+    std::unique_lock<std::mutex> lock(in_flight_mutex);
+    in_flight_cv.wait(lock, [this] { return in_flight == 0; });
+}
+
+void SolverServer::accept_clients() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Ошибка accept: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        
+        uint64_t id = next_connection_id++;
+        Connection connection;
+        connection.fd = fd;
+        connections.emplace(id, std::move(connection));
+        watch(epoll_fd, fd, id, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+void SolverServer::read_client(uint64_t id) {
+    auto& connection = connections.at(id);
+    char chunk[16384];
+    
+    while (true) {
+        ssize_t result = recv(connection.fd, chunk, sizeof(chunk), 0);
+        if (result > 0) {
+            connection.input.append(chunk, static_cast<size_t>(result));
+            continue;
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        // Клиент закрыл соединение или ошибка чтения
+        close_client(id);
+        return;
+    }
+    
+    try {
+        Frame frame;
+        size_t offset = 0;
+        while (size_t consumed = parse_frame(connection.input.data() + offset,
+                                             connection.input.size() - offset, frame)) {
+            offset += consumed;
+            handle_frame(id, connection, frame);
+        }
+        connection.input.erase(0, offset);
+    } catch (const std::exception& e) {
+        // Нарушение протокола: сообщаем клиенту и закрываем соединение
+        append_frame(connection.output, FrameType::Error, 0, e.what());
+        flush(id, connection);
+        close_client(id);
+        return;
+    }
+    
+    flush(id, connection);
+}
+
+void SolverServer::handle_frame(uint64_t id, Connection& connection, const Frame& frame) {
+    switch (frame.type) {
+        case FrameType::Solve:
+            start_solve(id, connection, frame);
+            break;
+        case FrameType::Cancel: {
+            auto it = connection.requests.find(frame.request_id);
+            if (it != connection.requests.end()) {
+                it->second->cancel();
+            }
+            break;
+        }
+        case FrameType::Info:
+            append_frame(connection.output, FrameType::InfoReply, frame.request_id,
+                         static_cast<uint32_t>(engine.num_workers()), model_path);
+            break;
+        default:
+            throw std::runtime_error("Кадр не предназначен демону: " +
+                                     std::to_string(static_cast<int>(frame.type)));
+    }
+}
+
+void SolverServer::start_solve(uint64_t id, Connection& connection, const Frame& frame) {
+    uint32_t request_id = frame.request_id;
+    uint32_t timeout_ms = payload_value(frame);
+    
+    if (connection.requests.count(request_id)) {
+        append_frame(connection.output, FrameType::Result, request_id, static_cast<uint32_t>(SolveStatus::Error),
+                     "Ошибка: Запрос с таким номером уже выполняется");
+        return;
+    }
+    
+    auto cancellation = std::make_shared<CancellationToken>();
+    connection.requests.emplace(request_id, cancellation);
+    
+    SolveRequest request;
+    request.limits = RequestLimits::with_timeout(std::chrono::milliseconds(timeout_ms));
+    request.limits.cancellation = cancellation;
+    request.priority = request_priority_from_int(frame.flags);
+    request.on_fragment = [this, id, request_id](const std::string& fragment) {
+        Outgoing message{id, request_id, false, std::string()};
+        append_frame(message.bytes, FrameType::Fragment, request_id, fragment);
+        post(std::move(message));
+    };
+    
+    {
+        std::lock_guard<std::mutex> lock(in_flight_mutex);
+        in_flight++;
+    }
+    
+    engine.submit(payload_text(frame), std::move(request), [this, id, request_id](SolveResult result) {
+        Outgoing message{id, request_id, true, std::string()};
+        append_frame(message.bytes, FrameType::Result, request_id, static_cast<uint32_t>(result.status),
+                     result.text);
+        post(std::move(message));
+        
+        std::lock_guard<std::mutex> lock(in_flight_mutex);
+        if (--in_flight == 0) {
+            in_flight_cv.notify_all();
+        }
+    });
+}
+
+bool SolverServer::flush(uint64_t id, Connection& connection) {
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        ssize_t result = send(connection.fd, connection.output.data() + written,
+                              connection.output.size() - written, MSG_NOSIGNAL);
+        if (result > 0) {
+            written += static_cast<size_t>(result);
+            continue;
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        close_client(id);
+        return false;
+    }
+    connection.output.erase(0, written);
+    
+    if (connection.output.size() > MAX_PENDING_OUTPUT) {
+        std::cerr << "Клиент не читает ответы, соединение закрыто" << std::endl;
+        close_client(id);
+        return false;
+    }
+    
+    // EPOLLOUT нужен, только пока есть недописанный вывод
+    bool want_write = !connection.output.empty();
+    if (want_write != connection.want_write) {
+        connection.want_write = want_write;
+        watch(epoll_fd, connection.fd, id, EPOLLIN | EPOLLRDHUP | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u), EPOLL_CTL_MOD);
+    }
+    return true;
+}
+
+void SolverServer::close_client(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        return;
+    }
+    
+    // Решения для отключившегося клиента больше не нужны
+    for (auto& request : it->second.requests) {
+        request.second->cancel();
+    }
+    
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    close(it->second.fd);
+    connections.erase(it);
+}
+
+void SolverServer::post(Outgoing message) {
+    {
+        std::lock_guard<std::mutex> lock(outgoing_mutex);
+        outgoing.push_back(std::move(message));
+    }
+    
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void SolverServer::deliver_outgoing() {
+    uint64_t counter;
+    ssize_t ignored = read(wake_fd, &counter, sizeof(counter));
+    (void)ignored;
+    
+    std::vector<Outgoing> messages;
+    {
+        std::lock_guard<std::mutex> lock(outgoing_mutex);
+        messages.swap(outgoing);
+    }
+    
+    // Сначала копим вывод по клиентам, потом пишем по одному разу на клиента
+    std::vector<uint64_t> touched;
+    for (auto& message : messages) {
+        auto it = connections.find(message.connection_id);
+        if (it == connections.end()) {
+            continue;
+        }
+        if (message.final) {
+            it->second.requests.erase(message.request_id);
+        }
+        if (it->second.output.empty()) {
+            touched.push_back(message.connection_id);
+        }
+        it->second.output += message.bytes;
+    }
+    
+    for (uint64_t id : touched) {
+        auto it = connections.find(id);
+        if (it != connections.end()) {
+            flush(id, it->second);
+        }
+    }
+}
+
+} // namespace daemon
+} // namespace formula_teacher
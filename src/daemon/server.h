@@ -0,0 +1,98 @@
+#pragma once
+
+#include "protocol.h"
+#include "../core/engine.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace formula_teacher {
+namespace daemon {
+
+// Сервер formula-solverd: один поток с epoll обслуживает всех клиентов,
+// задачи решаются потоками-исполнителями FormulaEngine. Ответы исполнителей
+// складываются в очередь и будят цикл событий через eventfd
+class SolverServer {
+public:
+    // Создает сокет socket_path. Бросает std::runtime_error, если сокет занят другим демоном.
+    // SIGINT и SIGTERM должны быть заблокированы до создания потоков движка (см. block_stop_signals)
+    SolverServer(FormulaEngine& engine, const std::string& socket_path, const std::string& model_path);
+    ~SolverServer();
+    
+    SolverServer(const SolverServer&) = delete;
+    SolverServer& operator=(const SolverServer&) = delete;
+    
+    // Цикл событий до SIGINT или SIGTERM. Перед возвратом отменяет незавершенные
+    // запросы и ждет, пока исполнители вернут их результаты
+    void run();
+    
+    // Обработчик SIGHUP, вызывается в цикле событий. Долгую работу (перезагрузку модели)
+    // он должен передать другому потоку, например FormulaEngine::run
+    void on_reload(std::function<void()> handler) { reload_handler = std::move(handler); }
+    
+    // Блокировка SIGINT, SIGTERM и SIGHUP в текущем потоке: их принимает цикл событий через signalfd
+    static void block_stop_signals();
+    
+private:
+    struct Connection {
+        int fd;
+        std::string input;
+        std::string output;
+        bool want_write = false;
+        
+        // Выполняющиеся запросы клиента
+        std::unordered_map<uint32_t, std::shared_ptr<CancellationToken>> requests;
+    };
+    
+    // Кадр от потока-исполнителя для клиента
+    struct Outgoing {
+        uint64_t connection_id;
+        uint32_t request_id;
+        bool final;
+        std::string bytes;
+    };
+    
+    void accept_clients();
+    void read_client(uint64_t id);
+    void handle_frame(uint64_t id, Connection& connection, const Frame& frame);
+    void start_solve(uint64_t id, Connection& connection, const Frame& frame);
+    
+    // Запись накопленного вывода, при переполнении сокета - ожидание EPOLLOUT.
+    // false - клиент отключился
+    bool flush(uint64_t id, Connection& connection);
+    void close_client(uint64_t id);
+    
+    // Вызывается из потоков-исполнителей
+    void post(Outgoing message);
+    void deliver_outgoing();
+    
+    FormulaEngine& engine;
+    std::string socket_path;
+    std::string model_path;
+    std::function<void()> reload_handler;
+    
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    int signal_fd = -1;
+    
+    uint64_t next_connection_id;
+    std::unordered_map<uint64_t, Connection> connections;
+    
+    std::mutex outgoing_mutex;
+    std::vector<Outgoing> outgoing;
+    
+    // Запросы, отданные движку и еще не вернувшие результат
+    std::mutex in_flight_mutex;
+    std::condition_variable in_flight_cv;
+    int in_flight = 0;
+};
+
+} // namespace daemon
+} // namespace formula_teacher
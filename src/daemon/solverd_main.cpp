@@ -0,0 +1,147 @@
+#include "server.h"
+#include "../core/bundle_file.h"
+#include "../core/engine.h"
+#include "../core/threading.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+void print_usage() {
+    std::cout << "Использование: formula-solverd --model FILE [опции]\n"
+              << "Держит модель загруженной и решает задачи клиентов через Unix-сокет.\n"
+              << "По SIGHUP перечитывает модель и словарь без остановки обслуживания\n"
+              << "Опции:\n"
+              << "  --model FILE           Модель (.pt, .ftb)\n"
+              << "  --vocab FILE           Словарь (по умолчанию model_path + .vocab, для .ftb не нужен)\n"
+              << "  --socket PATH          Путь к сокету (по умолчанию $XDG_RUNTIME_DIR/formula-solverd.sock)\n"
+              << "  --workers N            Число потоков-исполнителей (по умолчанию по числу ядер)\n"
+              << "  --intra-op N           Потоков LibTorch внутри операций на исполнителя (по умолчанию 1)\n"
+              << "  --batch N              Задач в непрерывном батче исполнителя (по умолчанию 1 - без батча)\n"
+              << "  --cpus LIST            Ядра для исполнителей, например 0-3,8 (по умолчанию без привязки)\n"
+              << "  --quantize             Квантовать модель в int8\n"
+              << "  --shared-weights       Веса .pt в разделяемой памяти, общей с другими процессами\n"
+              << "  --constrain-formulas   Ответы только с закрытыми формулами и сбалансированными скобками\n"
+              << "  --max-formulas N       С --constrain-formulas: ответ заканчивается после N формул\n"
+              << "  --no-symbolic          Решать все задачи моделью, без символьного решателя\n"
+              << "  --encoder-cache-mb N   Объем кэша энкодера в МБ (по умолчанию 64, 0 - выключить)\n"
+              << "  --solution-cache FILE  Постоянный кэш готовых решений\n"
+              << "  --help                 Показать эту справку\n";
+}
+
+bool file_exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+int main(int argc, char* argv[]) {
+    std::string model_path;
+    std::string vocab_path;
+    std::string socket_path = formula_teacher::daemon::default_socket_path();
+    std::string solution_cache_path;
+    formula_teacher::ThreadBudget budget;
+    int encoder_cache_mb = 64;
+    int max_batch_size = 1;
+    bool quantize = false;
+    bool shared_weights = false;
+    bool symbolic = true;
+    formula_teacher::GenerationOptions generation_options;
+    
+    // Разбор аргументов командной строки
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_path = argv[++i];
+        } else if (strcmp(argv[i], "--vocab") == 0 && i + 1 < argc) {
+            vocab_path = argv[++i];
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            budget.sessions = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--intra-op") == 0 && i + 1 < argc) {
+            budget.intra_op_threads = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            max_batch_size = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+            budget.cpus = formula_teacher::parse_cpu_list(argv[++i]);
+        } else if (strcmp(argv[i], "--quantize") == 0) {
+            quantize = true;
+        } else if (strcmp(argv[i], "--shared-weights") == 0) {
+            shared_weights = true;
+        } else if (strcmp(argv[i], "--constrain-formulas") == 0) {
+            generation_options.constrain_formulas = true;
+        } else if (strcmp(argv[i], "--max-formulas") == 0 && i + 1 < argc) {
+            generation_options.max_formulas = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-symbolic") == 0) {
+            symbolic = false;
+        } else if (strcmp(argv[i], "--encoder-cache-mb") == 0 && i + 1 < argc) {
+            encoder_cache_mb = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--solution-cache") == 0 && i + 1 < argc) {
+            solution_cache_path = argv[++i];
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage();
+            return 0;
+        } else {
+            std::cerr << "Неизвестный аргумент: " << argv[i] << std::endl;
+            print_usage();
+            return 1;
+        }
+    }
+    
+    if (model_path.empty()) {
+        std::cerr << "Ошибка: Не указан обязательный аргумент --model" << std::endl;
+        print_usage();
+        return 1;
+    }
+    
+    // Сигналы остановки принимает цикл событий, потоки движка их наследуют заблокированными
+    formula_teacher::daemon::SolverServer::block_stop_signals();
+    
+    try {
+        formula_teacher::FormulaEngine engine(budget);
+        engine.set_shared_weights(shared_weights);
+        engine.set_max_batch_size(max_batch_size);
+        engine.set_generation_options(generation_options);
+        engine.set_symbolic_solver(symbolic);
+        
+        // Пакет модели содержит словарь, для .pt ищем его рядом
+        if (!formula_teacher::BundleFile::is_bundle(model_path) && vocab_path.empty()) {
+            vocab_path = model_path + ".vocab";
+            std::string replaced = model_path;
+            auto dot = replaced.rfind(".pt");
+            if (!file_exists(vocab_path) && dot != std::string::npos) {
+                vocab_path = replaced.replace(dot, 3, ".vocab");
+            }
+        }
+        
+        if (!engine.load(model_path, vocab_path, quantize)) {
+            std::cerr << "Ошибка: Не удалось загрузить модель " << model_path << " со словарем" << std::endl;
+            return 1;
+        }
+        
+        engine.set_encoder_cache_size(static_cast<size_t>(encoder_cache_mb) << 20);
+        if (!solution_cache_path.empty() && !engine.open_solution_cache(solution_cache_path)) {
+            return 1;
+        }
+        
+        formula_teacher::daemon::SolverServer server(engine, socket_path, model_path);
+        
+        // Ночное переобучение: новая модель подменяет старую, кэши и соединения сохраняются
+        server.on_reload([&engine, model_path, vocab_path, quantize] {
+            engine.run([&engine, model_path, vocab_path, quantize] {
+                if (engine.load(model_path, vocab_path, quantize)) {
+                    std::cout << "formula-solverd: модель перезагружена из " << model_path << std::endl;
+                } else {
+                    std::cerr << "formula-solverd: не удалось перезагрузить модель, работает прежняя" << std::endl;
+                }
+            });
+        });
+        std::cout << "formula-solverd: " << engine.num_workers() << " потоков, сокет " << socket_path << std::endl;
+        
+        server.run();
+        
+        std::cout << "formula-solverd: остановлен" << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 1;
+    }
+}
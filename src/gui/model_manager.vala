@@ -1,63 +1,185 @@
 using GLib;
 
+// Очередь событий асинхронного C API движка: обработчики запросов выполняются
+// в потоке, который вызывает dispatch, когда дескриптор готов к чтению
+[Compact]
+[CCode (cname = "FormulaQueue", free_function = "formula_queue_free")]
+public class FormulaQueue {
+    [CCode (cname = "formula_queue_new")]
+    public FormulaQueue();
+    
+    [CCode (cname = "formula_queue_fd")]
+    public int fd();
+    
+    [CCode (cname = "formula_queue_dispatch")]
+    public int dispatch();
+    
+    [CCode (cname = "formula_queue_cancel")]
+    public bool cancel(uint64 request_id);
+}
+
+// Ожидание асинхронной загрузки модели, передается в C API как user_data
+private class PendingLoad {
+    public SourceFunc resume;
+    public bool success = false;
+    
+    public PendingLoad(owned SourceFunc resume) {
+        this.resume = (owned) resume;
+    }
+}
+
 public class ModelManager : Object {
     private bool model_loaded = false;
     private string model_path = "";
     private string vocabulary_path = "";
     
+    // Handle of the C++ inference engine shared by all TaskProcessor calls
+    private void* engine = null;
+    
+    // Подключение к formula-solverd, если демон запущен: тогда модель уже загружена в нем
+    private void* daemon_client = null;
+    
+    // Очередь событий движка и её источник в главном цикле
+    private FormulaQueue queue;
+    private IOSource queue_source;
+    
     // External C function declarations
-    [CCode (cname = "load_model_from_file")]
-    private extern bool load_model_from_file_c(string model_path);
+    [CCode (cname = "formula_engine_new_with_budget")]
+    private extern void* formula_engine_new_with_budget_c(int threads, int sessions, string? cpus);
     
-    [CCode (cname = "load_vocabulary_from_file")]
-    private extern bool load_vocabulary_from_file_c(string vocab_path);
+    [CCode (cname = "formula_engine_free")]
+    private extern void formula_engine_free_c(void* engine);
     
-    public ModelManager() {
-        // Initialize
-    }
+    [CCode (has_target = false)]
+    private delegate void LoadCallback(uint64 request_id, bool success, void* user_data);
     
-    public async void load_model(string path) throws Error {
-        // Look for vocabulary file in the same directory
-        string vocab_path = path.replace(".pt", ".vocab");
-        
-        SourceFunc callback = load_model.callback;
+    [CCode (cname = "formula_engine_load_async")]
+    private extern uint64 formula_engine_load_async_c(void* engine, FormulaQueue queue, string model_path,
+                                                      string? vocab_path, LoadCallback on_loaded, void* user_data);
+    
+    [CCode (cname = "formula_engine_set_shared_weights")]
+    private extern void formula_engine_set_shared_weights_c(void* engine, bool enabled);
+    
+    [CCode (cname = "is_model_bundle_file")]
+    private extern bool is_model_bundle_file_c(string path);
+    
+    [CCode (cname = "formula_client_connect")]
+    private extern void* formula_client_connect_c(string? socket_path);
+    
+    [CCode (cname = "formula_client_free")]
+    private extern void formula_client_free_c(void* client);
+    
+    [CCode (cname = "formula_client_model_path")]
+    private extern string? formula_client_model_path_c(void* client);
+    
+    // context - цикл событий, в котором выполняются обработчики движка
+    // (по умолчанию - цикл текущего потока)
+    public ModelManager(MainContext? context = null) {
+        queue = new FormulaQueue();
         
-        ThreadFunc<bool> run = () => {
-            bool success = load_model_from_file_c(path);
-            if (success && FileUtils.test(vocab_path, FileTest.EXISTS)) {
-                success = load_vocabulary_from_file_c(vocab_path);
-            }
-            
-            Idle.add((owned) callback);
-            return success;
-        };
+        // Замыкание не захватывает this, иначе источник не даст освободить менеджер
+        unowned FormulaQueue events = queue;
+        queue_source = new IOSource(new IOChannel.unix_new(events.fd()), IOCondition.IN);
+        queue_source.set_callback(() => {
+            events.dispatch();
+            return Source.CONTINUE;
+        });
+        queue_source.attach(context ?? MainContext.ref_thread_default());
         
-        try {
-            Thread<bool> thread = new Thread<bool>("model-load", (owned) run);
-            yield;
-            
-            bool success = thread.join();
-            if (success) {
+        // Сначала пробуем демон: он держит модель загруженной для всех процессов
+        daemon_client = formula_client_connect_c(null);
+        if (daemon_client != null) {
+            string? daemon_model = formula_client_model_path_c(daemon_client);
+            if (daemon_model != null) {
                 model_loaded = true;
-                model_path = path;
-                vocabulary_path = vocab_path;
+                model_path = daemon_model;
             } else {
-                throw new IOError.FAILED("Не удалось загрузить модель");
+                disconnect_daemon();
             }
-        } catch (Error e) {
-            throw new IOError.FAILED("Ошибка при загрузке модели: " + e.message);
         }
     }
     
+    ~ModelManager() {
+        disconnect_daemon();
+        queue_source.destroy();
+        
+        // Движок дорешивает очередь до освобождения очереди событий
+        if (engine != null) {
+            formula_engine_free_c(engine);
+        }
+    }
+    
+    // Подключение к демону или null, если задачи решает локальный движок
+    public void* get_daemon_client() {
+        return daemon_client;
+    }
+    
+    // Отказ от демона (например, соединение разорвано): дальше работает только локальная модель
+    public void disconnect_daemon() {
+        if (daemon_client == null) {
+            return;
+        }
+        formula_client_free_c(daemon_client);
+        daemon_client = null;
+        
+        // Пока демон подключен, локальная модель не загружается, поэтому без него модели нет
+        model_loaded = false;
+        model_path = "";
+    }
+    
+    public async void load_model(string path) throws Error {
+        // A .ftb bundle carries its own vocabulary, otherwise look for the
+        // vocabulary file in the same directory
+        bool is_bundle = is_model_bundle_file_c(path);
+        string vocab_path = is_bundle ? path : path.replace(".pt", ".vocab");
+        
+        if (engine == null) {
+            // Leave one core for the GTK main loop, one single-threaded worker per remaining core
+            int threads = int.max(1, (int) get_num_processors() - 1);
+            engine = formula_engine_new_with_budget_c(threads, 0, null);
+            
+            // Несколько окон на одном сервере держат одну копию весов
+            formula_engine_set_shared_weights_c(engine, true);
+        }
+        
+        // Загрузка идет на потоке-исполнителе движка, результат приходит через очередь событий
+        string? load_vocab = !is_bundle && FileUtils.test(vocab_path, FileTest.EXISTS) ? vocab_path : null;
+        var pending = new PendingLoad(load_model.callback);
+        if (formula_engine_load_async_c(engine, queue, path, load_vocab, on_loaded, pending) == 0) {
+            throw new IOError.FAILED("Ошибка при загрузке модели: движок не создан");
+        }
+        
+        yield;
+        
+        if (!pending.success) {
+            throw new IOError.FAILED("Ошибка при загрузке модели: Не удалось загрузить модель");
+        }
+        
+        // Явно выбранная модель загружается локально, демон с другой моделью больше не нужен
+        disconnect_daemon();
+        model_loaded = true;
+        model_path = path;
+        vocabulary_path = vocab_path;
+    }
+    
+    private static void on_loaded(uint64 request_id, bool success, void* user_data) {
+        PendingLoad pending = (PendingLoad) user_data;
+        pending.success = success;
+        pending.resume();
+    }
+    
+    // Очередь событий движка для асинхронных запросов
+    public unowned FormulaQueue get_queue() {
+        return queue;
+    }
+    
     public bool is_model_loaded() {
         return model_loaded;
     }
     
     public void* get_model() {
-        // This function would return a pointer to the C++ model object
-        // For simplicity in this Vala interface, we return void*
-        // In a real implementation, there would be an external C function to get the model pointer
-        return null;
+        // Engine handle to pass to TaskProcessor.process_task
+        return engine;
     }
     
     public string get_model_path() {
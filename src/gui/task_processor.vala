@@ -1,20 +1,126 @@
 using GLib;
 
+// Чем закончилось решение, совпадает с SolveStatus из ядра
+public enum SolveStatus {
+    COMPLETED,
+    MAX_LENGTH,
+    DEADLINE_EXCEEDED,
+    CANCELLED,
+    ERROR
+}
+
+// Результат решения из асинхронного C API, память принадлежит ядру (подсчет ссылок)
+[Compact]
+[CCode (cname = "FormulaResult", ref_function = "formula_result_ref", unref_function = "formula_result_unref")]
+private class FormulaResult {
+    [CCode (cname = "formula_result_text")]
+    public unowned string text();
+    
+    [CCode (cname = "formula_result_status")]
+    public int status();
+}
+
+// Один запрос: получатель фрагментов и продолжение process_task, передается в C API как user_data
+private class PendingTask {
+    public TaskProcessor.FragmentHandler handler;
+    public SourceFunc? resume;
+    public FormulaResult? result = null;
+    
+    public PendingTask(owned TaskProcessor.FragmentHandler handler, owned SourceFunc? resume) {
+        this.handler = (owned) handler;
+        this.resume = (owned) resume;
+    }
+}
+
 public class TaskProcessor : Object {
     // External C function declarations
-    [CCode (cname = "process_task_with_model")]
-    private extern string? process_task_with_model_c(string task_text, void* model_ptr);
+    [CCode (has_target = false)]
+    private delegate void FragmentCallback(string fragment, void* user_data);
+    
+    [CCode (has_target = false)]
+    private delegate void CompleteCallback(uint64 request_id, FormulaResult result, void* user_data);
+    
+    [CCode (cname = "formula_engine_submit")]
+    private extern uint64 formula_engine_submit_c(void* engine, FormulaQueue queue, string task_text, int timeout_ms,
+                                                  FragmentCallback on_fragment, CompleteCallback on_complete,
+                                                  void* user_data);
+    
+    [CCode (cname = "formula_client_solve")]
+    private extern string? formula_client_solve_c(void* client, string task_text, int timeout_ms,
+                                                  FragmentCallback callback, void* user_data, out int status);
+    
+    [CCode (cname = "formula_client_cancel")]
+    private extern void formula_client_cancel_c(void* client);
+    
+    // Обработчик очередного фрагмента решения, вызывается в главном потоке
+    public delegate void FragmentHandler(string fragment);
+    
+    // Срок решения одной задачи в миллисекундах, 0 - без срока
+    public int timeout_ms { get; set; default = 30000; }
     
     public TaskProcessor() {
         // Initialize
     }
     
-    public async string process_task(string task_text, void* model) throws Error {
-        SourceFunc callback = process_task.callback;
+    // Решение задачи: через демон, если он подключен, иначе пулом исполнителей движка.
+    // Фрагменты и результат движка приходят через его очередь событий в главном цикле,
+    // без отдельного потока на запрос. При отмене через cancellable или по истечении
+    // timeout_ms возвращается уже сгенерированная часть решения, причина - в status
+    public async string process_task(string task_text, ModelManager model_manager, Cancellable? cancellable,
+                                     owned FragmentHandler on_fragment_received,
+                                     out SolveStatus status) throws Error {
+        void* daemon_client = model_manager.get_daemon_client();
+        if (daemon_client != null) {
+            return yield process_task_daemon(task_text, model_manager, daemon_client, cancellable,
+                                             (owned) on_fragment_received, out status);
+        }
+        
+        unowned FormulaQueue queue = model_manager.get_queue();
+        var task = new PendingTask((owned) on_fragment_received, process_task.callback);
+        
+        uint64 request_id = formula_engine_submit_c(model_manager.get_model(), queue, task_text, timeout_ms,
+                                                    on_engine_fragment, on_engine_complete, task);
+        if (request_id == 0) {
+            throw new IOError.FAILED("Ошибка при обработке задачи: модель не загружена");
+        }
+        
+        ulong cancel_handler = 0;
+        if (cancellable != null) {
+            cancel_handler = cancellable.connect(() => {
+                queue.cancel(request_id);
+            });
+        }
+        
+        yield;
+        
+        if (cancellable != null) {
+            cancellable.disconnect(cancel_handler);
+        }
+        
+        status = (SolveStatus) task.result.status();
+        return task.result.text();
+    }
+    
+    // Клиент демона блокирующий, поэтому запрос к демону идет в отдельном потоке
+    private async string process_task_daemon(string task_text, ModelManager model_manager, void* daemon_client,
+                                             Cancellable? cancellable, owned FragmentHandler on_fragment_received,
+                                             out SolveStatus status) throws Error {
+        SourceFunc callback = process_task_daemon.callback;
         string? result = null;
+        int result_status = SolveStatus.ERROR;
+        
+        ulong cancel_handler = 0;
+        if (cancellable != null) {
+            cancel_handler = cancellable.connect(() => {
+                formula_client_cancel_c(daemon_client);
+            });
+        }
+        
+        var task = new PendingTask((owned) on_fragment_received, null);
         
         ThreadFunc<bool> run = () => {
-            result = process_task_with_model_c(task_text, model);
+            result = formula_client_solve_c(daemon_client, task_text, timeout_ms, on_daemon_fragment, task,
+                                            out result_status);
             Idle.add((owned) callback);
             return true;
         };
@@ -24,13 +130,42 @@ public class TaskProcessor : Object {
             yield;
             thread.join();
             
+            if (cancellable != null) {
+                cancellable.disconnect(cancel_handler);
+            }
+            
+            // Соединение с демоном потеряно: дальше нужна локальная модель
             if (result == null) {
-                throw new IOError.FAILED("Не удалось обработать задачу");
+                model_manager.disconnect_daemon();
+                throw new IOError.FAILED("Демон formula-solverd недоступен, загрузите модель");
             }
             
+            status = (SolveStatus) result_status;
             return result;
         } catch (Error e) {
             throw new IOError.FAILED("Ошибка при обработке задачи: " + e.message);
         }
     }
+    
+    // Вызывается из потока клиента демона: фрагмент копируется и передается в главный поток
+    private static void on_daemon_fragment(string fragment, void* user_data) {
+        PendingTask task = (PendingTask) user_data;
+        string text = fragment;
+        Idle.add(() => {
+            task.handler(text);
+            return Source.REMOVE;
+        });
+    }
+    
+    // Вызывается из formula_queue_dispatch в главном потоке: строка действительна только во время вызова
+    private static void on_engine_fragment(string fragment, void* user_data) {
+        PendingTask task = (PendingTask) user_data;
+        task.handler(fragment);
+    }
+    
+    private static void on_engine_complete(uint64 request_id, FormulaResult result, void* user_data) {
+        PendingTask task = (PendingTask) user_data;
+        task.result = result;
+        task.resume();
+    }
 }
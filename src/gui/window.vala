@@ -29,6 +29,9 @@ public class GTKSolverWindow : ApplicationWindow {
     private ModelManager model_manager;
     private TaskProcessor task_processor;
     
+    // Отмена выполняющегося решения
+    private Cancellable? current_request = null;
+    
     public GTKSolverWindow(Gtk.Application app) {
         Object(application: app);
         
@@ -44,10 +47,20 @@ public class GTKSolverWindow : ApplicationWindow {
         
         // Initial state setup
         save_solution_button.sensitive = false;
-        solve_button.sensitive = false;
+        
+        // Модель уже доступна, если подключен демон formula-solverd
+        solve_button.sensitive = model_manager.is_model_loaded();
         
         // Set window title
         header_bar.title_widget = new Gtk.Label("GTKSolver");
+        
+        // Незавершенное решение при закрытии окна не должно занимать ядра
+        close_request.connect(() => {
+            if (current_request != null) {
+                current_request.cancel();
+            }
+            return false;
+        });
     }
     
     private void on_solve_clicked() {
@@ -68,13 +81,47 @@ public class GTKSolverWindow : ApplicationWindow {
             return;
         }
         
-        task_processor.process_task.begin(task_text, model_manager.get_model(), (obj, res) => {
+        // Новая задача заменяет предыдущую, если та еще решается
+        if (current_request != null) {
+            current_request.cancel();
+        }
+        var cancellable = new Cancellable();
+        current_request = cancellable;
+        
+        // Решение выводится по мере генерации, итоговый текст заменяет фрагменты
+        solution_text_view.buffer.text = "";
+        TaskProcessor.FragmentHandler append_fragment = (fragment) => {
+            // Фрагменты замененного запроса уже не нужны
+            if (current_request != cancellable) {
+                return;
+            }
+            Gtk.TextIter end;
+            solution_text_view.buffer.get_end_iter(out end);
+            solution_text_view.buffer.insert(ref end, fragment, -1);
+        };
+        
+        task_processor.process_task.begin(task_text, model_manager, cancellable, (owned) append_fragment, (obj, res) => {
             try {
-                string solution = task_processor.process_task.end(res);
+                SolveStatus status;
+                string solution = task_processor.process_task.end(res, out status);
+                
+                // Запрос уже заменен новым - его результат не показываем
+                if (current_request != cancellable) {
+                    return;
+                }
+                current_request = null;
+                
+                if (status == SolveStatus.DEADLINE_EXCEEDED) {
+                    solution += "\n\n[Решение прервано: истекло время ожидания]";
+                }
                 solution_text_view.buffer.text = solution;
                 save_solution_button.sensitive = true;
                 loading_spinner.stop();
             } catch (Error e) {
+                if (current_request != cancellable) {
+                    return;
+                }
+                current_request = null;
                 show_error_dialog("Ошибка при решении", e.message);
                 loading_spinner.stop();
             }
@@ -0,0 +1,74 @@
+#include "kernels.h"
+#include <cmath>
+
+namespace formula_teacher {
+namespace runtime {
+
+namespace {
+
+float sigmoid(float x) {
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+void gemv_scalar(const float* weight, int ld, const float* x, const float* bias, float* y,
+                 int rows, int cols, bool accumulate) {
+    for (int r = 0; r < rows; ++r) {
+        const float* row = weight + static_cast<long>(r) * ld;
+        float sum = bias ? bias[r] : 0.0f;
+        for (int k = 0; k < cols; ++k) {
+            sum += row[k] * x[k];
+        }
+        y[r] = accumulate ? y[r] + sum : sum;
+    }
+}
+
+void lstm_pointwise_scalar(const float* gates, float* h, float* c, int hidden) {
+    for (int j = 0; j < hidden; ++j) {
+        float input_gate = sigmoid(gates[j]);
+        float forget_gate = sigmoid(gates[hidden + j]);
+        float cell_gate = std::tanh(gates[2 * hidden + j]);
+        float output_gate = sigmoid(gates[3 * hidden + j]);
+        
+        c[j] = forget_gate * c[j] + input_gate * cell_gate;
+        h[j] = output_gate * std::tanh(c[j]);
+    }
+}
+
+void attention_scores_scalar(const float* keys, const float* query, float* scores, int steps, int hidden) {
+    for (int s = 0; s < steps; ++s) {
+        const float* key = keys + static_cast<long>(s) * hidden;
+        float sum = 0.0f;
+        for (int j = 0; j < hidden; ++j) {
+            sum += std::tanh(key[j] + query[j]);
+        }
+        scores[s] = sum;
+    }
+}
+
+const Kernels& select_kernels() {
+#if defined(FORMULA_RUNTIME_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return avx512_kernels();
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return avx2_kernels();
+    }
+#endif
+    return scalar_kernels();
+}
+
+} // namespace
+
+const Kernels& scalar_kernels() {
+    static const Kernels table = {"scalar", gemv_scalar, lstm_pointwise_scalar, attention_scores_scalar};
+    return table;
+}
+
+const Kernels& kernels() {
+    static const Kernels& selected = select_kernels();
+    return selected;
+}
+
+} // namespace runtime
+} // namespace formula_teacher
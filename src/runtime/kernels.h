@@ -0,0 +1,36 @@
+#pragma once
+
+namespace formula_teacher {
+namespace runtime {
+
+// Вычислительные ядра автономного рантайма. Реализация выбирается один раз
+// по возможностям процессора: AVX-512, AVX2+FMA или скалярная
+struct Kernels {
+    const char* name;
+    
+    // y[rows] = W x + bias (или y += W x + bias при accumulate).
+    // W - строки длины cols с шагом ld, поэтому можно умножать на часть столбцов матрицы.
+    // bias может быть nullptr
+    void (*gemv)(const float* weight, int ld, const float* x, const float* bias, float* y,
+                 int rows, int cols, bool accumulate);
+    
+    // Поэлементная часть ячейки LSTM: gates [4H] в порядке i, f, g, o -> новые h и c (на месте)
+    void (*lstm_pointwise)(const float* gates, float* h, float* c, int hidden);
+    
+    // Оценки внимания: scores[s] = sum_j tanh(keys[s, j] + query[j]), keys - [steps, hidden]
+    void (*attention_scores)(const float* keys, const float* query, float* scores, int steps, int hidden);
+};
+
+// Ядра, выбранные для текущего процессора
+const Kernels& kernels();
+
+// Скалярные ядра, для сравнения с векторными
+const Kernels& scalar_kernels();
+
+#if defined(FORMULA_RUNTIME_X86)
+const Kernels& avx2_kernels();
+const Kernels& avx512_kernels();
+#endif
+
+} // namespace runtime
+} // namespace formula_teacher
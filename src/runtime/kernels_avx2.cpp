@@ -0,0 +1,164 @@
+// Ядра AVX2 + FMA. Файл компилируется с -mavx2 -mfma и вызывается только
+// после проверки процессора в kernels()
+#include "kernels.h"
+#include <immintrin.h>
+#include <cmath>
+
+namespace formula_teacher {
+namespace runtime {
+
+namespace {
+
+float horizontal_sum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+// exp с разложением x = n ln2 + r и полиномом Cephes, относительная ошибка ~1e-7
+__m256 exp_ps(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+    
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+                               _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+    
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    
+    // 2^n через показатель степени float
+    __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+
+__m256 sigmoid_ps(__m256 x) {
+    __m256 one = _mm256_set1_ps(1.0f);
+    return _mm256_div_ps(one, _mm256_add_ps(one, exp_ps(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+}
+
+// tanh(x) = 2 sigmoid(2x) - 1
+__m256 tanh_ps(__m256 x) {
+    __m256 two = _mm256_set1_ps(2.0f);
+    return _mm256_fmsub_ps(two, sigmoid_ps(_mm256_mul_ps(two, x)), _mm256_set1_ps(1.0f));
+}
+
+float sigmoid(float x) {
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+void store_row(float* y, int r, float sum, const float* bias, bool accumulate) {
+    if (bias) {
+        sum += bias[r];
+    }
+    y[r] = accumulate ? y[r] + sum : sum;
+}
+
+void gemv(const float* weight, int ld, const float* x, const float* bias, float* y,
+          int rows, int cols, bool accumulate) {
+    int r = 0;
+    
+    // Четыре строки за проход: вектор x загружается один раз на четыре FMA
+    for (; r + 4 <= rows; r += 4) {
+        const float* w0 = weight + static_cast<long>(r) * ld;
+        const float* w1 = w0 + ld;
+        const float* w2 = w1 + ld;
+        const float* w3 = w2 + ld;
+        
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        
+        int k = 0;
+        for (; k + 8 <= cols; k += 8) {
+            __m256 xv = _mm256_loadu_ps(x + k);
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w0 + k), xv, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(w1 + k), xv, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(w2 + k), xv, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(w3 + k), xv, acc3);
+        }
+        
+        float sum0 = horizontal_sum(acc0);
+        float sum1 = horizontal_sum(acc1);
+        float sum2 = horizontal_sum(acc2);
+        float sum3 = horizontal_sum(acc3);
+        for (; k < cols; ++k) {
+            sum0 += w0[k] * x[k];
+            sum1 += w1[k] * x[k];
+            sum2 += w2[k] * x[k];
+            sum3 += w3[k] * x[k];
+        }
+        
+        store_row(y, r, sum0, bias, accumulate);
+        store_row(y, r + 1, sum1, bias, accumulate);
+        store_row(y, r + 2, sum2, bias, accumulate);
+        store_row(y, r + 3, sum3, bias, accumulate);
+    }
+    
+    for (; r < rows; ++r) {
+        const float* w = weight + static_cast<long>(r) * ld;
+        __m256 acc = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 8 <= cols; k += 8) {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(w + k), _mm256_loadu_ps(x + k), acc);
+        }
+        float sum = horizontal_sum(acc);
+        for (; k < cols; ++k) {
+            sum += w[k] * x[k];
+        }
+        store_row(y, r, sum, bias, accumulate);
+    }
+}
+
+void lstm_pointwise(const float* gates, float* h, float* c, int hidden) {
+    int j = 0;
+    for (; j + 8 <= hidden; j += 8) {
+        __m256 input_gate = sigmoid_ps(_mm256_loadu_ps(gates + j));
+        __m256 forget_gate = sigmoid_ps(_mm256_loadu_ps(gates + hidden + j));
+        __m256 cell_gate = tanh_ps(_mm256_loadu_ps(gates + 2 * hidden + j));
+        __m256 output_gate = sigmoid_ps(_mm256_loadu_ps(gates + 3 * hidden + j));
+        
+        __m256 next_c = _mm256_fmadd_ps(forget_gate, _mm256_loadu_ps(c + j), _mm256_mul_ps(input_gate, cell_gate));
+        _mm256_storeu_ps(c + j, next_c);
+        _mm256_storeu_ps(h + j, _mm256_mul_ps(output_gate, tanh_ps(next_c)));
+    }
+    
+    for (; j < hidden; ++j) {
+        float next_c = sigmoid(gates[hidden + j]) * c[j] + sigmoid(gates[j]) * std::tanh(gates[2 * hidden + j]);
+        c[j] = next_c;
+        h[j] = sigmoid(gates[3 * hidden + j]) * std::tanh(next_c);
+    }
+}
+
+void attention_scores(const float* keys, const float* query, float* scores, int steps, int hidden) {
+    for (int s = 0; s < steps; ++s) {
+        const float* key = keys + static_cast<long>(s) * hidden;
+        __m256 acc = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= hidden; j += 8) {
+            acc = _mm256_add_ps(acc, tanh_ps(_mm256_add_ps(_mm256_loadu_ps(key + j), _mm256_loadu_ps(query + j))));
+        }
+        float sum = horizontal_sum(acc);
+        for (; j < hidden; ++j) {
+            sum += std::tanh(key[j] + query[j]);
+        }
+        scores[s] = sum;
+    }
+}
+
+} // namespace
+
+const Kernels& avx2_kernels() {
+    static const Kernels table = {"avx2", gemv, lstm_pointwise, attention_scores};
+    return table;
+}
+
+} // namespace runtime
+} // namespace formula_teacher
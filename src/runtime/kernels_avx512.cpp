@@ -0,0 +1,150 @@
+// Ядра AVX-512. Файл компилируется с -mavx512f и вызывается только
+// после проверки процессора в kernels(). Хвосты обрабатываются масками, без скалярного кода
+#include "kernels.h"
+#include <immintrin.h>
+
+namespace formula_teacher {
+namespace runtime {
+
+namespace {
+
+__mmask16 tail_mask(int count) {
+    return static_cast<__mmask16>((1u << count) - 1);
+}
+
+// exp с разложением x = n ln2 + r и полиномом Cephes, относительная ошибка ~1e-7
+__m512 exp_ps(__m512 x) {
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-87.3f)), _mm512_set1_ps(88.3f));
+    
+    __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)),
+                                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+    
+    __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+    
+    // p * 2^n
+    return _mm512_scalef_ps(p, n);
+}
+
+__m512 sigmoid_ps(__m512 x) {
+    __m512 one = _mm512_set1_ps(1.0f);
+    return _mm512_div_ps(one, _mm512_add_ps(one, exp_ps(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+}
+
+// tanh(x) = 2 sigmoid(2x) - 1
+__m512 tanh_ps(__m512 x) {
+    __m512 two = _mm512_set1_ps(2.0f);
+    return _mm512_fmsub_ps(two, sigmoid_ps(_mm512_mul_ps(two, x)), _mm512_set1_ps(1.0f));
+}
+
+void store_row(float* y, int r, float sum, const float* bias, bool accumulate) {
+    if (bias) {
+        sum += bias[r];
+    }
+    y[r] = accumulate ? y[r] + sum : sum;
+}
+
+void gemv(const float* weight, int ld, const float* x, const float* bias, float* y,
+          int rows, int cols, bool accumulate) {
+    int full = cols & ~15;
+    __mmask16 mask = tail_mask(cols - full);
+    
+    int r = 0;
+    
+    // Четыре строки за проход: вектор x загружается один раз на четыре FMA
+    for (; r + 4 <= rows; r += 4) {
+        const float* w0 = weight + static_cast<long>(r) * ld;
+        const float* w1 = w0 + ld;
+        const float* w2 = w1 + ld;
+        const float* w3 = w2 + ld;
+        
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        
+        for (int k = 0; k < full; k += 16) {
+            __m512 xv = _mm512_loadu_ps(x + k);
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(w0 + k), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(w1 + k), xv, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(w2 + k), xv, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(w3 + k), xv, acc3);
+        }
+        if (mask) {
+            __m512 xv = _mm512_maskz_loadu_ps(mask, x + full);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w0 + full), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w1 + full), xv, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w2 + full), xv, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w3 + full), xv, acc3);
+        }
+        
+        store_row(y, r, _mm512_reduce_add_ps(acc0), bias, accumulate);
+        store_row(y, r + 1, _mm512_reduce_add_ps(acc1), bias, accumulate);
+        store_row(y, r + 2, _mm512_reduce_add_ps(acc2), bias, accumulate);
+        store_row(y, r + 3, _mm512_reduce_add_ps(acc3), bias, accumulate);
+    }
+    
+    for (; r < rows; ++r) {
+        const float* w = weight + static_cast<long>(r) * ld;
+        __m512 acc = _mm512_setzero_ps();
+        for (int k = 0; k < full; k += 16) {
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(w + k), _mm512_loadu_ps(x + k), acc);
+        }
+        if (mask) {
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w + full), _mm512_maskz_loadu_ps(mask, x + full), acc);
+        }
+        store_row(y, r, _mm512_reduce_add_ps(acc), bias, accumulate);
+    }
+}
+
+void lstm_pointwise(const float* gates, float* h, float* c, int hidden) {
+    for (int j = 0; j < hidden; j += 16) {
+        __mmask16 mask = hidden - j >= 16 ? static_cast<__mmask16>(0xFFFF) : tail_mask(hidden - j);
+        
+        __m512 input_gate = sigmoid_ps(_mm512_maskz_loadu_ps(mask, gates + j));
+        __m512 forget_gate = sigmoid_ps(_mm512_maskz_loadu_ps(mask, gates + hidden + j));
+        __m512 cell_gate = tanh_ps(_mm512_maskz_loadu_ps(mask, gates + 2 * hidden + j));
+        __m512 output_gate = sigmoid_ps(_mm512_maskz_loadu_ps(mask, gates + 3 * hidden + j));
+        
+        __m512 next_c = _mm512_fmadd_ps(forget_gate, _mm512_maskz_loadu_ps(mask, c + j),
+                                        _mm512_mul_ps(input_gate, cell_gate));
+        _mm512_mask_storeu_ps(c + j, mask, next_c);
+        _mm512_mask_storeu_ps(h + j, mask, _mm512_mul_ps(output_gate, tanh_ps(next_c)));
+    }
+}
+
+void attention_scores(const float* keys, const float* query, float* scores, int steps, int hidden) {
+    int full = hidden & ~15;
+    __mmask16 mask = tail_mask(hidden - full);
+    
+    for (int s = 0; s < steps; ++s) {
+        const float* key = keys + static_cast<long>(s) * hidden;
+        __m512 acc = _mm512_setzero_ps();
+        for (int j = 0; j < full; j += 16) {
+            acc = _mm512_add_ps(acc, tanh_ps(_mm512_add_ps(_mm512_loadu_ps(key + j), _mm512_loadu_ps(query + j))));
+        }
+        if (mask) {
+            // Нули за маской дают tanh(0) = 0 и не меняют сумму
+            __m512 tail = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, key + full), _mm512_maskz_loadu_ps(mask, query + full));
+            acc = _mm512_add_ps(acc, tanh_ps(tail));
+        }
+        scores[s] = _mm512_reduce_add_ps(acc);
+    }
+}
+
+} // namespace
+
+const Kernels& avx512_kernels() {
+    static const Kernels table = {"avx512", gemv, lstm_pointwise, attention_scores};
+    return table;
+}
+
+} // namespace runtime
+} // namespace formula_teacher
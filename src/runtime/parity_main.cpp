@@ -0,0 +1,140 @@
+#include "runtime_model.h"
+#include "../core/model.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+// Сверка автономного рантайма с FormulaModel на LibTorch: логиты каждого шага
+// при одинаковых входах (teacher forcing по токенам LibTorch) и время жадной генерации
+
+void print_usage() {
+    std::cout << "Использование: runtime-parity [опции]\n"
+              << "Опции:\n"
+              << "  --model FILE       Пакет модели (.ftb). Без него сверяется случайная модель\n"
+              << "  --samples N        Количество случайных входов (по умолчанию 16)\n"
+              << "  --length N         Длина входа и число шагов декодера (по умолчанию 24)\n"
+              << "  --tolerance X      Допустимое отклонение логитов (по умолчанию 1e-3)\n"
+              << "  --help             Показать эту справку\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string model_path;
+    int samples = 16;
+    int length = 24;
+    double tolerance = 1e-3;
+    
+    // Разбор аргументов командной строки
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_path = argv[++i];
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            samples = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            length = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage();
+            return 0;
+        } else {
+            std::cerr << "Неизвестный аргумент: " << argv[i] << std::endl;
+            print_usage();
+            return 1;
+        }
+    }
+    
+    try {
+        torch::NoGradGuard no_grad;
+        
+        // Без пакета сохраняем случайную модель во временный пакет
+        std::string temp_path;
+        if (model_path.empty()) {
+            torch::manual_seed(42);
+            auto random_model = std::make_shared<formula_teacher::FormulaModel>(1000, 64, 128);
+            temp_path = "/tmp/runtime-parity-" + std::to_string(getpid()) + ".ftb";
+            random_model->save_bundle(temp_path, formula_teacher::FormulaTokenizer());
+            model_path = temp_path;
+        }
+        
+        auto bundle = formula_teacher::BundleFile::open(model_path);
+        auto torch_model = formula_teacher::FormulaModel::from_bundle(bundle);
+        torch_model->eval();
+        formula_teacher::runtime::RuntimeModel runtime_model(bundle);
+        
+        int vocab_size = runtime_model.vocab_size();
+        std::cout << "Ядра рантайма: " << runtime_model.kernels_name() << ", словарь " << vocab_size << std::endl;
+        
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> token_distribution(4, vocab_size - 1);
+        
+        double max_error = 0.0;
+        int agreement = 0;
+        int total_steps = 0;
+        double torch_seconds = 0.0;
+        double runtime_seconds = 0.0;
+        
+        for (int sample = 0; sample < samples; ++sample) {
+            std::vector<int> input_tokens{formula_teacher::FormulaTokenizer::SOS};
+            for (int i = 0; i < length; ++i) {
+                input_tokens.push_back(token_distribution(generator));
+            }
+            input_tokens.push_back(formula_teacher::FormulaTokenizer::EOS);
+            
+            // Пошаговое сравнение логитов, оба декодера получают токены LibTorch
+            auto state = torch_model->prepare(input_tokens);
+            runtime_model.start(input_tokens);
+            
+            int token = formula_teacher::FormulaTokenizer::SOS;
+            for (int step = 0; step < length; ++step) {
+                auto torch_logits = torch_model->decode_step(torch::full({1}, token, torch::kLong), state)
+                                        .squeeze(0).contiguous();
+                const float* runtime_logits = runtime_model.step(token);
+                
+                auto expected = torch_logits.data_ptr<float>();
+                for (int v = 0; v < vocab_size; ++v) {
+                    max_error = std::max(max_error, static_cast<double>(std::abs(expected[v] - runtime_logits[v])));
+                }
+                
+                int torch_token = static_cast<int>(torch_logits.argmax().item<int64_t>());
+                int runtime_token = static_cast<int>(std::max_element(runtime_logits, runtime_logits + vocab_size) - runtime_logits);
+                agreement += torch_token == runtime_token;
+                total_steps++;
+                token = torch_token;
+            }
+            
+            // Время жадной генерации одной задачи
+            auto start = std::chrono::steady_clock::now();
+            torch_model->generate(input_tokens, length);
+            auto middle = std::chrono::steady_clock::now();
+            runtime_model.generate(input_tokens, length);
+            auto end = std::chrono::steady_clock::now();
+            
+            torch_seconds += std::chrono::duration<double>(middle - start).count();
+            runtime_seconds += std::chrono::duration<double>(end - middle).count();
+        }
+        
+        if (!temp_path.empty()) {
+            std::remove(temp_path.c_str());
+        }
+        
+        std::cout << "Максимальное отклонение логитов: " << max_error << "\n"
+                  << "Совпадение токенов: " << agreement << " из " << total_steps << "\n"
+                  << "Генерация, мс на задачу: LibTorch " << torch_seconds * 1000.0 / samples
+                  << ", рантайм " << runtime_seconds * 1000.0 / samples << std::endl;
+        
+        if (max_error > tolerance) {
+            std::cerr << "Ошибка: отклонение логитов больше допустимого " << tolerance << std::endl;
+            return 1;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,186 @@
+#include "runtime_model.h"
+#include "../core/tokenizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace formula_teacher {
+namespace runtime {
+
+namespace {
+
+// Сумма смещений входа и скрытого состояния LSTM: прибавляется один раз за шаг
+std::vector<float> sum_biases(const float* bias_ih, const float* bias_hh, int size) {
+    std::vector<float> bias(size);
+    for (int i = 0; i < size; ++i) {
+        bias[i] = bias_ih[i] + bias_hh[i];
+    }
+    return bias;
+}
+
+} // namespace
+
+RuntimeModel::RuntimeModel(std::shared_ptr<BundleFile> bundle_file)
+    : bundle(std::move(bundle_file)), ops(kernels()) {
+    const BundleHeader& header = bundle->header();
+    vocab = header.vocab_size;
+    embedding_dim = header.embedding_dim;
+    hidden_dim = header.hidden_dim;
+    
+    const int64_t V = vocab;
+    const int64_t E = embedding_dim;
+    const int64_t H = hidden_dim;
+    
+    encoder_embedding = tensor("encoder.embedding.weight", {V, E});
+    encoder_w_ih[0] = tensor("encoder.lstm.weight_ih_l0", {4 * H, E});
+    encoder_w_hh[0] = tensor("encoder.lstm.weight_hh_l0", {4 * H, H});
+    encoder_bias[0] = sum_biases(tensor("encoder.lstm.bias_ih_l0", {4 * H}),
+                                 tensor("encoder.lstm.bias_hh_l0", {4 * H}), 4 * hidden_dim);
+    encoder_w_ih[1] = tensor("encoder.lstm.weight_ih_l0_reverse", {4 * H, E});
+    encoder_w_hh[1] = tensor("encoder.lstm.weight_hh_l0_reverse", {4 * H, H});
+    encoder_bias[1] = sum_biases(tensor("encoder.lstm.bias_ih_l0_reverse", {4 * H}),
+                                 tensor("encoder.lstm.bias_hh_l0_reverse", {4 * H}), 4 * hidden_dim);
+    encoder_fc_weight = tensor("encoder.fc.weight", {H, 2 * H});
+    encoder_fc_bias = tensor("encoder.fc.bias", {H});
+    
+    decoder_embedding = tensor("decoder.embedding.weight", {V, E});
+    attn_weight = tensor("decoder.attn.weight", {H, E + H});
+    attn_bias = tensor("decoder.attn.bias", {H});
+    decoder_w_ih = tensor("decoder.lstm.weight_ih_l0", {4 * H, E + H});
+    decoder_w_hh = tensor("decoder.lstm.weight_hh_l0", {4 * H, H});
+    decoder_bias = sum_biases(tensor("decoder.lstm.bias_ih_l0", {4 * H}),
+                              tensor("decoder.lstm.bias_hh_l0", {4 * H}), 4 * hidden_dim);
+    decoder_fc_weight = tensor("decoder.fc.weight", {V, H});
+    decoder_fc_bias = tensor("decoder.fc.bias", {V});
+    
+    rnn_input.resize(embedding_dim + hidden_dim);
+    query.resize(hidden_dim);
+    gates.resize(4 * hidden_dim);
+    h.resize(hidden_dim);
+    c.resize(hidden_dim);
+    logits.resize(vocab);
+}
+
+const float* RuntimeModel::tensor(const char* name, std::initializer_list<int64_t> shape) const {
+    const BundleTensor* entry = bundle->find_tensor(name);
+    if (!entry || entry->ndim != shape.size() || !std::equal(shape.begin(), shape.end(), entry->shape)) {
+        throw std::runtime_error(std::string("В пакете модели нет тензора нужной формы: ") + name);
+    }
+    return bundle->tensor_data(*entry);
+}
+
+void RuntimeModel::start(const std::vector<int>& input_tokens) {
+    steps = static_cast<int>(input_tokens.size());
+    if (steps == 0) {
+        throw std::runtime_error("Пустая входная последовательность");
+    }
+    for (int token : input_tokens) {
+        if (token < 0 || token >= vocab) {
+            throw std::runtime_error("Токен вне словаря модели: " + std::to_string(token));
+        }
+    }
+    
+    const int H = hidden_dim;
+    lstm_output.resize(static_cast<size_t>(steps) * 2 * H);
+    encoder_output.resize(static_cast<size_t>(steps) * H);
+    keys.resize(static_cast<size_t>(steps) * H);
+    scores.resize(steps);
+    
+    // Двунаправленный LSTM: выход прямого направления - первые H столбцов, обратного - вторые
+    for (int direction = 0; direction < 2; ++direction) {
+        std::fill(h.begin(), h.end(), 0.0f);
+        std::fill(c.begin(), c.end(), 0.0f);
+        
+        for (int i = 0; i < steps; ++i) {
+            int t = direction == 0 ? i : steps - 1 - i;
+            const float* embedded = encoder_embedding + static_cast<long>(input_tokens[t]) * embedding_dim;
+            
+            ops.gemv(encoder_w_ih[direction], embedding_dim, embedded, encoder_bias[direction].data(),
+                     gates.data(), 4 * H, embedding_dim, false);
+            ops.gemv(encoder_w_hh[direction], H, h.data(), nullptr, gates.data(), 4 * H, H, true);
+            ops.lstm_pointwise(gates.data(), h.data(), c.data(), H);
+            
+            std::memcpy(&lstm_output[(static_cast<size_t>(t) * 2 + direction) * H], h.data(), H * sizeof(float));
+        }
+    }
+    
+    // Выход энкодера и часть attn, относящаяся к энкодеру, - один раз на запрос
+    for (int t = 0; t < steps; ++t) {
+        float* output = &encoder_output[static_cast<size_t>(t) * H];
+        ops.gemv(encoder_fc_weight, 2 * H, &lstm_output[static_cast<size_t>(t) * 2 * H], encoder_fc_bias,
+                 output, H, 2 * H, false);
+        ops.gemv(attn_weight + embedding_dim, embedding_dim + H, output, attn_bias,
+                 &keys[static_cast<size_t>(t) * H], H, H, false);
+    }
+    
+    // Декодер начинает с нулевого состояния
+    std::fill(h.begin(), h.end(), 0.0f);
+    std::fill(c.begin(), c.end(), 0.0f);
+}
+
+const float* RuntimeModel::step(int token) {
+    if (token < 0 || token >= vocab) {
+        throw std::runtime_error("Токен вне словаря модели: " + std::to_string(token));
+    }
+    
+    const int E = embedding_dim;
+    const int H = hidden_dim;
+    
+    // Вход LSTM - [эмбеддинг; контекст], эмбеддинг сразу кладем на место
+    float* embedded = rnn_input.data();
+    float* context = rnn_input.data() + E;
+    std::memcpy(embedded, decoder_embedding + static_cast<long>(token) * E, E * sizeof(float));
+    
+    // Внимание: запрос складывается с заранее посчитанными ключами
+    ops.gemv(attn_weight, E + H, embedded, nullptr, query.data(), H, E, false);
+    ops.attention_scores(keys.data(), query.data(), scores.data(), steps, H);
+    
+    float max_score = *std::max_element(scores.begin(), scores.end());
+    float total = 0.0f;
+    for (auto& score : scores) {
+        score = std::exp(score - max_score);
+        total += score;
+    }
+    
+    std::fill(context, context + H, 0.0f);
+    for (int s = 0; s < steps; ++s) {
+        float weight = scores[s] / total;
+        const float* output = &encoder_output[static_cast<size_t>(s) * H];
+        for (int j = 0; j < H; ++j) {
+            context[j] += weight * output[j];
+        }
+    }
+    
+    // Ячейка LSTM продолжает с сохраненного состояния
+    ops.gemv(decoder_w_ih, E + H, rnn_input.data(), decoder_bias.data(), gates.data(), 4 * H, E + H, false);
+    ops.gemv(decoder_w_hh, H, h.data(), nullptr, gates.data(), 4 * H, H, true);
+    ops.lstm_pointwise(gates.data(), h.data(), c.data(), H);
+    
+    ops.gemv(decoder_fc_weight, H, h.data(), decoder_fc_bias, logits.data(), vocab, H, false);
+    return logits.data();
+}
+
+std::vector<int> RuntimeModel::generate(const std::vector<int>& input_tokens, int max_length) {
+    start(input_tokens);
+    
+    std::vector<int> output_tokens;
+    int token = FormulaTokenizer::SOS;
+    
+    for (int i = 0; i < max_length; i++) {
+        const float* scores = step(token);
+        token = static_cast<int>(std::max_element(scores, scores + vocab) - scores);
+        output_tokens.push_back(token);
+        
+        // Проверка на токен конца последовательности
+        if (token == FormulaTokenizer::EOS) {
+            break;
+        }
+    }
+    
+    return output_tokens;
+}
+
+} // namespace runtime
+} // namespace formula_teacher
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../core/bundle_file.h"
+#include "kernels.h"
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+namespace formula_teacher {
+namespace runtime {
+
+// FormulaModel без LibTorch: веса читаются прямо из отображенного пакета модели,
+// вычисления для одной задачи (batch 1) выполняют ядра из kernels.h.
+// Объект хранит рабочие буферы и состояние декодера, поэтому каждому потоку нужен свой;
+// сам пакет можно разделять между объектами
+class RuntimeModel {
+public:
+    explicit RuntimeModel(std::shared_ptr<BundleFile> bundle);
+    
+    // Кодирование входа и сброс состояния декодера
+    void start(const std::vector<int>& input_tokens);
+    
+    // Один шаг декодера после start: токен -> логиты [vocab_size]
+    const float* step(int token);
+    
+    // Жадная генерация ответа
+    std::vector<int> generate(const std::vector<int>& input_tokens, int max_length = 100);
+    
+    int vocab_size() const { return vocab; }
+    const char* kernels_name() const { return ops.name; }
+    
+private:
+    // Тензор пакета по имени с проверкой формы
+    const float* tensor(const char* name, std::initializer_list<int64_t> shape) const;
+    
+    std::shared_ptr<BundleFile> bundle;
+    const Kernels& ops;
+    
+    int vocab;
+    int embedding_dim;
+    int hidden_dim;
+    
+    // Веса энкодера
+    const float* encoder_embedding;
+    const float* encoder_w_ih[2];
+    const float* encoder_w_hh[2];
+    std::vector<float> encoder_bias[2];
+    const float* encoder_fc_weight;
+    const float* encoder_fc_bias;
+    
+    // Веса декодера. attn [H, E + H]: первые E столбцов - запрос, остальные - ключи
+    const float* decoder_embedding;
+    const float* attn_weight;
+    const float* attn_bias;
+    const float* decoder_w_ih;
+    const float* decoder_w_hh;
+    std::vector<float> decoder_bias;
+    const float* decoder_fc_weight;
+    const float* decoder_fc_bias;
+    
+    // Рабочие буферы. steps - длина текущего входа
+    int steps = 0;
+    std::vector<float> lstm_output;
+    std::vector<float> encoder_output;
+    std::vector<float> keys;
+    std::vector<float> scores;
+    std::vector<float> rnn_input;
+    std::vector<float> query;
+    std::vector<float> gates;
+    std::vector<float> h;
+    std::vector<float> c;
+    std::vector<float> logits;
+};
+
+} // namespace runtime
+} // namespace formula_teacher
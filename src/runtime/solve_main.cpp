@@ -0,0 +1,76 @@
+#include "runtime_model.h"
+#include "../core/tokenizer.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void print_usage() {
+    std::cout << "Использование: formula-solve --model FILE [опции] [задача ...]\n"
+              << "Решает задачи без LibTorch. Без задач в аргументах читает по одной задаче на строку из stdin\n"
+              << "Опции:\n"
+              << "  --model FILE       Пакет модели (.ftb), созданный train --bundle\n"
+              << "  --max-length N     Максимальная длина ответа (по умолчанию 100)\n"
+              << "  --help             Показать эту справку\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string model_path;
+    int max_length = 100;
+    std::vector<std::string> tasks;
+    
+    // Разбор аргументов командной строки
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_path = argv[++i];
+        } else if (strcmp(argv[i], "--max-length") == 0 && i + 1 < argc) {
+            max_length = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage();
+            return 0;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            std::cerr << "Неизвестный аргумент: " << argv[i] << std::endl;
+            print_usage();
+            return 1;
+        } else {
+            tasks.push_back(argv[i]);
+        }
+    }
+    
+    if (model_path.empty()) {
+        std::cerr << "Ошибка: Не указан обязательный аргумент --model" << std::endl;
+        print_usage();
+        return 1;
+    }
+    
+    try {
+        auto bundle = formula_teacher::BundleFile::open(model_path);
+        formula_teacher::FormulaTokenizer tokenizer(bundle->vocabulary());
+        formula_teacher::runtime::RuntimeModel model(bundle);
+        
+        auto solve = [&](const std::string& task) {
+            std::vector<int> input_tokens;
+            input_tokens.push_back(formula_teacher::FormulaTokenizer::SOS);
+            tokenizer.tokenize(task, input_tokens);
+            input_tokens.push_back(formula_teacher::FormulaTokenizer::EOS);
+            
+            std::cout << tokenizer.detokenize(model.generate(input_tokens, max_length)) << std::endl;
+        };
+        
+        if (tasks.empty()) {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                solve(line);
+            }
+        } else {
+            for (const auto& task : tasks) {
+                solve(task);
+            }
+        }
+        
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 1;
+    }
+}